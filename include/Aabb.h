@@ -22,6 +22,7 @@ public:
   void expand(const Vector3& vert);
   void expand(const Aabb &aabb);
   bool intersectRay(const Vector3& vert, const Vector3& dir) const;
+  bool intersectSegment(const Vector3& vert, const Vector3& dir, float &tNear) const;
   void checkFlat(float offset);
   void draw() const;
 
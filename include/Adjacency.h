@@ -0,0 +1,73 @@
+#ifndef __ADJACENCY_H__
+#define __ADJACENCY_H__
+
+#include <vector>
+#include <algorithm>
+
+/**
+* Adjacency
+* Compressed sparse row storage of index lists (triangles around a vertex, 1-ring...).
+* Every list owns a slice of one flat array, with a bit of slack after its indices so
+* that local topology edits rarely have to relocate it.
+* Adding indices may reallocate the flat array : it invalidates every Range.
+*/
+class Adjacency
+{
+public:
+  static const int slack_ = 2; //free slots reserved after each list when (re)building the store
+
+  /** Read-only view on one list */
+  class Range
+  {
+  public:
+    Range(const int *first = 0, int nb = 0) : first_(first), nb_(nb) {}
+    inline int size() const { return nb_; }
+    inline bool empty() const { return nb_==0; }
+    inline const int* begin() const { return first_; }
+    inline const int* end() const { return first_+nb_; }
+    inline int operator[](int i) const { return first_[i]; }
+    inline int front() const { return first_[0]; }
+    inline int back() const { return first_[nb_-1]; }
+    inline std::vector<int> toVector() const { return std::vector<int>(first_, first_+nb_); }
+
+  private:
+    const int *first_; //first index of the list
+    int nb_; //number of indices
+  };
+
+public:
+  Adjacency();
+  ~Adjacency();
+  void clear();
+  void init(const std::vector<int> &sizes);
+  void resize(int nbLists);
+  void compact();
+  int getNbLists() const;
+  size_t getNbBytes() const;
+
+  inline Range operator[](int i) const { return Range(data_.data()+offset_[i], size_[i]); }
+  inline int size(int i) const { return size_[i]; }
+
+  void add(int i, int val);
+  void append(const Range &list);
+  void assign(int i, const int *first, const int *last);
+  void assign(int i, const std::vector<int> &values);
+  void move(int iDst, int iSrc);
+  void set(int i, int j, int val);
+  void replace(int i, int valOld, int valNew);
+  void remove(int i, int val);
+  void removeAt(int i, int j);
+  void sort(int i);
+  void tidy(int i);
+
+private:
+  void reserve(int i, int capacity);
+
+  std::vector<int> data_; //all the lists, back to back
+  std::vector<int> offset_; //start of each list inside data_
+  std::vector<int> size_; //number of indices of each list
+  std::vector<int> capacity_; //number of slots owned by each list
+  int nbWasted_; //slots of data_ that are not owned by any list anymore
+};
+
+#endif /*__ADJACENCY_H__*/
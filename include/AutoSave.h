@@ -2,18 +2,18 @@
 #define __AUTOSAVE_H__
 
 #include <string>
+#include <memory>
 #include <cinder/Thread.h>
-#include "Vertex.h"
-#include "Triangle.h"
+#include "ThreadPool.h"
 
 class Mesh;
+class MeshSnapshot;
 
 class AutoSave {
 
 public:
 
   AutoSave();
-  void start();
   void shutdown();
   void triggerAutoSave(Mesh* mesh);
   bool haveAutoSave() const;
@@ -27,18 +27,14 @@ public:
 
 private:
 
-  void runMainLoop();
   void checkAutoSave();
 
   static std::string getUserAppDirectory();
 
   bool m_shutdown;
-  VertexVector m_vertices;
-  TriangleVector m_triangles;
-  float m_scale;
-  std::thread m_saveThread;
+  std::shared_ptr<const MeshSnapshot> m_snapshot;
   std::mutex m_saveMutex;
-  std::condition_variable m_saveCondition;
+  ThreadPool::TaskGroup m_saveTasks;
   bool m_savePending;
   double m_lastSaveTime;
 
@@ -23,9 +23,11 @@
 #include "Sculpt.h"
 
 #include "Geometry.h" // for GetClosestPointOutput declaration
+#include "IsoPotentialCache.h"
 
 
 class Mesh;
+class MeshSnapshot;
 
 struct lmRay {
   lmRay() {}
@@ -87,6 +89,10 @@ public:
 
     bool queryTriangles;
 
+    // Sample the potential on a cached lattice instead of integrating it at every query
+    bool cacheIsoPotential;
+    lmReal isoCacheSpacing; // lattice spacing, relative to the query radius
+
     int numRotationClipIterations;
 
     lmReal isoQueryPaddingRadius;
@@ -126,6 +132,8 @@ public:
       grav_k = 0.0001f;
       grav_n = 2.0f;
       queryTriangles = true;
+      cacheIsoPotential = true;
+      isoCacheSpacing = 0.05f;
       numRotationClipIterations = 1;
       isoQueryPaddingRadius = 50.0f;
       clipToIsoSurface = false;
@@ -188,6 +196,9 @@ public:
 
   lmReal IsoQueryRadius(const Mesh* mesh, IsoCameraState* state) const;
 
+  // Same from the last published epoch of the mesh (safe outside of the mesh thread).
+  lmReal IsoQueryRadius(const MeshSnapshot& snapshot, IsoCameraState* state) const;
+
   void IsoUpdateCameraTransform(const Vector3& newDirection, IsoCameraState* state, lmReal deltaTime);
 
   void IsoPreventCameraInMesh(Mesh* mesh, IsoCameraState* state);
@@ -224,6 +235,8 @@ public:
 
   lmReal GetMeshSize(const Mesh* mesh) const;
 
+  lmReal GetMeshSize(const Aabb& aabbSplit) const;
+
 private:
 
   void UpdateMeshTransform(const Mesh* mesh, Params* paramsInOut );
@@ -233,11 +246,26 @@ private:
 
   bool VerifyCameraMovement(Mesh* mesh, const Vector3& from, const Vector3& to, lmReal radius);
 
+  // Potential integrated over the triangles (or vertices) around the position.
+  lmReal IsoPotentialExact(Mesh* mesh, const Vector3& position, lmReal queryRadius);
+
+  // Potential (and its gradient) interpolated from the cached lattice.
+  lmReal IsoPotentialCached(Mesh* mesh, const Vector3& position, lmReal queryRadius, Vector3* gradientOut = NULL);
+
+  // Returns a lattice sample of the cache, computing it if needed.
+  lmReal IsoPotentialSample(Mesh* mesh, int x, int y, int z);
+
+  // Drops the cached samples around the regions modified since the last camera update.
+  void UpdateIsoPotentialCache(Mesh* mesh, lmReal queryRadius);
+
   // Helper functions:
   void CastOneRay(const Mesh* mesh, const lmRay& ray, lmRayCastOutput* result);
 
   void CastOneRay(const Mesh* mesh, const lmRay& ray, std::vector<lmRayCastOutput>* results, bool collectall = false);
 
+  // Casts several rays, by packets of Geometry::RAY_PACKET_SIZE. results must hold one vector per ray.
+  void CastRays(const Mesh* mesh, const lmRay* rays, int numRays, std::vector<lmRayCastOutput>* results, bool collectall = false);
+
   // Compute camera transform from standard camera vectors: from, to, & assumed up along y-axis.
   //
   // unused
@@ -307,6 +335,10 @@ public:
   std::mutex m_referencePointMutex;
 
   std::vector<int> m_queryTriangles;
+  std::vector<int> m_queryLeaves;
+
+  IsoPotentialCache m_isoPotentialCache;
+  const Mesh* m_isoPotentialCacheMesh;
 
 public:
 
@@ -77,7 +77,11 @@ inline bool lmIsInRange(const T& v, const T& min, const T& max) { return min <=
 
 #if !LM_PRODUCTION_BUILD
 # define LM_REPORT(message) std::cout << message
-# define LM_BREAK __asm { int 3 }
+# if _WIN32
+#  define LM_BREAK __debugbreak()
+# else
+#  define LM_BREAK __builtin_trap()
+# endif
 # define LM_ASSERT(condition, message) if (!(condition)) { LM_REPORT(message); LM_BREAK; }
 #else
 # define LM_REPORT(message)
@@ -0,0 +1,45 @@
+#ifndef __EDGEMAP_H__
+#define __EDGEMAP_H__
+
+#include <vector>
+
+/**
+* EdgeMap
+* Hash table (open addressing) associating an edge (unordered pair of vertices) to an index,
+* for example the vertex created at the middle of the edge during subdivision.
+* Lookup and insertion are constant time, clearing doesn't touch the table.
+*/
+class EdgeMap
+{
+private:
+  class Slot
+  {
+  public :
+    Slot() : iv1_(-1), iv2_(-1), value_(-1), stamp_(0) {}
+
+  public :
+    int iv1_; //smallest vertex index of the edge
+    int iv2_; //biggest vertex index of the edge
+    int value_; //value associated to the edge
+    int stamp_; //the slot is used only if it matches the stamp of the map
+  };
+
+public:
+  EdgeMap();
+  ~EdgeMap();
+  void clear();
+  bool insert(int iv1, int iv2, int &value);
+  int find(int iv1, int iv2) const;
+  int size() const;
+
+private:
+  int getSlot(int iv1, int iv2) const;
+  void grow();
+
+  std::vector<Slot> slots_; //hash table (size is a power of two)
+  int mask_; //number of slots - 1
+  int nbEdges_; //number of edges stored
+  int stamp_; //current stamp
+};
+
+#endif /*__EDGEMAP_H__*/
@@ -7,6 +7,7 @@
 #include <cstdlib>
 #include <set>
 #include "Mesh.h"
+#include "MeshSnapshot.h"
 
 /**
 * Handle files (import/export)
@@ -23,12 +24,14 @@ public:
   Mesh* loadPLY(std::istream& stream) const;
   Mesh* loadOBJ(std::istream& stream) const;
   Mesh* load3DS(std::istream& stream) const;
-  int detectNewVertex(const Vertex &v, int iTri, VertexSet &setVertices, VertexVector &vertices) const;
+  int detectNewVertex(const Vertex &v, VertexMap &verticesMap, VertexVector &vertices) const;
 
   void saveSTL(Mesh* mesh, const std::string& filename) const;
   void saveOBJ(Mesh* mesh, std::ostream& ss) const;
   void savePLY(Mesh* mesh, std::ostream& ss) const;
-  void savePLY(const VertexVector& vertices, const TriangleVector& triangles, float scale, std::ostream& ss) const;
+  void saveSTL(const MeshSnapshot& snapshot, const Matrix4x4& transformation, const std::string& filename) const;
+  void saveOBJ(const MeshSnapshot& snapshot, std::ostream& ss) const;
+  void savePLY(const MeshSnapshot& snapshot, std::ostream& ss) const;
 
 };
 
@@ -25,6 +25,7 @@
 #include "Sculpt.h"
 #include "CameraUtil.h"
 #include "AutoSave.h"
+#include "SculptLog.h"
 
 #define IRRKLANG_STATIC
 #include <irrklang.h>
@@ -41,6 +42,9 @@ class CameraUtil;
 #define LM_DISABLE_THREADING_AND_ENVIRONMENT 0
 #endif
 
+// feed the mesh thread with empty frames at the device rate, to measure the latency of the pipeline
+#define LM_SYNTHETIC_LEAP_FRAMES 0
+
 class FreeformApp : public AppNative
 {
 public:
@@ -72,6 +76,8 @@ public:
   void setWireframe(bool wireframe);
   void toggleWireframe();
   void toggleSymmetry();
+  void toggleSculptLog();
+  void setUndoFile();
   void setEnvironment(const std::string& str);
   void toggleSound();
   int loadFile();
@@ -155,6 +161,7 @@ private:
   std::thread _mesh_thread;
   bool _shutdown;
   Utilities::FPSCounter _mesh_update_counter;
+  Utilities::ExponentialFilter<float> _input_latency; // from the reception of a frame to the end of its sculpting step (ms)
   Vector3 _focus_point;
   float _focus_radius;
   double _last_update_time;
@@ -165,6 +172,7 @@ private:
   MachineSpeed _machine_speed;
   bool _lock_camera;
   AutoSave _auto_save;
+  SculptLog _sculpt_log; // inputs of the sculpting thread, replayed by ReplayHarness
   bool _first_environment_load;
   bool _have_shaders;
   std::string _screenshot_path;
@@ -222,6 +230,7 @@ private:
   bool drawOctree_;
   std::string shapes_[NUM_SHAPES];
   float remeshRadius_;
+  int smoothIterations_;
 
   // camera control settings
   CameraUtil::Params _camera_params;
@@ -11,6 +11,7 @@ public:
   void create();
   void bind();
   void allocate(const void* data, int count, GLenum pattern);
+  void update(const void* data, int offset, int count);
   void release();
   int size() const;
   void* map(GLuint access);
@@ -4,6 +4,7 @@
 #include "DataTypes.h"
 #include <cinder/gl/gl.h>
 #include "Aabb.h"
+#include <xmmintrin.h>
 
 class Mesh;
 class Triangle;
@@ -62,4 +63,45 @@ namespace Geometry {
   void getClosestPoint_noNormal(const GetClosestPointInput& input, GetClosestPointOutput* output);
 }
 
+/**
+* Packet ray casting : up to 4 segments are tested together with SSE
+*/
+namespace Geometry {
+  static const int RAY_PACKET_SIZE = 4;
+
+  struct RayPacket {
+    __m128 ox, oy, oz; // starts of the segments
+    __m128 dx, dy, dz; // end - start
+    __m128 idx, idy, idz; // inverse of the directions (slab tests)
+    int mask; // active lanes
+
+    RayPacket(const Vector3* starts, const Vector3* ends, int numRays);
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Returns the lanes whose segment enters the box before tMax (segment parameter in [0,1]).
+  int intersectionRaysAabb(const RayPacket& packet, const Aabb& aabb, const float* tMax);
+
+  // Moller-Trumbore against 4 segments, returns the lanes that hit and their parameters in tHit.
+  int intersectionRaysTriangle(const RayPacket& packet, const Vector3& v1, const Vector3& v2, const Vector3& v3, float* tHit);
+
+  static const int TRIANGLE_BATCH_SIZE = 4;
+
+  // Vertices and areas of up to 4 triangles gathered in SoA layout.
+  struct TriangleBatch {
+    __m128 v0x, v0y, v0z;
+    __m128 v1x, v1y, v1z;
+    __m128 v2x, v2y, v2z;
+    __m128 area;
+    int mask; // active lanes
+
+    void gather(const Mesh* mesh, const int* triIdx, int numTris);
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Squared distances from a point to the 4 triangles of a batch (FLT_MAX for unused lanes).
+  // The closest points are written to px/py/pz when they are not NULL.
+  __m128 getClosestPoints(const TriangleBatch& batch, const Vector3& point, __m128* px = NULL, __m128* py = NULL, __m128* pz = NULL);
+}
+
 #endif /*__GEOMETRY_H__*/
@@ -0,0 +1,54 @@
+#ifndef __ISOPOTENTIALCACHE_H__
+#define __ISOPOTENTIALCACHE_H__
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "DataTypes.h"
+#include "Aabb.h"
+
+/**
+* IsoPotentialCache
+* Sparse cache of the iso-camera potential sampled on a regular lattice. The samples are
+* grouped in bricks of brickSize_^3 allocated on demand, and a brick is dropped as soon as
+* the mesh is modified within the query radius of its samples.
+*/
+class IsoPotentialCache
+{
+public:
+  static const int brickSize_ = 4; //samples per brick along each axis
+  static const int maxBricks_ = 4096; //the cache is flushed beyond this number of bricks
+  static const float radiusStep_; //query radii are quantized geometrically with this ratio
+
+public:
+  IsoPotentialCache();
+  ~IsoPotentialCache();
+  void clear();
+  lmReal setQueryRadius(lmReal queryRadius, lmReal spacingRatio);
+  lmReal getQueryRadius() const;
+  lmReal getSpacing() const;
+  void invalidate(const Aabb &aabb);
+  bool getSample(int x, int y, int z, lmReal &value) const;
+  void setSample(int x, int y, int z, lmReal value);
+  int getNbBricks() const;
+
+private:
+  struct Brick
+  {
+    Brick() : valid_(0) {}
+    float values_[brickSize_*brickSize_*brickSize_]; //potential of the samples
+    uint64_t valid_; //one bit per computed sample
+  };
+
+  static int floorDiv(int a, int b);
+  static int64_t brickKey(int bx, int by, int bz);
+  static int sampleIndex(int x, int y, int z);
+
+  std::unordered_map<int64_t, Brick> bricks_; //bricks indexed by their lattice coordinates
+  lmReal queryRadius_; //quantized query radius used for every sample
+  lmReal spacing_; //distance between two samples
+  int radiusLevel_; //quantization level of the query radius
+  lmReal spacingRatio_; //spacing relatively to the query radius
+};
+
+#endif /*__ISOPOTENTIALCACHE_H__*/
@@ -0,0 +1,45 @@
+#ifndef __LAPLACIAN_H__
+#define __LAPLACIAN_H__
+
+#include "DataTypes.h"
+#include <vector>
+
+class Mesh;
+
+/**
+* Laplacian
+* Uniform laplacian operator of a region of the mesh, stored as a sparse matrix (CSR).
+* Each row is a vertex of the region, its columns are its neighbours : the region first,
+* then the neighbours outside the region that are kept fixed. Built once, it can be
+* applied several times (smoothing passes, Jacobi/Taubin iterations) on contiguous buffers
+* without walking the 1-rings again.
+* On the border of the mesh, a vertex is only averaged with its border neighbours.
+*/
+class Laplacian
+{
+public:
+  Laplacian();
+  ~Laplacian();
+  void init(const Mesh *mesh, const std::vector<int> &iVerts);
+  void clear();
+  int getNbVertices() const;
+  const std::vector<int>& getVertices() const;
+  void average(const Mesh *mesh, Vector3Vector &smoothVerts, Vector3Vector &smoothColors);
+  void iterate(Mesh *mesh, int nbIterations, float lambda, float mu);
+
+private:
+  void gather(const Vector3Vector &values);
+  void gatherPositions(const Mesh *mesh);
+  void multiply(const Vector3Vector &values, Vector3Vector &result) const;
+
+  std::vector<int> iVerts_; //vertices of the region, then their fixed neighbours
+  int nbRows_; //number of vertices of the region
+  std::vector<int> rowStart_; //first column of each row (nbRows_+1)
+  std::vector<int> columns_; //local index of the neighbours
+  std::vector<float> rowWeights_; //1/number of neighbours (0 if the vertex has none)
+  std::vector<int> localIndex_; //local index of each vertex of the mesh during init (-1 otherwise)
+  Vector3Vector values_; //gathered values (region and fixed neighbours)
+  Vector3Vector result_; //result of the product
+};
+
+#endif /*__LAPLACIAN_H__*/
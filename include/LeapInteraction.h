@@ -7,6 +7,7 @@
 #include "UserInterface.h"
 #include "Sculpt.h"
 #include "Utilities.h"
+#include "LockFree.h"
 #include <cinder/app/App.h>
 #include <cinder/Thread.h>
 class HandInfo;
@@ -28,13 +29,21 @@ public:
   void setBrushRadius(float _Radius) { _desired_brush_radius = _Radius; }
   void setBrushStrength(float _Strength) { _desired_brush_strength = _Strength; }
   void setBrushAuto(bool autoBrush) { _autoBrush = autoBrush; }
+  void setMotionToPhoton(float _Seconds) { _motion_to_photon = _Seconds; }
+  void setPredictionHorizon(float _Seconds) { _max_prediction_horizon = _Seconds; }
+  float getMotionToPhoton() const { return _motion_to_photon; }
+  float getPredictionHorizon() const { return std::min(_motion_to_photon, _max_prediction_horizon); }
+  float getPredictionError() const { return _prediction_error; }
+  float getLagError() const { return _lag_error; }
   double mostRecentTime() const { return Utilities::TIME_STAMP_TICKS_TO_SECS*static_cast<double>(_cur_frame.timestamp()); }
-  std::vector<Vec4f> getTips() { std::unique_lock<std::mutex> tipsLock(_tips_mutex); return _tips; }
+  double frameReceiveTime() const { return _cur_frame_receive_time; }
+  const std::vector<Vec4f>& getTips() { return _published_tips.read(); }
   double getLastCameraUpdateTime() const { return _last_camera_update_time; }
   double getLastActivityTime() const { return _last_activity_time; }
 
   static const float MIN_POINTABLE_LENGTH;
   static const float MIN_POINTABLE_AGE;
+  static const float DEFAULT_PREDICTION_HORIZON;
 
 private:
 
@@ -66,10 +75,12 @@ private:
 
   Leap::Frame _cur_frame;
   Leap::Frame _last_frame;
+  double _cur_frame_receive_time;
 
   Sculpt* _sculpt;
   UserInterface* _ui;
   std::vector<Vec4f> _tips;
+  TripleBuffer< std::vector<Vec4f> > _published_tips; // tips of the last frame, read by the render thread
   Matrix44f _model_view_inv;
   Matrix44f _model_view;
   Matrix44f _projection;
@@ -80,13 +91,18 @@ private:
   Utilities::ExponentialFilter<float> _dtheta;
   Utilities::ExponentialFilter<float> _dzoom;
   Utilities::ExponentialFilter<float> _scaleFactor;
-  std::mutex _tips_mutex;
   double _last_camera_update_time;
   float _reference_distance;
   float _fov;
   bool _autoBrush;
   double _last_activity_time;
 
+  // Brush prediction
+  float _motion_to_photon; // estimated time from the reception of a frame to its display (seconds)
+  float _max_prediction_horizon; // the brushes are extrapolated min(_motion_to_photon, _max_prediction_horizon) ahead, 0 disables
+  float _prediction_error; // distance between the predicted and the real tip at the target time (mm)
+  float _lag_error; // same without prediction (mm)
+
   // Handling pinch gesture
   bool _is_pinched;
   int _pinching_hand_id;
@@ -108,10 +124,15 @@ private:
 class HandInfo {
 public:
 
-  HandInfo() : m_lastUpdateTime(0.0), m_lastHandOpenChangeTime(0.0), m_handOpen(false), m_firstUpdate(true), m_lastPalmPos(Vector3::Zero()) {
+  static const int MAX_PENDING_PREDICTIONS = 8;
+
+  HandInfo() : m_lastUpdateTime(0.0), m_lastHandOpenChangeTime(0.0), m_handOpen(false), m_firstUpdate(true), m_lastPalmPos(Vector3::Zero()),
+    m_tipId(-1), m_tipTime(0.0), m_tipPos(Vector3::Zero()), m_tipRawVelocity(Vector3::Zero()), m_numPredictions(0) {
     m_translation.value = Vector3::Zero();
     m_transRatio.value = 0.5f;
     m_normalY.value = 0.5f;
+    m_predictionError.value = 0.0f;
+    m_lagError.value = 0.0f;
   }
 
   int getNumFingers() const { return m_numFingers.FilteredCategory(); }
@@ -121,6 +142,34 @@ public:
   double getLastUpdateTime() const { return m_lastUpdateTime; }
   double getLastHandOpenChangeTime() const { return m_lastHandOpenChangeTime; }
   bool handOpen() const { return m_handOpen; }
+  int getTipId() const { return m_tipId; }
+  float getPredictionError() const { return m_predictionError.value; }
+  float getLagError() const { return m_lagError.value; }
+
+  // tip of the frontmost pointable extrapolated horizon seconds after the last frame (leap coordinates)
+  Vector3 predictTip(double horizon) {
+    static const float MAX_PREDICTION_DISTANCE = 30.0f;
+    Vector3 offset = Vector3::Zero();
+    if (!m_tipVelocity.first && horizon > 0.0) {
+      const float h = static_cast<float>(horizon);
+      offset = h*m_tipVelocity.value;
+      if (!m_tipAcceleration.first) {
+        offset += (0.5f*h*h)*m_tipAcceleration.value;
+      }
+      const float dist = offset.norm();
+      if (dist > MAX_PREDICTION_DISTANCE) {
+        offset *= MAX_PREDICTION_DISTANCE/dist;
+      }
+    }
+    // remember the prediction, it is compared to the real trajectory once the frames reach its time
+    if (horizon > 0.0 && m_numPredictions < MAX_PENDING_PREDICTIONS) {
+      Prediction& prediction = m_predictions[m_numPredictions++];
+      prediction.time = m_tipTime + horizon;
+      prediction.predicted = m_tipPos + offset;
+      prediction.unpredicted = m_tipPos;
+    }
+    return m_tipPos + offset;
+  }
 
   Vector3 getModifiedTranslation() const {
     const float ratio = getTranslationRatio();
@@ -173,8 +222,63 @@ public:
 
     // update palm normal Y value
     m_normalY.Update(fabs(hand.palmNormal().y), curTime, NORMAL_Y_SMOOTH_STRENGTH);
+
+    updateTip(hand.pointables().frontmost(), curTime);
   }
 private:
+  struct Prediction {
+    double time;
+    Vector3 predicted;
+    Vector3 unpredicted;
+  };
+
+  // trajectory of the tip, from the frame timestamps
+  void updateTip(const Leap::Pointable& pointable, double curTime) {
+    static const float VELOCITY_SMOOTH_STRENGTH = 0.5f;
+    static const float ACCELERATION_SMOOTH_STRENGTH = 0.9f;
+    static const float ERROR_SMOOTH_STRENGTH = 0.99f;
+    const Leap::Vector temp(pointable.tipPosition());
+    const Vector3 tipPos(temp.x, temp.y, temp.z);
+    if (!pointable.isValid() || pointable.id() != m_tipId) {
+      m_tipId = pointable.isValid() ? pointable.id() : -1;
+      m_tipTime = curTime;
+      m_tipPos = tipPos;
+      m_tipVelocity.first = true;
+      m_tipAcceleration.first = true;
+      m_numPredictions = 0;
+      return;
+    }
+    const double deltaTime = curTime - m_tipTime;
+    if (deltaTime <= 0.0) {
+      return;
+    }
+
+    // score the predictions whose time is between the last two frames
+    int numKept = 0;
+    for (int i=0; i<m_numPredictions; i++) {
+      const Prediction& prediction = m_predictions[i];
+      if (prediction.time > curTime) {
+        m_predictions[numKept++] = prediction;
+      } else if (prediction.time >= m_tipTime) {
+        const float t = static_cast<float>((prediction.time - m_tipTime)/deltaTime);
+        const Vector3 actual = (1.0f-t)*m_tipPos + t*tipPos;
+        m_predictionError.Update((prediction.predicted - actual).norm(), curTime, ERROR_SMOOTH_STRENGTH);
+        m_lagError.Update((prediction.unpredicted - actual).norm(), curTime, ERROR_SMOOTH_STRENGTH);
+      }
+    }
+    m_numPredictions = numKept;
+
+    const Vector3 velocity = (tipPos - m_tipPos)/static_cast<float>(deltaTime);
+    if (!m_tipVelocity.first) {
+      const Vector3 acceleration = (velocity - m_tipRawVelocity)/static_cast<float>(deltaTime);
+      m_tipAcceleration.Update(acceleration, curTime, ACCELERATION_SMOOTH_STRENGTH);
+    }
+    m_tipVelocity.Update(velocity, curTime, VELOCITY_SMOOTH_STRENGTH);
+    m_tipRawVelocity = velocity;
+    m_tipPos = tipPos;
+    m_tipTime = curTime;
+  }
+
   bool m_firstUpdate;
   Vector3 m_lastPalmPos;
   Utilities::CategoricalFilter<10> m_numFingers;
@@ -184,6 +288,18 @@ private:
   double m_lastUpdateTime;
   bool m_handOpen;
   double m_lastHandOpenChangeTime;
+
+  // tip prediction
+  int m_tipId;
+  double m_tipTime;
+  Vector3 m_tipPos;
+  Vector3 m_tipRawVelocity;
+  Utilities::ExponentialFilter<Vector3> m_tipVelocity;
+  Utilities::ExponentialFilter<Vector3> m_tipAcceleration;
+  Utilities::ExponentialFilter<float> m_predictionError;
+  Utilities::ExponentialFilter<float> m_lagError;
+  Prediction m_predictions[MAX_PENDING_PREDICTIONS];
+  int m_numPredictions;
 };
 
 #endif
@@ -3,28 +3,49 @@
 
 #include "cinder/Thread.h"
 #include "Leap.h"
-#include <deque>
+#include "LockFree.h"
 
 class LeapListener : public Leap::Listener {
 
 public:
 
+  static const int MAX_FRAMES_BEHIND = 3; // max number of frames we can be "behind"
+
   LeapListener();
+  ~LeapListener();
   virtual void onInit( const Leap::Controller& );
   virtual void onConnect( const Leap::Controller& );
   virtual void onDisconnect( const Leap::Controller& );
   virtual void onFrame( const Leap::Controller& );
-  bool waitForFrame(Leap::Frame& _Frame, int _MillisecondsTimeout);
+  void pushFrame(const Leap::Frame& _Frame);
+  bool waitForFrame(Leap::Frame& _Frame, double& _ReceiveTime, int _MillisecondsTimeout);
+  void setLatestWins(bool _LatestWins);
+  void startSyntheticFrames(double _Frequency);
+  void stopSyntheticFrames();
   bool isConnected() const;
   bool isReceivingFrames() const;
 
 private:
 
+  struct ReceivedFrame {
+    Leap::Frame frame;
+    double time; // when the frame was pushed (seconds)
+  };
+
+  void runSyntheticFrames(double _Frequency);
+  bool timedWait(std::unique_lock<std::mutex>& _Lock, std::condition_variable& _Condition, int _MillisecondsTimeout);
+
   bool _is_connected;
   double _last_frame_time;
-  std::deque<Leap::Frame> _frameQueue;
+  SpscRing<ReceivedFrame, 8> _frames; // pushed by the Leap thread, popped by the mesh thread
+  int _max_frames_behind;
+  volatile unsigned int _consumer_waiting; // the mesh thread sleeps on _condition
   std::mutex _mutex;
   std::condition_variable _condition;
+  std::thread _synthetic_thread;
+  bool _synthetic_running;
+  std::mutex _synthetic_mutex;
+  std::condition_variable _synthetic_condition;
 
 };
 
@@ -0,0 +1,161 @@
+#ifndef __LOCKFREE_H__
+#define __LOCKFREE_H__
+
+#if _WIN32
+#include <intrin.h>
+#endif
+
+/**
+* LockFree
+* Minimal atomic operations on 32 bits indices (VS2010 has no <atomic>). The application
+* only targets x86/x64 : the loads and stores of aligned words are atomic, acquire/release
+* ordering only needs to stop the compiler from reordering.
+*/
+namespace LockFree
+{
+  inline unsigned int loadAcquire(const volatile unsigned int &value)
+  {
+#if _WIN32
+    unsigned int result = value;
+    _ReadWriteBarrier();
+    return result;
+#else
+    return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+#endif
+  }
+
+  inline void storeRelease(volatile unsigned int &value, unsigned int newValue)
+  {
+#if _WIN32
+    _ReadWriteBarrier();
+    value = newValue;
+#else
+    __atomic_store_n(&value, newValue, __ATOMIC_RELEASE);
+#endif
+  }
+
+  /** Returns the previous value (acquire and release) */
+  inline unsigned int exchange(volatile unsigned int &value, unsigned int newValue)
+  {
+#if _WIN32
+    return static_cast<unsigned int>(_InterlockedExchange(reinterpret_cast<volatile long*>(&value), static_cast<long>(newValue)));
+#else
+    return __atomic_exchange_n(&value, newValue, __ATOMIC_ACQ_REL);
+#endif
+  }
+
+  /** Full barrier, a store is not reordered with a following load */
+  inline void fence()
+  {
+#if _WIN32
+    _mm_mfence();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+  }
+}
+
+/**
+* SpscRing
+* Bounded ring shared by one producer thread and one consumer thread, without lock.
+* The consumer can skip the oldest values to stay at most maxBehind values late
+* (maxBehind = 1 : the latest value wins). A value pushed while the ring is full is dropped.
+* N must be a power of two.
+*/
+template <typename T, int N>
+class SpscRing
+{
+public:
+  SpscRing() : head_(0), tail_(0), nbDropped_(0) {}
+
+  /** Producer : false if the ring is full */
+  bool push(const T &value)
+  {
+    const unsigned int head = head_;
+    if (head - LockFree::loadAcquire(tail_) == N) {
+      ++nbDropped_;
+      return false;
+    }
+    slots_[head & (N-1)] = value;
+    LockFree::storeRelease(head_, head + 1);
+    return true;
+  }
+
+  /** Consumer : oldest value not consumed (after skipping), false if the ring is empty */
+  bool pop(T &value, int maxBehind = N)
+  {
+    unsigned int tail = tail_;
+    const unsigned int head = LockFree::loadAcquire(head_);
+    if (head == tail) {
+      return false;
+    }
+    if (head - tail > static_cast<unsigned int>(maxBehind)) {
+      tail = head - maxBehind;
+    }
+    value = slots_[tail & (N-1)];
+    LockFree::storeRelease(tail_, tail + 1);
+    return true;
+  }
+
+  bool empty() const { return LockFree::loadAcquire(head_) == LockFree::loadAcquire(tail_); }
+
+  /** Producer : values dropped because the ring was full */
+  int getNbDropped() const { return nbDropped_; }
+
+private:
+  SpscRing(const SpscRing&);
+  SpscRing& operator=(const SpscRing&);
+
+  T slots_[N];
+  volatile unsigned int head_; //next slot written (producer)
+  volatile unsigned int tail_; //next slot read (consumer)
+  int nbDropped_;
+};
+
+/**
+* TripleBuffer
+* Hands the last value written by one thread to one reader thread, without lock.
+* The writer fills the back buffer and publishes it. The reader takes the last published
+* buffer and keeps it until its next read : neither of them ever waits for the other.
+*/
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : back_(0), middle_(1), front_(2) {}
+
+  /** Writer : buffer to fill before publish */
+  T& getBack() { return buffers_[back_]; }
+
+  /** Writer : makes the back buffer the last published value */
+  void publish() { back_ = LockFree::exchange(middle_, back_ | dirty_) & ~dirty_; }
+
+  /** Writer */
+  void write(const T &value)
+  {
+    getBack() = value;
+    publish();
+  }
+
+  /** Reader : last published value, valid until the next call */
+  const T& read()
+  {
+    if (LockFree::loadAcquire(middle_) & dirty_) {
+      front_ = LockFree::exchange(middle_, front_) & ~dirty_;
+    }
+    return buffers_[front_];
+  }
+
+private:
+  static const unsigned int dirty_ = 4; //middle_ holds a buffer the reader has not seen
+
+  TripleBuffer(const TripleBuffer&);
+  TripleBuffer& operator=(const TripleBuffer&);
+
+  T buffers_[3];
+  unsigned int back_; //buffer of the writer
+  volatile unsigned int middle_; //last published buffer (plus the dirty flag)
+  unsigned int front_; //buffer of the reader
+};
+
+#endif /*__LOCKFREE_H__*/
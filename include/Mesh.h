@@ -8,18 +8,23 @@
 #include <algorithm>
 #include <stdint.h>
 #include <list>
+#include <memory>
 #include "Tools.h"
 #include "Triangle.h"
 #include "Vertex.h"
 #include "State.h"
-#if _WIN32
-#include "omp.h"
-#endif
+#include "StateFile.h"
+#include "StateJournal.h"
+#include "Adjacency.h"
+#include "Visitation.h"
+#include "ThreadPool.h"
 #include "Geometry.h"
 #include "GLBuffer.h"
 #include "Brush.h"
 
 class Octree;
+class SphereQueryCache;
+class MeshSnapshot;
 
 /**
 * Mesh
@@ -29,7 +34,7 @@ class Mesh
 {
 public:
   static const float globalScale_; //for precision issue...
-  static int stateMask_; //for history
+  static const size_t defaultUndoFileCapacity_; //maximum size of the undo file
 
 public:
   Mesh();
@@ -38,7 +43,15 @@ public:
   const TriangleVector& getTriangles() const;
   VertexVector& getVertices();
   const VertexVector& getVertices() const;
-  std::vector<Octree*>& getLeavesUpdate();
+  Vector3Vector& getMaterials();
+  const Vector3Vector& getMaterials() const;
+  Adjacency& getVerticesTriangles();
+  const Adjacency& getVerticesTriangles() const;
+  Adjacency& getVerticesRing();
+  const Adjacency& getVerticesRing() const;
+  std::vector<int>& getLeavesUpdate();
+  std::vector<Aabb>& getDirtyAabbs();
+  Visitation& getSelection();
   Triangle& getTriangle(int i);
   const Triangle& getTriangle(int i) const;
   Vertex& getVertex(int i);
@@ -63,12 +76,24 @@ public:
   double getLastUpdateTime() const { return lastUpdateTime_; }
 
   void getTrianglesFromVertices(const std::vector<int> &iVerts, std::vector<int>& triangles);
+  void getTrianglesFromVertices(const std::vector<int> &iVerts, std::vector<int>& triangles, Visitation &visitation) const;
   void getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<int>& vertices);
+  void getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<int>& vertices, Visitation &visitation) const;
   void expandTriangles(std::vector<int> &iTris, int nRing);
   void expandVertices(std::vector<int> &iVerts, int nRing);
   void computeRingVertices(int iVert);
+  int addVertex(const Vertex &v, const Vector3 &material);
+  int getNextVertex() const;
+  void removeVertex(int iVert);
+  int addTriangle();
+  void setRecycling(bool recycling);
+  bool isRecycling() const;
+  void recycleTriangle(int iTri);
+  void recycleVertex(int iVert);
+  void compact();
   void getVerticesInsideSphere(const Vector3& point, float radiusWorldSquared, std::vector<int>& result);
-  void getVerticesInsideBrush(const Brush& brush, std::vector<int>& result);
+  void getVerticesInsideBrush(const Brush& brush, std::vector<int>& result, SphereQueryCache* cache = 0);
+  void getVerticesInsideSweptBrush(const BrushVector& samples, std::vector<int>& result, std::vector<float>& times);
 
   Vector3 getTriangleCenter(int iTri) const;
   void moveTo(const Vector3& destination);
@@ -79,6 +104,11 @@ public:
   bool initMesh();
 
   void updateMesh(const std::vector<int> &iTris, const std::vector<int> &iVerts);
+  void startDeferredUpdate();
+  void flushDeferredUpdate();
+  void endDeferredUpdate();
+  std::shared_ptr<const MeshSnapshot> getSnapshot() const;
+  void setSnapshotOctree(bool snapshotOctree);
   void updateGPUBuffers();
 
   std::vector<int> subdivide(std::vector<int> &iTris,std::vector<int> &iVerts,float inradiusMaxSquared);
@@ -87,13 +117,20 @@ public:
   void checkLeavesUpdate();
 
   //undo-redo
-  TriangleVector& getTrianglesState();
-  VertexVector& getVerticesState();
   void startPushState();
   void pushState(const std::vector<int> &iTris, const std::vector<int> &iVerts);
+  void pushTriangleState(int iTri);
+  void pushVertexState(int iVert);
+  void moveTriangle(int iTri, int iTriFrom);
   void undo();
   void redo();
+  bool isUndoPending() const { return undoPending_; }
+  bool isRedoPending() const { return redoPending_; }
   void handleUndoRedo();
+  void setUndoBudget(size_t nbBytes);
+  size_t getUndoBudget() const;
+  size_t getUndoSize() const;
+  bool setUndoFile(const std::string &path, size_t capacity = defaultUndoFileCapacity_);
   void recomputeOctree(const Aabb &aabbSplit);
   void checkNormals();
   void checkVertices(const std::vector<int>& iVerts, float d2Min);
@@ -105,37 +142,70 @@ public:
 private:
 
   void updateOctree(const std::vector<int> &iTris);
+  void updateGeometry(const std::vector<int> &iTris, const std::vector<int> &iVerts);
+  void tidyPending(std::vector<int> &iTris, std::vector<int> &iVerts) const;
+  void addDirtyAabb(const Aabb &aabb);
+  void addDirtyTriangles(const std::vector<int> &iTris);
   void computeVertexNormals(const std::vector<int> &iVerts);
   float angleTri(int iTri, int iVer);
-  void initIndexVBO();
-  void initVertexVBO();
-  void reinitVerticesBuffer();
-  void reinitIndicesBuffer();
+  void initIndexVBO(int nbTriangles);
+  void initVertexVBO(int nbVertices);
+  void publishSnapshot();
+  void publishSnapshot(const std::vector<int> &iTris, const std::vector<int> &iVerts);
   void performUndo();
   void performRedo();
+  void closeState(State &state);
+  void trimHistory();
+  void spillStates(size_t nbBytes);
+  void saveTriangle(State &state, int iTri);
+  void restoreTriangle(const State &state, int iState);
+  void saveVertex(State &state, int iVert);
+  void restoreVertex(const State &state, int iState);
+  void compactTriangles(std::vector<int> &iTrisMoved);
+  void compactVertices(std::vector<int> &iVertsMoved, std::vector<int> &iTrisChanged);
+  void startRestore(const std::vector<int> &iTris, int nbTrianglesState);
+  void endRestore(const std::vector<int> &iTris, const Aabb &aabbSplit);
 
   VertexVector vertices_; //vertices
+  Vector3Vector materials_; //colors of the vertices
   TriangleVector triangles_; //triangles
+  Adjacency vertTris_; //triangles around each vertex
+  Adjacency vertRings_; //1-ring of each vertex
   std::vector<int> queryTriangles_;
   std::vector<int> queryVertices_;
+  std::vector<int> queryRing_;
+  Visitation triVisitation_; //triangles visited by the queries of the sculpting thread
+  Visitation vertVisitation_; //vertices visited by the queries of the sculpting thread
+  Visitation selection_; //vertices inside the brush (see getVerticesInsideBrush)
+  StateJournal triJournal_; //triangles saved in the current undo state
+  StateJournal vertJournal_; //vertices saved in the current undo state
   GLint verticesBufferCount_;
   GLint indicesBufferCount_;
   GLBuffer verticesBuffer_; //vertices buffer (openGL)
   GLBuffer normalsBuffer_; //normals buffer (openGL)
   GLBuffer indicesBuffer_; //indexes (openGL)
   GLBuffer colorsBuffer_;
-  bool reallocateVerticesBuffer_;
-  bool reallocateIndicesBuffer_;
-  int pendingGPUTriangles;
-  int nbGPUTriangles;
-  int pendingGPUVertices;
+  std::shared_ptr<const MeshSnapshot> snapshot_; //last published epoch of the mesh
+  mutable std::mutex snapshotMutex_; //only guards the swap/copy of snapshot_, never a sculpting step
+  std::shared_ptr<const MeshSnapshot> gpuSnapshot_; //epoch stored in the GPU buffers (rendering thread)
+  bool snapshotOctree_; //copy the octree cells in the snapshots (for drawing)
   Vector3 center_; //center of mesh
   float scale_; //scale
   Octree *octree_; //octree
   //Matrix4x4 matTransform_; //transformation matrix of the mesh
   Matrix4x4 rotationMatrix_;
   Vector3 translation_;
-  std::vector<Octree*> leavesUpdate_; //leaves of the octree to check
+  std::vector<int> leavesUpdate_; //leaves of the octree to check
+  std::vector<Aabb> dirtyAabbs_; //regions modified since the camera caches last looked at them
+  bool deferUpdates_; //updateMesh only records the modified elements
+  std::vector<int> pendingTris_; //triangles modified since startDeferredUpdate
+  std::vector<int> pendingVerts_; //vertices modified since startDeferredUpdate
+  int nbFlushedTris_; //pending triangles already updated by flushDeferredUpdate
+  int nbFlushedVerts_; //pending vertices already updated by flushDeferredUpdate
+  bool recycling_; //deleted elements leave a hole reused by the next new elements (see compact)
+  std::vector<int> freeTris_; //deleted triangles (holes) waiting for reuse or compaction
+  std::vector<int> freeVerts_; //deleted vertices (holes) waiting for reuse or compaction
+  std::vector<int> recycledTris_; //triangles deleted since the last snapshot
   bool undoPending_;
   bool redoPending_;
   double lastUpdateTime_;
@@ -145,6 +215,10 @@ private:
   std::list<State> redo_; //redo actions
   std::list<State>::iterator undoIte_; //iterator to undo
   bool beginIte_; //end of undo action
+  size_t undoBudget_; //bytes of history kept in memory, the oldest states are spilled or dropped beyond
+  StateFile stateFile_; //oldest states of the history (optional)
+  volatile unsigned int spilling_; //a spill task is writing to stateFile_
+  ThreadPool::TaskGroup stateTasks_; //compression and spill of the closed states
 
   Vector3 rotationOrigin_;
   Vector3 rotationAxis_;
@@ -152,25 +226,6 @@ private:
   float curRotation_;
   Utilities::ExponentialFilter<float> rotationVelocitySmoother_;
 
-  struct IndexUpdate {
-    int idx;
-    GLuint indices[3];
-  };
-
-  struct VertexUpdate {
-    int idx;
-    Vector3 pos;
-    Vector3 color;
-    Vector3 normal;
-  };
-
-  typedef std::vector<IndexUpdate> IndexUpdateVector;
-  typedef std::vector<VertexUpdate, Eigen::aligned_allocator<VertexUpdate> > VertexUpdateVector;
-
-  IndexUpdateVector indexUpdates_;
-  VertexUpdateVector vertexUpdates_;
-  std::mutex bufferMutex_;
-
   // Adrian's
  public:
   void verifyMesh();
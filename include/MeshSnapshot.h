@@ -0,0 +1,91 @@
+#ifndef __MESHSNAPSHOT_H__
+#define __MESHSNAPSHOT_H__
+
+#include <cinder/gl/gl.h>
+#include "DataTypes.h"
+#include "Aabb.h"
+#include <vector>
+#include <memory>
+
+class Mesh;
+
+/**
+* MeshSnapshot
+* Immutable copy of the data read outside of the sculpting thread (positions, normals,
+* colors, indices, octree cells) at one epoch of the mesh. The arrays are split in chunks
+* shared between consecutive snapshots : publishing a new epoch only rebuilds the chunks
+* holding modified elements (copy on write), the other ones are shared with the previous
+* epoch. Readers (rendering, camera, autosave, export) keep an epoch alive as long as they
+* hold the pointer, whatever the sculpting thread does meanwhile.
+*/
+class MeshSnapshot
+{
+public:
+  static const int chunkShift_ = 12;
+  static const int chunkSize_ = 1<<chunkShift_; //elements per chunk
+
+  /** Vertices of a chunk, 3 floats per vertex and attribute */
+  struct VertexChunk
+  {
+    std::vector<GLfloat> positions_;
+    std::vector<GLfloat> normals_;
+    std::vector<GLfloat> colors_;
+  };
+
+  /** Triangles of a chunk, 3 indices per triangle */
+  struct IndexChunk
+  {
+    std::vector<GLuint> indices_;
+  };
+
+  typedef std::shared_ptr<const VertexChunk> VertexChunkPtr;
+  typedef std::shared_ptr<const IndexChunk> IndexChunkPtr;
+  typedef std::shared_ptr<const std::vector<Aabb> > CellsPtr;
+
+public:
+  MeshSnapshot(const Mesh &mesh, int epoch, bool withOctree);
+  MeshSnapshot(const MeshSnapshot &previous, const Mesh &mesh, const std::vector<int> &iTris,
+    const std::vector<int> &iVerts, bool withOctree);
+  ~MeshSnapshot();
+  int getEpoch() const;
+  int getNbVertices() const;
+  int getNbTriangles() const;
+  float getScale() const;
+  const Aabb& getAabbSplit() const;
+  int getNbVertexChunks() const;
+  int getNbIndexChunks() const;
+  const VertexChunkPtr& getVertexChunk(int i) const;
+  const IndexChunkPtr& getIndexChunk(int i) const;
+
+  inline Vector3 getPosition(int iVert) const { return get(vertexChunks_[iVert>>chunkShift_]->positions_, iVert); }
+  inline Vector3 getNormal(int iVert) const { return get(vertexChunks_[iVert>>chunkShift_]->normals_, iVert); }
+  inline Vector3 getColor(int iVert) const { return get(vertexChunks_[iVert>>chunkShift_]->colors_, iVert); }
+  inline const GLuint* getTriangle(int iTri) const { return &indexChunks_[iTri>>chunkShift_]->indices_[(iTri&(chunkSize_-1))*3]; }
+
+  void drawOctree() const;
+
+private:
+  static inline Vector3 get(const std::vector<GLfloat> &values, int i)
+  {
+    const GLfloat *v = &values[(i&(chunkSize_-1))*3];
+    return Vector3(v[0], v[1], v[2]);
+  }
+  static VertexChunkPtr createVertexChunk(const Mesh &mesh, int iChunk);
+  static IndexChunkPtr createIndexChunk(const Mesh &mesh, int iChunk);
+  static int getNbChunks(int nbElements);
+  void init(const Mesh &mesh);
+  void snapshotOctree(const Mesh &mesh, const MeshSnapshot *previous, bool withOctree);
+
+  int epoch_; //increases with every snapshot of the mesh
+  int nbVertices_;
+  int nbTriangles_;
+  float scale_; //scale of the mesh
+  Aabb aabbSplit_; //root of the octree
+  std::vector<VertexChunkPtr> vertexChunks_;
+  std::vector<IndexChunkPtr> indexChunks_;
+  CellsPtr octreeCells_; //split and loose aabb of each cell (empty if not requested)
+  int octreeId_; //octree the cells were copied from
+  uint64_t octreeStamp_; //version of the octree when the cells were copied
+};
+
+#endif /*__MESHSNAPSHOT_H__*/
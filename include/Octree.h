@@ -2,13 +2,38 @@
 #define __OCTREE_H__
 
 #include <vector>
-#include <set>
 #include <algorithm>
+#include <limits>
+#include <functional>
 #include "Triangle.h"
 #include "Mesh.h"
+#include "Adjacency.h"
+
+/**
+* SphereQueryCache
+* Leaves around the previous sphere query of a moving brush. The region is larger than
+* the sphere, so that the next queries of a slow stroke only have to look at the
+* nodes modified since (see Octree::intersectSphere).
+*/
+class SphereQueryCache
+{
+public:
+  SphereQueryCache() : center_(Vector3::Zero()), radius_(-1.0f), octreeId_(-1), stamp_(0), structureStamp_(0) {}
+
+public:
+  Vector3 center_; //center of the cached region
+  float radius_; //radius of the cached region
+  int octreeId_; //octree the region was cached from
+  uint64_t stamp_; //modification stamp of the octree when the leaves were gathered
+  uint64_t structureStamp_; //structure stamp of the octree when the region was cached
+  std::vector<int> leaves_; //leaves intersecting the region
+};
 
 /**
 * Octree
+* Linear octree : the nodes are stored in one array (the 8 children of a node are consecutive)
+* and the triangles of the leaves in one index array (see Adjacency). Nodes are referenced by
+* their index, the root is node 0.
 * @author Stphane GINIER
 */
 class Octree
@@ -16,31 +41,68 @@ class Octree
 public:
   static const int maxDepth_ = 15;
   static const int maxTriangles_ = 200;
+  static const float sphereCacheMargin_; //extra radius (relative) of the regions cached by SphereQueryCache
+
+private:
+  class Node
+  {
+  public :
+    Node(int parent = -1, int depth = 0) : parent_(parent), child_(-1), depth_(depth), stamp_(0) {}
+
+  public :
+    Aabb aabbLoose_; //loose aabb (extended boundary for intersect test)
+    Aabb aabbSplit_; //split aabb (static boundary in order to store exactly the triangle according to their center)
+    int parent_; //parent node (-1 for the root)
+    int child_; //first of the 8 children (-1 if the node is a leaf)
+    int depth_; //depth of the node (-1 if the node has been cut)
+    uint64_t stamp_; //last modification of the loose aabb of the node or of a descendant
+  };
 
 public:
-  Octree(Octree *parent=0, int depth = 0);
+  Octree();
   ~Octree();
   void build(Mesh *mesh, const std::vector<int> &iTris, const Aabb &aabb);
-  void constructCells(Mesh *mesh);
-  std::vector<int>& getTriangles();
   Aabb& getAabbLoose();
   Aabb& getAabbSplit();
-  int getDepth() const;
-  Octree* getParent();
-  Octree **getChildren();
-  void draw() const;
+  const Aabb& getAabbSplit(int iNode) const;
+  const Aabb& getAabbLoose(int iNode) const;
+  void expandLoose(int iNode, const Aabb &aabb);
+  int getNbTriangles(int iLeaf) const;
+  void getCells(std::vector<Aabb> &cells) const;
+  int getId() const;
+  uint64_t getVersion() const;
   void intersectRay(const Vector3& vert, const Vector3& dir, std::vector<int>& trisHit) const;
-  void intersectSphere(const Vector3& vert, float radiusSquared, std::vector<Octree*> &leavesHit, std::vector<int>& trisHit);
-  void addTriangle(Mesh *mesh, Triangle &tri);
-  static void checkEmptiness(Octree* leaf, std::vector<Octree*> &cutLeaves);
+  int intersectRayClosest(const Mesh *mesh, const Vector3& start, const Vector3& end, Vector3& vertInter) const;
+  bool intersectRayAny(const Mesh *mesh, const Vector3& start, const Vector3& end) const;
+  void intersectRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, int *iTrisHit, float *tHit) const;
+  void intersectRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, std::vector<std::pair<float, int> > *hits) const;
+  void intersectSphere(const Vector3& vert, float radiusSquared, std::vector<int> &leavesHit, std::vector<int>& trisHit) const;
+  void intersectSphere(SphereQueryCache &cache, const Vector3& vert, float radiusSquared, std::vector<int> &leavesHit, std::vector<int>& trisHit) const;
+  void addTriangle(Triangle &tri);
+  void addTriangle(int iLeaf, Triangle &tri);
+  void removeTriangle(TriangleVector &triangles, const Triangle &tri);
+  void renameTriangle(const Triangle &tri, int iTriNew);
+  void checkLeaves(Mesh *mesh, std::vector<int> &leaves);
 
 private:
-  Octree *parent_; //parent
-  Octree *child_[8]; //children
-  Aabb aabbLoose_; //loose aabb (extended boundary for intersect test)
-  Aabb aabbSplit_; //split aabb (static boundary in order to store exactly the triangle according to their center)
-  std::vector<int> iTris_; //triangles (if cell is a leaf)
-  int depth_; //depth of current node
+  int createChildren(int iNode);
+  int traverseRay(const Mesh *mesh, const Vector3& start, const Vector3& end, bool anyHit, Vector3& vertInter) const;
+  void traverseRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, float *tMax, int *iTrisHit, std::vector<std::pair<float, int> > *hits) const;
+  void constructCells(Mesh *mesh, int iLeaf);
+  void checkEmptiness(int iLeaf);
+  void markChanged(int iNode);
+  void collectLeaves(const Vector3& vert, float radiusSquared, uint64_t minStamp, std::vector<int> &leaves) const;
+  static int getOctant(const Aabb &aabbSplit, const Vector3 &point);
+  static Aabb getOctantAabb(const Aabb &aabbSplit, int octant);
+
+  std::vector<Node> nodes_; //nodes, the 8 children of a node are stored consecutively
+  Adjacency leafTris_; //triangles of each node (empty if the node isn't a leaf)
+  std::vector<int> freeChildren_; //blocks of 8 cut nodes that can be reused
+  std::vector<int> cutChildren_; //blocks of 8 nodes cut during the current leaves check
+  int id_; //identity of the cells, a rebuilt octree gets a new one
+  uint64_t stamp_; //modification counter of this octree, advanced by every change of the cells
+  uint64_t structureStamp_; //changes whenever nodes are split or cut
+  static int nbIds_; //identities given so far (octrees are only built by the mesh thread)
 };
 
 #endif /*__OCTREE_H__*/
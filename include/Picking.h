@@ -37,6 +37,7 @@ private:
   Mesh *mesh_; //selected mesh
   int pickedTriangle_; //triangle picked
   std::vector<int> pickedVertices_; //vertices selected
+  Visitation visitation_; //vertices visited by the picking queries
   Vector3 intersectionPoint_; //intersection point
   float radiusScreen_; //radius of the selection area (screen unit)
   float radiusWorldSquared_; //radius of the selection area (world unit)
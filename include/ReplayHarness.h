@@ -0,0 +1,48 @@
+#ifndef __REPLAYHARNESS_H__
+#define __REPLAYHARNESS_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+class Mesh;
+
+/**
+* ReplayHarness
+* Replays a SculptLog on a mesh without window, Leap device nor GL context : only Mesh,
+* Sculpt and Topology run, on the calling thread and the ThreadPool. The replay is
+* deterministic (same log and mesh : same result) and times every step, so real sculpting
+* sessions can be benchmarked on build machines.
+*/
+class ReplayHarness
+{
+public:
+  /** Measures of one replayed step */
+  struct FrameTiming
+  {
+    int frame_;
+    double time_; //recorded time of the step (seconds)
+    int nbBrushes_;
+    float sculptMs_; //duration of applyBrushes
+    int nbTriangles_;
+    int nbVertices_;
+  };
+
+public:
+  ReplayHarness();
+  ~ReplayHarness();
+  bool run(Mesh *mesh, const std::string& logFilename);
+  bool run(const std::string& meshFilename, const std::string& logFilename);
+  const std::vector<FrameTiming>& getTimings() const;
+  void writeTimings(std::ostream& os) const;
+  void writeSummary(std::ostream& os) const;
+  float getPercentile(float percentile) const;
+
+  static int main(int argc, char** argv);
+
+private:
+  std::vector<FrameTiming> timings_; //one per replayed step
+  double totalMs_; //sum of the durations of the steps
+};
+
+#endif /*__REPLAYHARNESS_H__*/
@@ -11,7 +11,11 @@
 #define LM_USE_ITEMS 0
 
 #ifndef LM_BREAK
-# define LM_BREAK __asm { int 3 }
+# if _WIN32
+#  define LM_BREAK __debugbreak()
+# else
+#  define LM_BREAK __builtin_trap()
+# endif
 #endif
 #ifndef LM_ASSERT
 # define LM_ASSERT(condition, message) if (!(condition)) LM_BREAK;
@@ -4,9 +4,13 @@
 #include "DataTypes.h"
 #include "Mesh.h"
 #include "Topology.h"
+#include "Octree.h"
+#include "Laplacian.h"
+#include "LockFree.h"
 #include <vector>
 
 class AutoSave;
+class SculptLog;
 
 /**
 * Sculpt
@@ -27,29 +31,36 @@ public:
   bool isSweep() { return sculptMode_==SWEEP; }
   void setMaterialColor(const Vector3& color) { materialColor_ = color; }
   void setSymmetry(bool symmetry) { symmetry_ = symmetry; }
+  void setLog(SculptLog *log) { log_ = log; }
   bool symmetry() const { return symmetry_; }
+  void setRecycling(bool recycling) { recycling_ = recycling; }
+  bool recycling() const { return recycling_; }
 
   void setRemeshRadius(float remeshRadius) { remeshRadius_ = remeshRadius; }
+  void setSmoothMesh(int nbIterations) { smoothMeshIterations_ = nbIterations; }
   void sculptMesh(std::vector<int> &iVertsSelected, const Brush& brush);
 
   static void setDetail(float detail) { detail_ = detail; }
-  static void smooth(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, bool limit = true);
-  static void smoothFlat(Mesh* mesh, const std::vector<int> &iVerts);
-  static void draw(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, bool negate = false);
-  static void flatten(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush);
-  static void sweep(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush);
-  static void push(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush);
-  static void crease(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush);
-  static void paint(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, const Vector3& color);
+  static float getDetail() { return detail_; }
+  static void smooth(Mesh* mesh, Laplacian &laplacian, const Brush& brush, bool limit = true);
+  static void smoothFlat(Mesh* mesh, Laplacian &laplacian);
+  static void draw(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths, bool negate = false);
+  static void flatten(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths);
+  static void sweep(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths);
+  static void push(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths);
+  static void crease(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths);
+  static void paint(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, const Vector3& color, std::vector<float> &strengths);
 
   int getNumBrushes() const { return (int)_brushes.size(); }
   void addBrush(const Vector3& worldPos, const Vector3& pos, const Vector3& dir, const Vector3& vel, float radius, float strength, float activation);
   void clearBrushes() { _brushes.clear(); }
+  void setBrushes(const BrushVector& brushes) { _brushes = brushes; }
   void applyBrushes(double curTime, AutoSave* autoSave);
-  BrushVector getBrushes() const;
+  void publishBrushes();
+  const BrushVector& getBrushes();
   double getLastSculptTime() const { return lastSculptTime_; }
-
-  std::mutex& getBrushMutex();
+  float getSculptDuration() const { return sculptDuration_.value; }
+  float getLastSculptDuration() const { return lastSculptDuration_; }
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -57,17 +68,20 @@ private:
   static void setAdaptiveParameters(float radiusSquared);
   static Vector3 areaNormal(Mesh* mesh, const std::vector<int> &iVerts);
   static Vector3 areaCenter(Mesh* mesh, const std::vector<int> &iVerts);
-  static void laplacianSmooth(Mesh* mesh, const std::vector<int> &iVerts, Vector3Vector &smoothVerts, Vector3Vector &smoothColors);
+  static void computeStrengths(const VertexVector &vertices, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths);
   void remesh(float remeshRadius);
+  void smoothMesh(int nbIterations);
+  void getSweptVerticesInsideBrush(const Brush& brush, float sampleIndex, float sampleWindow, std::vector<int>& result);
+  void logFrame(double curTime);
 
 private:
 
   struct MaskMatch {
-    MaskMatch(const VertexVector& verts) : vertices(verts) { }
+    MaskMatch(const Visitation& sel) : selection(sel) { }
     bool operator()(const int& idx) {
-      return vertices[idx].sculptFlag_ != Vertex::sculptMask_;
+      return !selection.isVisited(idx);
     }
-    const VertexVector& vertices;
+    const Visitation& selection;
   };
 
   static float detail_; //intensity of details
@@ -84,15 +98,27 @@ private:
   Vector3 materialColor_;
   float autoSmoothStrength_;
   std::vector<int> brushVertices_;
+  BrushVector frameBrushes_; //copy of the brushes sculpting the current frame
+  BrushVector sampleBrushes_; //brush at each rotation sample of the frame
+  std::vector<int> sweptVertices_; //vertices swept by the brush during the frame
+  std::vector<float> sweptTimes_; //sample index of closest approach of each swept vertex
+  std::vector<SphereQueryCache> brushCaches_; //region of the previous query of each brush
   std::vector<int> iTris_;
-  mutable std::mutex brushMutex_;
   double lastSculptTime_;
   double lastUpdateTime_;
   Topology topo_;
   float remeshRadius_;
+  int smoothMeshIterations_; //pending smoothing of the whole mesh
+  Laplacian laplacian_; //operator of the sculpted region, shared by the smoothing passes
+  std::vector<float> strengths_; //falloff of the sculpted vertices, reused by the deformation kernels
   bool symmetry_;
+  bool recycling_; //the topology leaves holes reused by the new elements (see Mesh::setRecycling)
+  Utilities::ExponentialFilter<float> sculptDuration_; //time spent in applyBrushes per frame (ms)
+  float lastSculptDuration_; //time spent in the last applyBrushes (ms)
+  SculptLog *log_; //records the inputs of applyBrushes (can be null)
 
   BrushVector _brushes;
+  TripleBuffer<BrushVector> publishedBrushes_; //brushes of the last frame, read by the render thread
 };
 
 #endif /*__SCULPT_H__*/
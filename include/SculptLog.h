@@ -0,0 +1,82 @@
+#ifndef __SCULPTLOG_H__
+#define __SCULPTLOG_H__
+
+#include "DataTypes.h"
+#include "Brush.h"
+#include <string>
+#include <fstream>
+
+/**
+* SculptLog
+* Compact binary log of a sculpting session. One record per step of the sculpting thread :
+* its time, the brushes, and only the settings that changed since the previous record
+* (modes, color, detail, spin, remesh/smooth requests, undo/redo).
+* The mesh at the start of the recording is saved beside the log (ply). Reloading it
+* normalizes it again : the header keeps the scale of the recorded mesh to match the brushes.
+* Replaying the records through Sculpt::applyBrushes repeats the session without window,
+* device nor GL context (see ReplayHarness).
+*/
+class SculptLog
+{
+public:
+  static const unsigned int magic_ = 0x4c534d4c; //"LMSL"
+  static const unsigned int version_ = 1;
+
+  /** Inputs of one step of the sculpting thread */
+  struct Frame
+  {
+    Frame();
+    double time_; //time given to applyBrushes (seconds)
+    int sculptMode_;
+    int topoMode_;
+    Vector3 materialColor_;
+    float detail_;
+    float rotationVelocity_; //requested spin of the mesh
+    float remeshRadius_; //remesh requested during this step (-1 : none)
+    int smoothMeshIterations_; //smoothing requested during this step (0 : none)
+    bool undo_;
+    bool redo_;
+    BrushVector brushes_; //brushes in world space, symmetry included
+  };
+
+public:
+  SculptLog();
+  ~SculptLog();
+  bool openWrite(const std::string& filename, float meshScale);
+  bool openRead(const std::string& filename);
+  void close();
+  bool isRecording() const;
+  int getNbFrames() const;
+  float getMeshScale() const;
+  void write(const Frame& frame);
+  bool read(Frame& frame);
+
+private:
+  /** Settings stored in a record (bit flags) */
+  enum Change {
+    CHANGE_MODES = 1,
+    CHANGE_MATERIAL = 2,
+    CHANGE_DETAIL = 4,
+    CHANGE_ROTATION = 8,
+    CHANGE_REMESH = 16,
+    CHANGE_SMOOTH = 32,
+    CHANGE_UNDO = 64,
+    CHANGE_REDO = 128
+  };
+
+  SculptLog(const SculptLog&);
+  SculptLog& operator=(const SculptLog&);
+
+  template <typename T> void put(const T &value) { stream_.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+  template <typename T> bool get(T &value) { return !stream_.read(reinterpret_cast<char*>(&value), sizeof(T)).fail(); }
+  void putVector(const Vector3 &v);
+  bool getVector(Vector3 &v);
+
+  std::fstream stream_;
+  bool recording_; //opened by openWrite
+  float meshScale_; //scale of the mesh when the recording started (see Mesh::getScale)
+  int nbFrames_; //records written or read
+  Frame last_; //settings of the previous record (the changes are relative to it)
+};
+
+#endif /*__SCULPTLOG_H__*/
@@ -3,9 +3,22 @@
 
 #include "Vertex.h"
 #include "Triangle.h"
+#include "Adjacency.h"
+#include <vector>
+
+class Mesh;
+class StateFile;
 
 /**
 * State
+* One step of the history. While the step is recorded, the state holds plain copies of the
+* elements before their first modification. Once closed, only the differences with the mesh
+* at that time are kept : the indices of the saved elements, the exact deltas of the
+* attributes that changed and the triangles/adjacency lists that the topology edits touched.
+* This stream is then compressed (variable length integers) by a background task, and the
+* oldest states can be moved to a memory-mapped file (see spill).
+* A closed state is opened against the same mesh configuration, which the undo/redo chain
+* guarantees since every element modified by a step is saved in its state.
 * @author Stphane GINIER
 */
 class State
@@ -13,13 +26,47 @@ class State
 public:
   State();
   ~State();
+  void close(const Mesh &mesh);
+  void compress();
+  void spill(StateFile &file);
+  void open(const Mesh &mesh);
+  void releaseCopies();
+  bool isClosed() const;
+  bool isCompressed() const;
+  bool isSpilled() const;
+  bool isSpillDone() const;
+  bool isSpillFailed() const;
+  size_t getNbPackedBytes() const;
+  bool hasCopies() const;
+  size_t getNbBytes() const;
 
 public:
   int nbTrianglesState_; //number of triangles
   int nbVerticesState_; //number of vertices
-  TriangleVector tState_; //copies of some triangles
+  std::vector<int> tIdState_; //index of the copied triangles
+  std::vector<int> tIndicesState_; //vertices of the copied triangles (3 per triangle, same order as tIdState_)
   VertexVector vState_; //copies of some vertices
+  std::vector<int> vIdState_; //index of the copied vertices (same order as vState_)
+  Vector3Vector vMaterialState_; //colors of the copied vertices (same order as vState_)
+  Adjacency vTrisState_; //triangles around the copied vertices (same order as vState_)
+  Adjacency vRingState_; //1-ring of the copied vertices (same order as vState_)
   Aabb aabbState_; //root aabb
+  bool compressRequested_; //a compression task was submitted (mesh thread only)
+  bool spillRequested_; //the state was given a place in the undo file (mesh thread only)
+  size_t fileOffset_; //place of the compressed state in the undo file
+
+private:
+  int nbTrianglesBase_; //number of triangles of the mesh the deltas refer to
+  int nbVerticesBase_; //number of vertices of the mesh the deltas refer to
+  bool copies_; //the plain copies are available
+  bool closed_; //the differences with the mesh were computed
+  size_t nbDeltaBytes_; //size of the uncompressed differences
+  std::vector<int> deltas_; //differences with the mesh (before compression)
+  std::vector<unsigned char> packed_; //differences with the mesh (after compression)
+  size_t nbPackedBytes_; //size of the compressed differences
+  const StateFile *file_; //file holding the compressed differences once spilled
+  volatile unsigned int compressed_; //set by the compression task once packed_ is ready
+  volatile unsigned int spilled_; //set by the spill task (SPILL_DONE or SPILL_FAILED)
 };
 
 #endif /*__UNDO_H__*/
@@ -0,0 +1,39 @@
+#ifndef __STATEFILE_H__
+#define __STATEFILE_H__
+
+#include <string>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/**
+* StateFile
+* Memory-mapped file receiving the compressed undo states that do not fit in memory anymore.
+* The owner of the states decides where each state goes (see Mesh::spillStates), the file
+* grows by doubling up to its capacity. Reading a state only touches its own pages, the
+* system pages them back in on demand. Writes and reads must not overlap.
+*/
+class StateFile
+{
+public:
+  StateFile();
+  ~StateFile();
+  bool open(const std::string &path, size_t capacity);
+  void close();
+  bool isOpen() const;
+  size_t getCapacity() const;
+  bool write(size_t offset, const unsigned char *data, size_t nb);
+  const unsigned char* getData(size_t offset) const;
+
+private:
+  StateFile(const StateFile&);
+  StateFile& operator=(const StateFile&);
+  bool resize(size_t size);
+
+  std::string path_; //path of the file (removed when closed)
+  size_t capacity_; //maximum size of the file
+  size_t size_; //current size of the file and of the mapping
+  boost::interprocess::file_mapping mapping_;
+  boost::interprocess::mapped_region region_;
+};
+
+#endif /*__STATEFILE_H__*/
@@ -0,0 +1,44 @@
+#ifndef __STATEJOURNAL_H__
+#define __STATEJOURNAL_H__
+
+#include <vector>
+
+/**
+* StateJournal
+* Elements (vertices or triangles) already saved in the current undo state : one bit per
+* element that existed when the state started, the elements added since never need to be
+* saved. The marked elements are also logged in the order of their first touch, so that
+* starting the next state only clears their bits instead of the whole mesh.
+*/
+class StateJournal
+{
+public:
+  StateJournal();
+  ~StateJournal();
+  void start(int nbElements);
+  void move(int iDst, int iSrc);
+
+  /** Is the element saved already (or added by the state) */
+  inline bool isMarked(int i) const { return i>=nbElements_ || (bits_[i>>5]&(1u<<(i&31)))!=0; }
+
+  /** Mark an element, return false if it doesn't need to be saved (already marked or added by the state) */
+  inline bool mark(int i)
+  {
+    if(i>=nbElements_)
+      return false;
+    unsigned int &word = bits_[i>>5];
+    const unsigned int bit = 1u<<(i&31);
+    if(word&bit)
+      return false;
+    word |= bit;
+    log_.push_back(i);
+    return true;
+  }
+
+private:
+  std::vector<unsigned int> bits_; //one bit per element of the start of the state
+  std::vector<int> log_; //marked elements, in the order of their first touch
+  int nbElements_; //number of elements when the state started
+};
+
+#endif /*__STATEJOURNAL_H__*/
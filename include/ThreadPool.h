@@ -0,0 +1,152 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <cinder/Thread.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+
+/**
+* ThreadPool
+* Work stealing pool shared by every parallel part of the application (sculpting kernels,
+* octree, cubemap filtering, autosave...). Its workers are created once, sized to the
+* machine. Each worker owns a deque of tasks : it pops its newest task, and steals the
+* oldest task of another worker when its own deque is empty. Tasks submitted from outside
+* of the pool (sculpting thread, render thread...) go to a shared deque.
+* A thread waiting for a task group executes the pending tasks of that group meanwhile,
+* so nested parallel loops never deadlock and a long background task (autosave) is never
+* run by a thread waiting for a parallel loop.
+*/
+class ThreadPool
+{
+public:
+  typedef std::function<void()> Task;
+  /** Called after each task : name of its group, worker (-1 outside of the pool), duration (seconds) */
+  typedef std::function<void(const char *name, int iWorker, double duration)> TimingHook;
+
+  static const int chunksPerThread_ = 4; //chunks of a parallel loop per thread (load balancing)
+
+  /** Tasks waited for together */
+  class TaskGroup
+  {
+  public:
+    TaskGroup(const char *name = "task");
+    ~TaskGroup();
+    void run(const Task &task);
+    void wait();
+    const char* getName() const;
+
+  private:
+    friend class ThreadPool;
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+    void done();
+
+    const char *name_; //name given to the timing hook
+    int nbPending_; //tasks submitted but not finished
+    std::mutex mutex_;
+    std::condition_variable condition_;
+  };
+
+public:
+  static ThreadPool& getInstance() { static ThreadPool instance; return instance; }
+  int getNbThreads() const;
+  void setTimingHook(const TimingHook &hook);
+
+  template <typename Body>
+  static void parallelFor(int begin, int end, const Body &body, int grain = 64);
+  template <typename T, typename Body, typename Join>
+  static T parallelReduce(int begin, int end, const T &identity, const Body &body, const Join &join, int grain = 64);
+
+private:
+  struct Job
+  {
+    Task task_;
+    TaskGroup *group_;
+  };
+
+  /** Deque of a worker (the last one is shared by the threads outside of the pool) */
+  struct Queue
+  {
+    std::deque<Job> jobs_;
+    std::mutex mutex_;
+  };
+
+  ThreadPool();
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+  void push(const Job &job);
+  bool pop(int iQueue, Job &job);
+  bool steal(int iThief, const TaskGroup *group, Job &job);
+  void taken();
+  void execute(Job &job, int iWorker);
+  void runWorker(int iWorker);
+  static int getNbChunks(int nbElements, int grain);
+  static int getCurrentWorker();
+
+  std::vector<Queue*> queues_; //one per worker, plus the shared one
+  std::vector<std::thread*> workers_;
+  int nbQueued_; //jobs waiting in the deques
+  bool shutdown_;
+  std::mutex sleepMutex_; //guards nbQueued_ and shutdown_
+  std::condition_variable sleepCondition_;
+  TimingHook timingHook_; //set before submitting work
+};
+
+/**
+* Apply body(i) for i in [begin, end). The range is cut in chunks of at least grain
+* elements, the calling thread runs the first chunk.
+*/
+template <typename Body>
+void ThreadPool::parallelFor(int begin, int end, const Body &body, int grain)
+{
+  const int nbElements = end-begin;
+  const int nbChunks = getNbChunks(nbElements, grain);
+  if(nbChunks<=1)
+  {
+    for(int i=begin;i<end;++i)
+      body(i);
+    return;
+  }
+  TaskGroup group("parallelFor");
+  for(int c=1;c<nbChunks;++c)
+  {
+    const int first = begin+static_cast<int>(static_cast<long long>(nbElements)*c/nbChunks);
+    const int last = begin+static_cast<int>(static_cast<long long>(nbElements)*(c+1)/nbChunks);
+    group.run([&body, first, last]() {
+      for(int i=first;i<last;++i)
+        body(i);
+    });
+  }
+  const int firstEnd = begin+nbElements/nbChunks;
+  for(int i=begin;i<firstEnd;++i)
+    body(i);
+  group.wait();
+}
+
+/**
+* Reduce [begin, end) : body(i, partial) accumulates element i into the partial result
+* of its chunk (initialized to identity), the partial results are then joined in order
+* with join(a, b), so the result doesn't depend on the scheduling.
+*/
+template <typename T, typename Body, typename Join>
+T ThreadPool::parallelReduce(int begin, int end, const T &identity, const Body &body, const Join &join, int grain)
+{
+  const int nbElements = end-begin;
+  const int nbChunks = std::max(1, getNbChunks(nbElements, grain));
+  std::vector<T> partials(nbChunks, identity);
+  parallelFor(0, nbChunks, [&](int c) {
+    const int first = begin+static_cast<int>(static_cast<long long>(nbElements)*c/nbChunks);
+    const int last = begin+static_cast<int>(static_cast<long long>(nbElements)*(c+1)/nbChunks);
+    for(int i=first;i<last;++i)
+      body(i, partials[c]);
+  }, 1);
+  T result = partials[0];
+  for(int c=1;c<nbChunks;++c)
+    result = join(result, partials[c]);
+  return result;
+}
+
+#endif /*__THREADPOOL_H__*/
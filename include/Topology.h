@@ -10,6 +10,8 @@
 #include "Mesh.h"
 #include "Grid.h"
 #include "Octree.h"
+#include "EdgeMap.h"
+#include "Laplacian.h"
 
 /**
 * Topology functions
@@ -31,12 +33,14 @@ private:
   };
 
 public :
-  Topology() : mesh_(0), triangles_(0), vertices_(0), centerPoint_(Vector3::Zero()), radiusSquared_(0.0f) {}
+  Topology() : mesh_(0), triangles_(0), vertices_(0), vertTris_(0), vertRings_(0), centerPoint_(Vector3::Zero()), radiusSquared_(0.0f) {}
   ~Topology() {}
   void init(Mesh *mesh, float radiusSquared, const Vector3& centerPoint) {
     mesh_ = mesh;
     triangles_ = &mesh->getTriangles();
     vertices_ = &mesh->getVertices();
+    vertTris_ = &mesh->getVerticesTriangles();
+    vertRings_ = &mesh->getVerticesRing();
     centerPoint_ = centerPoint;
     radiusSquared_ = radiusSquared;
     verticesMap_.clear();
@@ -46,19 +50,27 @@ public :
     iTrisSubd_.clear();
     iVertsSubd_.clear();
     split_.clear();
+    iTrisNew_.clear();
+    iVertsNew_.clear();
+    iVertsReused_.clear();
+    iVertsMoved_.clear();
   }
   void subdivision(std::vector<int> &iTris, float detailMaxSquared);
   void decimation(std::vector<int> &iTris, float detailMinSquared);
   void adaptTopology(std::vector<int> &iTris, float d2Thickness);
+  /** Vertices created since init in the holes of deleted vertices (see Mesh::setRecycling) */
+  const std::vector<int>& getReusedVertices() const { return iVertsReused_; }
+  /** Slots that received the last vertex of the array since init (swap delete) */
+  const std::vector<int>& getMovedVertices() const { return iVertsMoved_; }
 
 private :
   //subdivision stuffs
-  void subdivide(std::vector<int> &iTris, float detail);
+  bool subdivide(std::vector<int> &iTris, float detail);
   void initSplit(std::vector<int> &iTris, std::vector<int> &iTrisSubd, std::vector<int> &split, float detailSquared);
   void subdivideTriangles(std::vector<int> &iTrisSubd, std::vector<int> &split, float detailSquared);
   void halfEdgeSplit(int iTri, int iv1, int iv2, int iv3);
   void fillTriangles(std::vector<int> &iTris);
-  void fillTriangle(int iTri, int iv1, int iv2, int iv3, int ivMid);
+  int fillTriangle(int iTri, int iv1, int iv2, int iv3, int ivMid);
   int findSplit(int iTri, float detailSquared, bool checkInsideSphere = false);
 
   //decimation stuffs
@@ -88,12 +100,18 @@ private :
 private:
   inline TriangleVector& triangles() { return *triangles_; }
   inline VertexVector& vertices() { return *vertices_; }
+  inline Adjacency& vertTris() { return *vertTris_; }
+  inline Adjacency& vertRings() { return *vertRings_; }
+  /** Vertex visited by the current vertex visitation, and not deleted since */
+  inline bool isTagged(int iVert) { return vertVisitation_.isVisited(iVert) && vertices()[iVert].tagFlag_>=0; }
 
   Mesh *mesh_; //mesh
   TriangleVector* triangles_; //reference to mesh triangles
   VertexVector* vertices_; //reference to mesh vertices
+  Adjacency* vertTris_; //reference to mesh triangles around each vertex
+  Adjacency* vertRings_; //reference to mesh 1-ring of each vertex
   Vector3 centerPoint_; //center of brush
-  std::map<std::pair<int,int>,int> verticesMap_; //to detect new vertices at the middle of edge (for subdivision)
+  EdgeMap verticesMap_; //to detect new vertices at the middle of edge (for subdivision)
   float radiusSquared_; //radius squared
   std::vector<int> iVertsDecimated_; //vertices to be updated (mainly for the VBO's, used in decimation and adaptive topo)
   std::vector<int> iTrisToDelete_; //triangles to be deleted
@@ -101,7 +119,14 @@ private:
   std::vector<int> iTrisSubd_;
   std::vector<int> iVertsSubd_;
   std::vector<int> split_;
+  std::vector<int> iTrisNew_; //triangles created by the current subdivision pass
+  std::vector<int> iVertsNew_; //vertices created by the current subdivision pass
+  std::vector<int> iVertsReused_; //vertices created in the holes of deleted vertices
+  std::vector<int> iVertsMoved_; //slots of deleted vertices that received the last vertex
   Grid grid_;
+  Visitation triVisitation_; //triangles visited by the topology functions
+  Visitation vertVisitation_; //vertices visited by the topology functions
+  Laplacian laplacian_; //operator of the regions smoothed by the topology functions
 };
 
 #endif /*__TOPOLOGY_H__*/
@@ -5,8 +5,6 @@
 #include "Aabb.h"
 #include <vector>
 
-class Octree;
-
 /**
 * Triangle
 * @author Stphane GINIER
@@ -14,9 +12,7 @@ class Octree;
 class Triangle
 {
 public:
-  static int tagMask_; //flag mask value (always >= tagFlag_)
-  int tagFlag_; //general purpose flag (<0 means the triangle is to be deleted)
-  int stateFlag_; //flag for history
+  int tagFlag_; //<0 means the triangle is to be deleted
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 public:
@@ -30,7 +26,7 @@ public:
   int vIndices_[3]; //indices of vertices
   Vector3 normal_; //normal of triangle
   Aabb aabb_; //bounding box of the triangle
-  Octree *leaf_; //octree leaf
+  int leaf_; //octree leaf (index of the node)
   int posInLeaf_; //position index in the leaf
   float area;
 };
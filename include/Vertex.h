@@ -3,50 +3,37 @@
 
 #include "DataTypes.h"
 #include <vector>
-#include <set>
+#include <map>
 #include "Tools.h"
 
 /**
 * Vertex
+* Plain data : the triangles around the vertex and its 1-ring are stored by the mesh (see Adjacency)
+* Only the attributes read by the sculpting kernels live here (28 bytes), the colors and
+* history flags are stored in separate arrays by the mesh. Visited/selected vertices
+* are tracked by the queries themselves (see Visitation)
 * @author Stphane GINIER
 */
 class Vertex : public Vector3
 {
 public:
-  static int tagMask_; //flag mask value (should be always >= tagFlag_)
-  static int sculptMask_; //flag mask value (should be always >= sculptFlag_)
-  int tagFlag_; //general purpose flag (<0 means the vertex is to be deleted)
-  int sculptFlag_; //sculpting flag
-  int stateFlag_; //flag for history
+  Vector3 normal_; //normal
+  int tagFlag_; //<0 means the vertex is to be deleted
 
 public:
-  Vertex(float x = 0, float y = 0, float z = 0, int id = -1);
-  Vertex(const Vector3& vec, int id=-1);
+  Vertex(float x = 0, float y = 0, float z = 0);
+  Vertex(const Vector3& vec);
   Vertex& operator=(const Vector3& vec);
-  ~Vertex();
-  inline void addTriangle(int iTri) { tIndices_.push_back(iTri); }
-  inline void addRingVertex(int iVer) { ringVertices_.push_back(iVer); }
-  void replaceTriangle(int iTriOld, int iTriNew);
-  void replaceRingVertex(int iVerOld, int iVerNew);
-  void removeTriangle(int iTri);
-  void removeRingVertex(int iVer);
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-public:
-  int id_; //id
-  std::vector<int> tIndices_; //triangles indices around the vertex
-  Vector3 normal_; //normal
-  std::vector<int> ringVertices_; //vertices neighborhood (1-ring)
-  Vector3 material_;
 };
 
 bool operator<(const Vertex &a,const Vertex &b);
 
 typedef std::vector<Vertex, Eigen::aligned_allocator<Vertex> > VertexVector;
 #if _WIN32
-typedef std::set<Vertex, std::less<Vertex>, Eigen::aligned_allocator<Vertex> > VertexSet;
+typedef std::map<Vertex, int, std::less<Vertex>, Eigen::aligned_allocator<std::pair<const Vertex, int> > > VertexMap;
 #else
-typedef std::set<Vertex> VertexSet;
+typedef std::map<Vertex, int> VertexMap;
 #endif
 
 #endif /*__VERTEX_H__*/
@@ -0,0 +1,46 @@
+#ifndef __VISITATION_H__
+#define __VISITATION_H__
+
+#include <vector>
+
+/**
+* Visitation
+* Marks the elements (vertices, triangles...) visited by one query, using a stamp per
+* element : starting a new query only increments the current stamp. Every query (or
+* thread) owns its visitation, so that several queries can run on the same mesh.
+*/
+class Visitation
+{
+public:
+  Visitation();
+  ~Visitation();
+  void start(int nbElements = 0);
+  void reserve(int nbElements);
+
+  /** Is the element visited by the current query */
+  inline bool isVisited(int i) const { return i<static_cast<int>(stamps_.size()) && stamps_[i]==stamp_; }
+
+  /** Mark an element, return false if it was already visited */
+  inline bool visit(int i)
+  {
+    if(i>=static_cast<int>(stamps_.size()))
+      stamps_.resize(i+1, 0);
+    if(stamps_[i]==stamp_)
+      return false;
+    stamps_[i] = stamp_;
+    return true;
+  }
+
+  /** Unmark an element */
+  inline void unvisit(int i)
+  {
+    if(i<static_cast<int>(stamps_.size()))
+      stamps_[i] = 0;
+  }
+
+private:
+  std::vector<int> stamps_; //stamp of the last query that visited each element
+  int stamp_; //stamp of the current query (>0)
+};
+
+#endif /*__VISITATION_H__*/
@@ -86,6 +86,22 @@ bool Aabb::intersectRay(const Vector3& vert, const Vector3& dir) const
   return (tmax >=0 && tmin<tmax);
 }
 
+/** Return true if the segment [vert, vert+dir] intersects the box, tNear is the entry parameter (0 if vert is inside) */
+bool Aabb::intersectSegment(const Vector3& vert, const Vector3& dir, float &tNear) const
+{
+  float t1 = (min_.x() - vert.x())/dir.x();
+  float t2 = (max_.x() - vert.x())/dir.x();
+  float t3 = (min_.y() - vert.y())/dir.y();
+  float t4 = (max_.y() - vert.y())/dir.y();
+  float t5 = (min_.z() - vert.z())/dir.z();
+  float t6 = (max_.z() - vert.z())/dir.z();
+
+  float tmin = std::max(std::max(std::min(t1, t2), std::min(t3, t4)), std::min(t5, t6));
+  float tmax = std::min(std::min(std::max(t1, t2), std::max(t3, t4)), std::max(t5, t6));
+  tNear = std::max(tmin, 0.0f);
+  return (tmax >=0 && tmin<=tmax && tmin<=1.0f);
+}
+
 /** Check if the aabb is a plane */
 void Aabb::checkFlat(float offset)
 {
@@ -0,0 +1,208 @@
+#include "StdAfx.h"
+#include "Adjacency.h"
+
+/** Constructor */
+Adjacency::Adjacency() : data_(), offset_(), size_(), capacity_(), nbWasted_(0)
+{}
+
+/** Destructor */
+Adjacency::~Adjacency()
+{}
+
+/** Getters */
+int Adjacency::getNbLists() const { return offset_.size(); }
+size_t Adjacency::getNbBytes() const { return (data_.capacity()+offset_.capacity()+size_.capacity()+capacity_.capacity())*sizeof(int); }
+
+/** Remove every list */
+void Adjacency::clear()
+{
+  data_.clear();
+  offset_.clear();
+  size_.clear();
+  capacity_.clear();
+  nbWasted_ = 0;
+}
+
+/** Lay out empty lists back to back, each one with room for its expected size (plus slack) */
+void Adjacency::init(const std::vector<int> &sizes)
+{
+  const int nbLists = sizes.size();
+  offset_.resize(nbLists);
+  size_.assign(nbLists, 0);
+  capacity_.resize(nbLists);
+  int offset = 0;
+  for(int i=0;i<nbLists;++i)
+  {
+    offset_[i] = offset;
+    capacity_[i] = sizes[i]+slack_;
+    offset += capacity_[i];
+  }
+  data_.resize(offset);
+  nbWasted_ = 0;
+}
+
+/** Add empty lists at the end, or drop the last lists */
+void Adjacency::resize(int nbLists)
+{
+  const int nbListsOld = offset_.size();
+  for(int i=nbLists;i<nbListsOld;++i)
+    nbWasted_ += capacity_[i];
+  offset_.resize(nbLists, data_.size());
+  size_.resize(nbLists, 0);
+  capacity_.resize(nbLists, 0);
+}
+
+/** Give back the slots lost by relocated or removed lists */
+void Adjacency::compact()
+{
+  const int nbLists = offset_.size();
+  int nbSlots = 0;
+  for(int i=0;i<nbLists;++i)
+    nbSlots += size_[i]+slack_;
+  std::vector<int> data(nbSlots);
+  int offset = 0;
+  for(int i=0;i<nbLists;++i)
+  {
+    std::copy(data_.begin()+offset_[i], data_.begin()+offset_[i]+size_[i], data.begin()+offset);
+    offset_[i] = offset;
+    capacity_[i] = size_[i]+slack_;
+    offset += capacity_[i];
+  }
+  data_.swap(data);
+  nbWasted_ = 0;
+}
+
+/** Relocate a list so that it can hold at least capacity indices */
+void Adjacency::reserve(int i, int capacity)
+{
+  const int offsetOld = offset_[i];
+  if(offsetOld+capacity_[i]==(int)data_.size()) //last list of the array, grow in place
+  {
+    data_.resize(offsetOld+capacity);
+  }
+  else
+  {
+    const int offsetNew = data_.size();
+    data_.resize(offsetNew+capacity);
+    std::copy(data_.begin()+offsetOld, data_.begin()+offsetOld+size_[i], data_.begin()+offsetNew);
+    offset_[i] = offsetNew;
+    nbWasted_ += capacity_[i];
+  }
+  capacity_[i] = capacity;
+}
+
+/** Add an index at the end of a list */
+void Adjacency::add(int i, int val)
+{
+  const int nb = size_[i];
+  if(nb==capacity_[i])
+  {
+    reserve(i, nb*2+slack_);
+    if(nbWasted_>(int)data_.size()/2)
+      compact();
+  }
+  data_[offset_[i]+nb] = val;
+  ++size_[i];
+}
+
+/** Add a new list at the end (copy of a list from another store) */
+void Adjacency::append(const Range &list)
+{
+  const int nb = list.size();
+  offset_.push_back(data_.size());
+  size_.push_back(nb);
+  capacity_.push_back(nb);
+  data_.insert(data_.end(), list.begin(), list.end());
+}
+
+/** Replace the content of a list (the values must not come from the same store) */
+void Adjacency::assign(int i, const int *first, const int *last)
+{
+  const int nb = last-first;
+  if(nb>capacity_[i])
+    reserve(i, nb+slack_);
+  std::copy(first, last, data_.begin()+offset_[i]);
+  size_[i] = nb;
+}
+
+/** Replace the content of a list */
+void Adjacency::assign(int i, const std::vector<int> &values)
+{
+  assign(i, values.data(), values.data()+values.size());
+}
+
+/** The list iDst takes the slots of the list iSrc, iSrc becomes empty */
+void Adjacency::move(int iDst, int iSrc)
+{
+  if(iDst==iSrc)
+    return;
+  nbWasted_ += capacity_[iDst];
+  offset_[iDst] = offset_[iSrc];
+  size_[iDst] = size_[iSrc];
+  capacity_[iDst] = capacity_[iSrc];
+  offset_[iSrc] = data_.size();
+  size_[iSrc] = 0;
+  capacity_[iSrc] = 0;
+}
+
+/** Set the j-th index of a list */
+void Adjacency::set(int i, int j, int val)
+{
+  LM_ASSERT(j<size_[i], "Bad position");
+  data_[offset_[i]+j] = val;
+}
+
+/** Replace an index of a list */
+void Adjacency::replace(int i, int valOld, int valNew)
+{
+  int *list = data_.data()+offset_[i];
+  const int nb = size_[i];
+  for(int j=0;j<nb;++j)
+  {
+    if(valOld==list[j])
+    {
+      list[j]=valNew;
+      return;
+    }
+  }
+  LM_ASSERT(false, "Index not found");
+}
+
+/** Remove an index of a list (the last index takes its place) */
+void Adjacency::remove(int i, int val)
+{
+  int *list = data_.data()+offset_[i];
+  const int nb = size_[i];
+  for(int j=0;j<nb;++j)
+  {
+    if(val==list[j])
+    {
+      list[j]=list[nb-1];
+      --size_[i];
+      return;
+    }
+  }
+  LM_ASSERT(false, "Index not found");
+}
+
+/** Remove the j-th index of a list (the last index takes its place) */
+void Adjacency::removeAt(int i, int j)
+{
+  LM_ASSERT(j<size_[i], "Bad position");
+  const int nb = --size_[i];
+  data_[offset_[i]+j] = data_[offset_[i]+nb];
+}
+
+/** Sort a list */
+void Adjacency::sort(int i)
+{
+  std::sort(data_.begin()+offset_[i], data_.begin()+offset_[i]+size_[i]);
+}
+
+/** Sort a list and delete duplicate indices */
+void Adjacency::tidy(int i)
+{
+  std::vector<int>::iterator first = data_.begin()+offset_[i];
+  std::sort(first, first+size_[i]);
+  size_[i] = std::unique(first, first+size_[i])-first;
+}
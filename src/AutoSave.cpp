@@ -2,6 +2,7 @@
 #include "AutoSave.h"
 #include "Mesh.h"
 #include "Files.h"
+#include "MeshSnapshot.h"
 #ifdef _WIN32
 //#pragma comment (lib, "wintrust.lib")
 #else // POSIX
@@ -34,40 +35,33 @@ const char AutoSave::PATH_SEPARATOR = PATH_SEPARATOR_UNIX;
 #if _WIN32 || __APPLE__
 const std::string AutoSave::APPLICATION_DIRECTORY = "Sculpting";
 #else
-const std::string AutoSave::APPLICATION_DIRECTORY[] = ".Sculpting";
+const std::string AutoSave::APPLICATION_DIRECTORY = ".Sculpting";
 #endif
 
-AutoSave::AutoSave() : m_shutdown(false), m_savePending(false), m_scale(1.0f), m_lastSaveTime(-MIN_TIME_BETWEEN_AUTOSAVES) {
+AutoSave::AutoSave() : m_shutdown(false), m_saveTasks("autosave"), m_savePending(false), m_lastSaveTime(-MIN_TIME_BETWEEN_AUTOSAVES) {
 
 }
 
-void AutoSave::start() {
-  m_saveThread = std::thread(&AutoSave::runMainLoop, this);
-#if __APPLE__
-  m_saveThread.detach();
-#endif
-}
-
 void AutoSave::shutdown() {
-  std::unique_lock<std::mutex> lock(m_saveMutex);
-  m_shutdown = true;
-  m_saveCondition.notify_all();
-  if (m_saveThread.joinable())
   {
-    m_saveThread.join();
+    std::unique_lock<std::mutex> lock(m_saveMutex);
+    m_shutdown = true;
   }
+  m_saveTasks.wait();
 }
 
 void AutoSave::triggerAutoSave(Mesh* mesh) {
   std::unique_lock<std::mutex> lock(m_saveMutex);
   const double curTime = ci::app::getElapsedSeconds();
   if (curTime - m_lastSaveTime > MIN_TIME_BETWEEN_AUTOSAVES && mesh->getNbVertices() > 0 && mesh->getNbTriangles() > 0) {
-    m_vertices = mesh->getVertices();
-    m_triangles = mesh->getTriangles();
-    m_scale = mesh->getScale();
-    m_savePending = true;
-    m_saveCondition.notify_all();
+    // only a reference on the last epoch : nothing is copied on the sculpting thread
+    m_snapshot = mesh->getSnapshot();
     m_lastSaveTime = curTime;
+    // a save already queued will pick the newest snapshot
+    if (!m_savePending && !m_shutdown) {
+      m_savePending = true;
+      m_saveTasks.run([this]() { checkAutoSave(); });
+    }
   }
 }
 
@@ -91,29 +85,27 @@ bool AutoSave::isFirstRun() {
   return !boost::filesystem::exists(curPath);
 }
 
-void AutoSave::runMainLoop() {
-  while (!m_shutdown) {
-    checkAutoSave();
-  }
-}
-
 void AutoSave::checkAutoSave() {
-  std::unique_lock<std::mutex> lock(m_saveMutex);
-  if (!m_savePending) {
-    m_saveCondition.wait(lock);
+  std::shared_ptr<const MeshSnapshot> snapshot;
+  {
+    std::unique_lock<std::mutex> lock(m_saveMutex);
+    if (!m_shutdown) {
+      snapshot.swap(m_snapshot);
+    }
+    m_savePending = false;
   }
-  if (!m_shutdown) {
+  // the file is written without the lock, triggerAutoSave never waits for it
+  if (snapshot) {
     try {
       Files files;
       const std::string savePath = getAutoSavePath();
       std::ofstream file(savePath.c_str());
       if (file) {
-        files.savePLY(m_vertices, m_triangles, m_scale, file);
+        files.savePLY(*snapshot, file);
         file.close();
       }
     } catch (...) {}
   }
-  m_savePending = false;
 }
 
 std::string AutoSave::getUserAppDirectory() {
@@ -8,6 +8,7 @@
 //--------------------------------------------------------------------------------------
 #include "StdAfx.h"
 #include "CCubeMapProcessor.h"
+#include "ThreadPool.h"
 #include <algorithm>
 
 #define CP_PI   3.14159265358979323846
@@ -1792,22 +1793,17 @@ void CCubeMapProcessor::FilterCubeMapMipChain()
   else
   {
     // generate top level mipmap
+    ThreadPool::TaskGroup faces("cubemap filter");
     for (int i=0; i<6; i++) {
       //SThreadFilterFace& face = sg_ThreadFilterFace[i];
       m_ThreadProgress[i].m_CurrentMipLevel = 0;
       m_ThreadProgress[i].m_CurrentRow = 0;
       m_ThreadProgress[i].m_CurrentFace = i;
-      m_Threads[i] = std::thread(&CCubeMapProcessor::FilterCubeSurfaces,
-        this,
-        m_InputSurface, 
-        m_OutputSurface[0], 
-        m_BaseFilterAngle,
-        i);
-    }
-
-    for (int i=0; i<6; i++) {
-      m_Threads[i].join();
+      faces.run([this, i]() {
+        FilterCubeSurfaces(m_InputSurface, m_OutputSurface[0], m_BaseFilterAngle, i);
+      });
     }
+    faces.wait();
 
     FixupCubeEdges(m_OutputSurface[0], m_FixupType, m_FixupWidth);
 
@@ -1822,16 +1818,11 @@ void CCubeMapProcessor::FilterCubeMapMipChain()
         m_ThreadProgress[j].m_CurrentMipLevel = i;
         m_ThreadProgress[j].m_CurrentRow = 0;
         m_ThreadProgress[j].m_CurrentFace = j;
-        m_Threads[j] = std::thread(&CCubeMapProcessor::FilterCubeSurfaces,
-          this,
-          m_OutputSurface[i-1], 
-          m_OutputSurface[i], 
-          coneAngle,
-          j);
-      }
-      for (int j=0; j<6; j++) {
-        m_Threads[j].join();
+        faces.run([this, i, j, coneAngle]() {
+          FilterCubeSurfaces(m_OutputSurface[i-1], m_OutputSurface[i], coneAngle, j);
+        });
       }
+      faces.wait();
       FixupCubeEdges(m_OutputSurface[i], m_FixupType, m_FixupWidth);
       coneAngle *= m_MipAnglePerLevelScale;
     }
@@ -1885,17 +1876,13 @@ void CCubeMapProcessor::PrecomputeFilterLookupTables(unsigned int a_FilterType,
 
   //Normalized vectors per cubeface and per-texel solid angle 
   // SL BEGIN
+  ThreadPool::TaskGroup faces("cubemap normalizer");
   for (int i=0; i<6; i++) {
-    m_Threads[i] = std::thread(&CCubeMapProcessor::BuildNormalizerSolidAngleCubemap,
-      this,
-      a_SrcCubeMapWidth,
-      m_NormCubeMap,
-      i,
-      a_FixupType);
-  }
-  for (int i=0; i<6; i++) {
-    m_Threads[i].join();
+    faces.run([this, a_SrcCubeMapWidth, i, a_FixupType]() {
+      BuildNormalizerSolidAngleCubemap(a_SrcCubeMapWidth, m_NormCubeMap, i, a_FixupType);
+    });
   }
+  faces.wait();
   // SL END
 
 }
@@ -2529,17 +2516,13 @@ void CCubeMapProcessor::SHFilterCubeMap(bool a_bUseSolidAngleWeighting, int a_Fi
   }
 
   //Normalized vectors per cubeface and per-texel solid angle
+  ThreadPool::TaskGroup faces("cubemap normalizer");
   for (int i=0; i<6; i++) {
-    m_Threads[i] = std::thread(&CCubeMapProcessor::BuildNormalizerSolidAngleCubemap,
-      this,
-      DstCubeImage->m_Width,
-      m_NormCubeMap,
-      i,
-      a_FixupType);
-  }
-  for (int i=0; i<6; i++) {
-    m_Threads[i].join();
+    faces.run([this, DstSize, i, a_FixupType]() {
+      BuildNormalizerSolidAngleCubemap(DstSize, m_NormCubeMap, i, a_FixupType);
+    });
   }
+  faces.wait();
 
   for (int iFaceIdx = 0; iFaceIdx < 6; iFaceIdx++)
   {
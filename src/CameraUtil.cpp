@@ -4,6 +4,7 @@
 #include "Geometry.h"
 #include "DataTypes.h"
 #include "ReplayUtil.h"
+#include "MeshSnapshot.h"
 
 #if LM_PRODUCTION_BUILD
 #define LM_LOG_CAMERA_LOGIC 0
@@ -37,6 +38,7 @@ CameraUtil::CameraUtil() {
   m_justSculpted = false;
   m_forceVerifyPositionAfterSculpting = false;
   m_numFramesInsideManifoldMesh = 0;
+  m_isoPotentialCacheMesh = NULL;
   m_orbitRefPoint.setZero();
   m_orbitDistance = 0.0f;
 }
@@ -121,7 +123,7 @@ inline static Vector3 TriCenter(const Mesh* mesh, const Triangle& tri) {
 }
 
 lmSurfacePoint CameraUtil::GetClosestSurfacePoint(Mesh* mesh, const Vector3& position, lmReal queryRadius) {
-  std::vector<Octree*> leavesHit;
+  std::vector<int> leavesHit;
   m_queryTriangles.clear();
   mesh->getOctree()->intersectSphere(position, queryRadius*queryRadius, leavesHit, m_queryTriangles);
 
@@ -194,28 +196,23 @@ void CameraUtil::GetNormalAtPoint(const Mesh* mesh, int triIdx, const Vector3& p
 bool CameraUtil::CollideCameraSphere(Mesh* mesh, const Vector3& position, lmReal radius )
 {
   // Get potential triangles from the aabb octree.
-  std::vector<Octree*> leavesHit;
+  std::vector<int> leavesHit;
   m_queryTriangles.clear();
   mesh->getOctree()->intersectSphere(position,radius*radius,leavesHit,m_queryTriangles);
 
-  // Collide each potential triangle; find real collisions.
-  std::vector<Geometry::GetClosestPointOutput> collidingTriangles;
-  for (unsigned ti = 0; ti < m_queryTriangles.size(); ti++) {
-    int triIdx = m_queryTriangles[ti];
-    const Triangle& tri = mesh->getTriangle(triIdx);
-
-    Geometry::GetClosestPointInput input(mesh, &tri, position);
-    Geometry::GetClosestPointOutput output;
-    Geometry::getClosestPoint_noNormal(input, &output);
-
-    if (output.distanceSqr < radius*radius) {
-      collidingTriangles.push_back(output);
-      // Cutting things short -- only return if collision happened
-      break;
+  // Collide potential triangles by batches; stop at the first real collision.
+  const __m128 radiusSqr = _mm_set1_ps(radius*radius);
+  const int numTris = static_cast<int>(m_queryTriangles.size());
+  for (int ti = 0; ti < numTris; ti += Geometry::TRIANGLE_BATCH_SIZE) {
+    Geometry::TriangleBatch batch;
+    batch.gather(mesh, &m_queryTriangles[ti], std::min(numTris - ti, Geometry::TRIANGLE_BATCH_SIZE));
+    const __m128 distSqr = Geometry::getClosestPoints(batch, position);
+    if (_mm_movemask_ps(_mm_cmplt_ps(distSqr, radiusSqr))) {
+      return true;
     }
   }
 
-  return collidingTriangles.size() > 0;
+  return false;
 }
 
 static lmTransform lmTransformFromMatrix(const Matrix4x4& _r, const Vector3& t) {
@@ -510,10 +507,27 @@ void CameraUtil::CastOneRay( const Mesh* mesh, const lmRay& ray, lmRayCastOutput
 
 void CameraUtil::CastOneRay( const Mesh* mesh, const lmRay& ray, std::vector<lmRayCastOutput>* results, bool collectall /*= false*/ )
 {
+  if (!collectall) {
+    // Closest hit only: front-to-back traversal of the octree
+    Vector3 hitPoint;
+    const int iTri = mesh->getOctree()->intersectRayClosest(mesh, ray.start, ray.end, hitPoint);
+    if (iTri != -1) {
+      const Triangle& tri = mesh->getTriangle(iTri);
+      lmRayCastOutput rayCastOutput;
+      rayCastOutput.triangleIdx = iTri;
+      rayCastOutput.position = hitPoint;
+      rayCastOutput.normal = tri.normal_;
+      rayCastOutput.dist = (hitPoint-ray.start).dot(ray.GetDirection());
+      rayCastOutput.fraction = rayCastOutput.dist / ray.GetLength();
+      if (lmInRange(rayCastOutput.fraction, 0.0f, 1.0f)) {
+        results->push_back(rayCastOutput);
+      }
+    }
+    return;
+  }
 
   m_queryTriangles.clear();
   mesh->getOctree()->intersectRay(ray.start, ray.GetDirection(), m_queryTriangles);
-  lmReal minDist = FLT_MAX;
 
   lmRayCastOutput rayCastOutput;
 
@@ -537,24 +551,62 @@ void CameraUtil::CastOneRay( const Mesh* mesh, const lmRay& ray, std::vector<lmR
     }
     if (rayHit) {
       lmReal dist = (hitPoint-ray.start).dot(rayDirection);
-      if ((0 <= dist && dist < minDist) || collectall) {
-        minDist = dist;
 
-        rayCastOutput.triangleIdx = m_queryTriangles[ti];
-        rayCastOutput.position = hitPoint;
-        rayCastOutput.normal = tri.normal_;
-        rayCastOutput.dist = dist;
-        rayCastOutput.fraction = dist / rayLength;
+      rayCastOutput.triangleIdx = m_queryTriangles[ti];
+      rayCastOutput.position = hitPoint;
+      rayCastOutput.normal = tri.normal_;
+      rayCastOutput.dist = dist;
+      rayCastOutput.fraction = dist / rayLength;
 
-        if (collectall && lmInRange(rayCastOutput.fraction, 0.0f, 1.0f)) {
-          results->push_back(rayCastOutput);
-        }
+      if (lmInRange(rayCastOutput.fraction, 0.0f, 1.0f)) {
+        results->push_back(rayCastOutput);
       }
     }
   }
+}
+
+static lmRayCastOutput MakeRayCastOutput(const Mesh* mesh, const lmRay& ray, int triIdx, lmReal fraction)
+{
+  lmRayCastOutput rayCastOutput;
+  rayCastOutput.triangleIdx = triIdx;
+  rayCastOutput.position = ray.start + fraction * (ray.end - ray.start);
+  rayCastOutput.normal = mesh->getTriangle(triIdx).normal_;
+  rayCastOutput.dist = fraction * ray.GetLength();
+  rayCastOutput.fraction = fraction;
+  return rayCastOutput;
+}
 
-  if (!collectall && minDist < FLT_MAX && lmInRange(rayCastOutput.fraction, 0.0f, 1.0f)) {
-    results->push_back(rayCastOutput);
+void CameraUtil::CastRays( const Mesh* mesh, const lmRay* rays, int numRays, std::vector<lmRayCastOutput>* results, bool collectall /*= false*/ )
+{
+  const Octree* octree = mesh->getOctree();
+  for (int first = 0; first < numRays; first += Geometry::RAY_PACKET_SIZE) {
+    const int count = std::min(numRays - first, Geometry::RAY_PACKET_SIZE);
+    Vector3 starts[Geometry::RAY_PACKET_SIZE];
+    Vector3 ends[Geometry::RAY_PACKET_SIZE];
+    for (int i = 0; i < count; i++) {
+      starts[i] = rays[first+i].start;
+      ends[i] = rays[first+i].end;
+    }
+    Geometry::RayPacket packet(starts, ends, count);
+
+    if (collectall) {
+      std::vector<std::pair<float, int> > hits[Geometry::RAY_PACKET_SIZE];
+      octree->intersectRayPacket(mesh, packet, hits);
+      for (int i = 0; i < count; i++) {
+        for (size_t hi = 0; hi < hits[i].size(); hi++) {
+          results[first+i].push_back(MakeRayCastOutput(mesh, rays[first+i], hits[i][hi].second, hits[i][hi].first));
+        }
+      }
+    } else {
+      int triIdx[Geometry::RAY_PACKET_SIZE];
+      float fractions[Geometry::RAY_PACKET_SIZE];
+      octree->intersectRayPacket(mesh, packet, triIdx, fractions);
+      for (int i = 0; i < count; i++) {
+        if (0 <= triIdx[i]) {
+          results[first+i].push_back(MakeRayCastOutput(mesh, rays[first+i], triIdx[i], fractions[i]));
+        }
+      }
+    }
   }
 }
 
@@ -567,10 +619,7 @@ bool CameraUtil::VerifyCameraMovement( Mesh* mesh, const Vector3& from, const Ve
   if (!cameraCollidesMesh) {
 
     // Cast a ray between old & new points -- if it crosses the mesh, prevent the movement
-    lmRayCastOutput rayCastOutput;
-    CastOneRay(mesh, lmRay(from, to), &rayCastOutput);
-
-    if (!rayCastOutput.isSuccess()) {
+    if (!mesh->getOctree()->intersectRayAny(mesh, from, to)) {
       validMovement = true;
     }
   }
@@ -578,11 +627,100 @@ bool CameraUtil::VerifyCameraMovement( Mesh* mesh, const Vector3& from, const Ve
   return validMovement;
 }
 
+// Potential contributions of a triangle batch (area * weight / dist^6), zero for lanes out of range.
+static __m128 IsoPotentialContributions(__m128 distSqr, __m128 inRange, lmReal queryRadiusSqr, lmReal gravKSqr, __m128 area)
+{
+  distSqr = _mm_add_ps(distSqr, _mm_set1_ps(gravKSqr));
+
+  // avoid calling std::pow
+  const __m128 distPowered = _mm_mul_ps(_mm_mul_ps(distSqr, distSqr), distSqr);
+  const __m128 weightDenominator = _mm_set1_ps(queryRadiusSqr * queryRadiusSqr * queryRadiusSqr);
+
+  __m128 weight = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_div_ps(distPowered, weightDenominator));
+  weight = _mm_max_ps(_mm_setzero_ps(), weight);
+  return _mm_and_ps(inRange, _mm_div_ps(_mm_mul_ps(area, weight), distPowered));
+}
+
+static lmReal SumLanes(__m128 v)
+{
+  float lanes[4];
+  _mm_storeu_ps(lanes, v);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
 lmReal CameraUtil::IsoPotential( Mesh* mesh, const Vector3& position, lmReal queryRadius )
 {
-  std::vector<Octree*> &leavesHit = mesh->getLeavesUpdate();
+  if (m_params.cacheIsoPotential) {
+    return IsoPotentialCached(mesh, position, queryRadius);
+  }
+  return IsoPotentialExact(mesh, position, queryRadius);
+}
+
+void CameraUtil::UpdateIsoPotentialCache( Mesh* mesh, lmReal queryRadius )
+{
+  std::vector<Aabb>& dirtyAabbs = mesh->getDirtyAabbs();
+  if (mesh != m_isoPotentialCacheMesh) {
+    m_isoPotentialCache.clear();
+    m_isoPotentialCacheMesh = mesh;
+    dirtyAabbs.clear();
+  }
+  m_isoPotentialCache.setQueryRadius(queryRadius, m_params.isoCacheSpacing);
+  for (size_t i = 0; i < dirtyAabbs.size(); i++) {
+    m_isoPotentialCache.invalidate(dirtyAabbs[i]);
+  }
+  dirtyAabbs.clear();
+}
+
+lmReal CameraUtil::IsoPotentialSample( Mesh* mesh, int x, int y, int z )
+{
+  lmReal potential;
+  if (!m_isoPotentialCache.getSample(x, y, z, potential)) {
+    const Vector3 position = Vector3(static_cast<lmReal>(x), static_cast<lmReal>(y), static_cast<lmReal>(z)) * m_isoPotentialCache.getSpacing();
+    potential = IsoPotentialExact(mesh, position, m_isoPotentialCache.getQueryRadius());
+    m_isoPotentialCache.setSample(x, y, z, potential);
+  }
+  return potential;
+}
+
+lmReal CameraUtil::IsoPotentialCached( Mesh* mesh, const Vector3& position, lmReal queryRadius, Vector3* gradientOut /*= NULL*/ )
+{
+  UpdateIsoPotentialCache(mesh, queryRadius);
+
+  // Trilinear interpolation between the 8 samples of the lattice cell
+  const lmReal spacing = m_isoPotentialCache.getSpacing();
+  const Vector3 cellPosition = position / spacing;
+  const int x0 = static_cast<int>(std::floor(cellPosition.x()));
+  const int y0 = static_cast<int>(std::floor(cellPosition.y()));
+  const int z0 = static_cast<int>(std::floor(cellPosition.z()));
+  const Vector3 f = cellPosition - Vector3(static_cast<lmReal>(x0), static_cast<lmReal>(y0), static_cast<lmReal>(z0));
+
+  lmReal potential = 0.0f;
+  Vector3 gradient = Vector3::Zero();
+  for (int c = 0; c < 8; c++) {
+    const int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+    const int x = x0 + dx, y = y0 + dy, z = z0 + dz;
+    const lmReal weight = (dx ? f.x() : 1.0f - f.x()) * (dy ? f.y() : 1.0f - f.y()) * (dz ? f.z() : 1.0f - f.z());
+    potential += weight * IsoPotentialSample(mesh, x, y, z);
+
+    if (gradientOut) {
+      // Central differences at the samples, so that the interpolated gradient stays continuous across cells
+      Vector3 sampleGradient(
+        IsoPotentialSample(mesh, x+1, y, z) - IsoPotentialSample(mesh, x-1, y, z),
+        IsoPotentialSample(mesh, x, y+1, z) - IsoPotentialSample(mesh, x, y-1, z),
+        IsoPotentialSample(mesh, x, y, z+1) - IsoPotentialSample(mesh, x, y, z-1));
+      gradient += weight * sampleGradient / (2.0f * spacing);
+    }
+  }
+
+  if (gradientOut) { *gradientOut = gradient; }
+  return potential;
+}
+
+lmReal CameraUtil::IsoPotentialExact( Mesh* mesh, const Vector3& position, lmReal queryRadius )
+{
+  m_queryLeaves.clear();
   m_queryTriangles.clear();
-  mesh->getOctree()->intersectSphere(position,queryRadius*queryRadius,leavesHit, m_queryTriangles);
+  mesh->getOctree()->intersectSphere(position,queryRadius*queryRadius,m_queryLeaves, m_queryTriangles);
 
   //lmReal radius = Get
   lmReal potential = 0.0;
@@ -592,34 +730,31 @@ lmReal CameraUtil::IsoPotential( Mesh* mesh, const Vector3& position, lmReal que
 
   if (m_params.queryTriangles) {
     const TriangleVector& triangles = mesh->getTriangles();
+    const lmReal gravKSqr = m_params.grav_k*m_params.grav_k;
+    const __m128 radiusSqr = _mm_set1_ps(queryRadiusSqr);
+    __m128 sum = _mm_setzero_ps();
 
-    for (unsigned ti = 0; ti < m_queryTriangles.size(); ti+= striding)
+    // Closest points & potential of the triangles, by batches
+    const int numTris = static_cast<int>(m_queryTriangles.size());
+    for (int ti = 0; ti < numTris; ti += Geometry::TRIANGLE_BATCH_SIZE)
     {
-      const Triangle& tri = triangles[m_queryTriangles[ti]];
-
-      Geometry::GetClosestPointInput input(mesh, &tri, position);
-      Geometry::GetClosestPointOutput output;
-      Geometry::getClosestPoint_noNormal(input, &output);
-
-      lmReal distSqr = output.distanceSqr;
-
-      if (distSqr < queryRadiusSqr)
-      {
-        distSqr += m_params.grav_k*m_params.grav_k;
-
-        // avoid calling std::pow
-        const lmReal distPowered = distSqr * distSqr * distSqr;
-        const lmReal weightDenominator = queryRadiusSqr * queryRadiusSqr * queryRadiusSqr;
-
-        lmReal weight = 1.0f - (distPowered / weightDenominator);
-        weight = std::max(0.0f, weight);
-        potential += tri.area * weight / distPowered;
-
-        if (m_params.drawDebugLines && m_params.drawSphereQueryResults) {
-          LM_DRAW_MESH_TRIANGLE(mesh, tri, lmColor::WHITE);
+      Geometry::TriangleBatch batch;
+      batch.gather(mesh, &m_queryTriangles[ti], std::min(numTris - ti, Geometry::TRIANGLE_BATCH_SIZE));
+      const __m128 distSqr = Geometry::getClosestPoints(batch, position);
+      const __m128 inRange = _mm_cmplt_ps(distSqr, radiusSqr);
+      sum = _mm_add_ps(sum, IsoPotentialContributions(distSqr, inRange, queryRadiusSqr, gravKSqr, batch.area));
+
+      if (m_params.drawDebugLines && m_params.drawSphereQueryResults) {
+        const int inRangeMask = _mm_movemask_ps(inRange);
+        for (int i = 0; i < Geometry::TRIANGLE_BATCH_SIZE; i++) {
+          if (inRangeMask & (1 << i)) {
+            const Triangle& tri = triangles[m_queryTriangles[ti+i]];
+            LM_DRAW_MESH_TRIANGLE(mesh, tri, lmColor::WHITE);
+          }
         }
       }
     }
+    potential += SumLanes(sum);
 
   } else {
 
@@ -658,9 +793,9 @@ lmReal CameraUtil::IsoPotential( Mesh* mesh, const Vector3& position, lmReal que
 
 void CameraUtil::IsoPotential_row4( Mesh* mesh, const Vector3* positions, lmReal queryRadius, lmReal* potentials )
 {
-  std::vector<Octree*> &leavesHit = mesh->getLeavesUpdate();
+  m_queryLeaves.clear();
   m_queryTriangles.clear();
-  mesh->getOctree()->intersectSphere(positions[0],queryRadius*queryRadius,leavesHit, m_queryTriangles);
+  mesh->getOctree()->intersectSphere(positions[0],queryRadius*queryRadius,m_queryLeaves, m_queryTriangles);
 
   for (int i = 0; i < 4; i++) { potentials[i] = 0.0f; }
 
@@ -670,54 +805,40 @@ void CameraUtil::IsoPotential_row4( Mesh* mesh, const Vector3* positions, lmReal
 
   if (m_params.queryTriangles) {
     const TriangleVector& triangles = mesh->getTriangles();
+    const lmReal gravKSqr = m_params.grav_k*m_params.grav_k;
+    const __m128 radiusSqr = _mm_set1_ps(queryRadiusSqr);
+    __m128 sums[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
 
-    for (unsigned ti = 0; ti < m_queryTriangles.size(); ti+= striding)
+    // Closest points are computed for the first position only, and reused for the 3 others
+    const int numTris = static_cast<int>(m_queryTriangles.size());
+    for (int ti = 0; ti < numTris; ti += Geometry::TRIANGLE_BATCH_SIZE)
     {
-      if (ti < m_queryTriangles.size()-striding) {
-        const Triangle& nextTri = triangles[m_queryTriangles[ti+striding]];
-        LM_MEM_PREFETCH(&mesh->getVertices()[0]+nextTri.vIndices_[0]);
-        LM_MEM_PREFETCH(&mesh->getVertices()[0]+nextTri.vIndices_[1]);
-        LM_MEM_PREFETCH(&mesh->getVertices()[0]+nextTri.vIndices_[2]);
-      }
-
-      const Triangle& tri = triangles[m_queryTriangles[ti]];
-
-      Geometry::GetClosestPointInput input(mesh, &tri, positions[0]);
-      Geometry::GetClosestPointOutput output;
-      Geometry::getClosestPoint_noNormal(input, &output);
-
-      lmReal distSqr = output.distanceSqr;
-
-      if (distSqr < queryRadiusSqr)
-      {
-        distSqr += m_params.grav_k*m_params.grav_k;
-
-        // avoid calling std::pow
-        const lmReal distPowered = distSqr * distSqr * distSqr;
-        const lmReal weightDenominator = queryRadiusSqr * queryRadiusSqr * queryRadiusSqr;
-
-        lmReal weight = 1.0f - (distPowered / weightDenominator);
-        weight = std::max(0.0f, weight);
-        potentials[0] += tri.area * weight / distPowered;
-
-        if (m_params.drawDebugLines && m_params.drawSphereQueryResults) {
-          LM_DRAW_MESH_TRIANGLE(mesh, tri, lmColor::WHITE);
+      Geometry::TriangleBatch batch;
+      batch.gather(mesh, &m_queryTriangles[ti], std::min(numTris - ti, Geometry::TRIANGLE_BATCH_SIZE));
+      __m128 px, py, pz;
+      const __m128 distSqr = Geometry::getClosestPoints(batch, positions[0], &px, &py, &pz);
+      const __m128 inRange = _mm_cmplt_ps(distSqr, radiusSqr);
+      sums[0] = _mm_add_ps(sums[0], IsoPotentialContributions(distSqr, inRange, queryRadiusSqr, gravKSqr, batch.area));
+
+      if (m_params.drawDebugLines && m_params.drawSphereQueryResults) {
+        const int inRangeMask = _mm_movemask_ps(inRange);
+        for (int i = 0; i < Geometry::TRIANGLE_BATCH_SIZE; i++) {
+          if (inRangeMask & (1 << i)) {
+            const Triangle& tri = triangles[m_queryTriangles[ti+i]];
+            LM_DRAW_MESH_TRIANGLE(mesh, tri, lmColor::WHITE);
+          }
         }
+      }
 
-        for (int i = 1; i < 4; i++) {
-          lmReal distSqr =  (positions[i]-output.position).squaredNorm();
-          distSqr += m_params.grav_k*m_params.grav_k;
-
-          // avoid calling std::pow
-          const lmReal distPowered = distSqr * distSqr * distSqr;
-          const lmReal weightDenominator = queryRadiusSqr * queryRadiusSqr * queryRadiusSqr;
-
-          lmReal weight = 1.0f - (distPowered / weightDenominator);
-          weight = std::max(0.0f, weight);
-          potentials[i] += tri.area * weight / distPowered;
-        }
+      for (int i = 1; i < 4; i++) {
+        const __m128 dx = _mm_sub_ps(_mm_set1_ps(positions[i].x()), px);
+        const __m128 dy = _mm_sub_ps(_mm_set1_ps(positions[i].y()), py);
+        const __m128 dz = _mm_sub_ps(_mm_set1_ps(positions[i].z()), pz);
+        const __m128 distSqrI = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        sums[i] = _mm_add_ps(sums[i], IsoPotentialContributions(distSqrI, inRange, queryRadiusSqr, gravKSqr, batch.area));
       }
     }
+    for (int i = 0; i < 4; i++) { potentials[i] += SumLanes(sums[i]); }
   } else {
 
     std::vector<int> selectedVertices;
@@ -763,6 +884,15 @@ void CameraUtil::IsoPotential_row4( Mesh* mesh, const Vector3* positions, lmReal
 
 Vector3 CameraUtil::IsoNormal( Mesh* mesh, const Vector3& position, lmReal queryRadius, lmReal* potentialOut /*= NULL*/, lmReal* gradientMagOut /*= NULL*/ )
 {
+  if (m_params.cacheIsoPotential) {
+    Vector3 gradient;
+    const lmReal potential = IsoPotentialCached(mesh, position, queryRadius, &gradient);
+    const lmReal gradientMag = gradient.norm();
+    if (potentialOut) { *potentialOut = potential; }
+    if (gradientMagOut) { *gradientMagOut = gradientMag; }
+    return -gradient / gradientMag;
+  }
+
   lmReal epsilon = 0.1f;
   const Vector3& pos = position;
   Vector3 posX = pos; posX.x() += epsilon;
@@ -803,6 +933,12 @@ lmReal CameraUtil::IsoQueryRadius( const Mesh* mesh, IsoCameraState* state ) con
   return std::max(state->refDist + m_params.isoQueryPaddingRadius * multiplier, m_params.isoQueryPaddingRadius * multiplier);
 }
 
+lmReal CameraUtil::IsoQueryRadius( const MeshSnapshot& snapshot, IsoCameraState* state ) const
+{
+  const lmReal multiplier = 0.5f * GetMeshSize(snapshot.getAabbSplit()) / Mesh::globalScale_;
+  return std::max(state->refDist + m_params.isoQueryPaddingRadius * multiplier, m_params.isoQueryPaddingRadius * multiplier);
+}
+
 void CameraUtil::IsoUpdateCameraTransform( const Vector3& newDirection, IsoCameraState* state, lmReal deltaTime )
 {
   lmQuat qCorrection; qCorrection.setFromTwoVectors(GetCameraDirection(), newDirection);
@@ -1154,16 +1290,15 @@ void CameraUtil::IsoCameraConstrainWhenSpinning( Mesh* mesh, IsoCameraState* sta
 
 void CameraUtil::IsoResetIfInsideManifoldMesh(Mesh* mesh, IsoCameraState* isoState) {
   // Only use for manifold meshes..
-  lmRay ray0(isoState->refPosition, isoState->refPosition - 10.0f * GetMeshSize(mesh) * isoState->refNormal);
-  lmRay ray1(isoState->refPosition, isoState->refPosition + 10.0f * GetMeshSize(mesh) * isoState->refNormal);
-  std::vector<lmRayCastOutput> results0;
-  std::vector<lmRayCastOutput> results1;
+  lmRay rays[2];
+  rays[0] = lmRay(isoState->refPosition, isoState->refPosition - 10.0f * GetMeshSize(mesh) * isoState->refNormal);
+  rays[1] = lmRay(isoState->refPosition, isoState->refPosition + 10.0f * GetMeshSize(mesh) * isoState->refNormal);
+  std::vector<lmRayCastOutput> results[2];
   const bool collectAll = true;
-  CastOneRay(mesh, ray0, &results0, collectAll);
-  CastOneRay(mesh, ray1, &results1, collectAll);
+  CastRays(mesh, rays, 2, results, collectAll);
 
   LM_TRACK_VALUE(m_numFramesInsideManifoldMesh);
-  if ((results0.size() % 2) && (results1.size() % 2)) {
+  if ((results[0].size() % 2) && (results[1].size() % 2)) {
     // Inside mesh && first output
 #if LM_LOG_CAMERA_LOGIC_4
     std::cout << "Inside manifold mesh." << std::endl;
@@ -1280,7 +1415,11 @@ lmReal CameraUtil::GetMaxDistanceForMesh(const Mesh* mesh) const
 }
 
 lmReal CameraUtil::GetMeshSize(const Mesh* mesh) const {
-  lmReal meshSize = mesh->getOctree()->getAabbSplit().getDiagonalLength();
+  return GetMeshSize(mesh->getOctree()->getAabbSplit());
+}
+
+lmReal CameraUtil::GetMeshSize(const Aabb& aabbSplit) const {
+  lmReal meshSize = aabbSplit.getDiagonalLength();
   // Clip max mesh size used for computations.
   meshSize = std::min(meshSize, 3.0f * (2.0f * Mesh::globalScale_));
   return meshSize;
@@ -0,0 +1,91 @@
+#include "StdAfx.h"
+#include "EdgeMap.h"
+#include <algorithm>
+#include <limits>
+
+/** Constructor */
+EdgeMap::EdgeMap() : slots_(1024), mask_(1023), nbEdges_(0), stamp_(1)
+{}
+
+/** Destructor */
+EdgeMap::~EdgeMap()
+{}
+
+/** Getters */
+int EdgeMap::size() const { return nbEdges_; }
+
+/** Remove every edge (the slots of the previous stamp become free) */
+void EdgeMap::clear()
+{
+  nbEdges_ = 0;
+  if(stamp_==std::numeric_limits<int>::max())
+  {
+    slots_.assign(slots_.size(), Slot());
+    stamp_ = 0;
+  }
+  ++stamp_;
+}
+
+/** Slot holding the edge, or the free slot where it should be inserted (edge must be ordered) */
+int EdgeMap::getSlot(int iv1, int iv2) const
+{
+  unsigned int hash = static_cast<unsigned int>(iv1)*2654435761u ^ static_cast<unsigned int>(iv2)*2246822519u;
+  hash ^= hash>>15;
+  int iSlot = hash & mask_;
+  while(true)
+  {
+    const Slot &slot = slots_[iSlot];
+    if(slot.stamp_!=stamp_ || (slot.iv1_==iv1 && slot.iv2_==iv2))
+      return iSlot;
+    iSlot = (iSlot+1) & mask_;
+  }
+}
+
+/** Double the number of slots and insert again the current edges */
+void EdgeMap::grow()
+{
+  std::vector<Slot> slots(slots_.size()*2);
+  slots_.swap(slots);
+  mask_ = slots_.size()-1;
+  int nbSlots = slots.size();
+  for(int i=0;i<nbSlots;++i)
+  {
+    const Slot &slot = slots[i];
+    if(slot.stamp_!=stamp_)
+      continue;
+    slots_[getSlot(slot.iv1_, slot.iv2_)] = slot;
+  }
+}
+
+/**
+* Insert an edge with a value, if the edge is already present the value is
+* set to the stored one and false is returned
+*/
+bool EdgeMap::insert(int iv1, int iv2, int &value)
+{
+  if(iv1>iv2)
+    std::swap(iv1, iv2);
+  if((nbEdges_+1)*2>(int)slots_.size())
+    grow();
+  Slot &slot = slots_[getSlot(iv1, iv2)];
+  if(slot.stamp_==stamp_)
+  {
+    value = slot.value_;
+    return false;
+  }
+  slot.iv1_ = iv1;
+  slot.iv2_ = iv2;
+  slot.value_ = value;
+  slot.stamp_ = stamp_;
+  ++nbEdges_;
+  return true;
+}
+
+/** Value associated to an edge (-1 if the edge isn't present) */
+int EdgeMap::find(int iv1, int iv2) const
+{
+  if(iv1>iv2)
+    std::swap(iv1, iv2);
+  const Slot &slot = slots_[getSlot(iv1, iv2)];
+  return slot.stamp_==stamp_ ? slot.value_ : -1;
+}
@@ -5,6 +5,7 @@
 #include "CCubeMapProcessor.h"
 #include "Common.h"
 #include "GLBuffer.h"
+#include "ThreadPool.h"
 
 #if _WIN32
 #include <direct.h>
@@ -254,22 +255,21 @@ void Environment::freeBitmaps(FIBITMAP** bitmaps) {
 void Environment::processMipmappedCubemap(CubemapImages& cubemapImages) {
   const int numLevels = cubemapImages.irradiance ? 1 : MIPMAP_LEVELS;
 
-  std::thread threads[CUBEMAP_SIDES];
+  ThreadPool::TaskGroup inputFaces("cubemap input");
   for (int i=0; i<CUBEMAP_SIDES; i++) {
-    threads[i] = std::thread(&CCubeMapProcessor::SetInputFaceData,
-      _cubemap_processor,
-      i,
-      CP_VAL_FLOAT32,
-      NUM_CHANNELS,
-      cubemapImages.inputSize*NUM_CHANNELS*4,
-      orig_images[i],
-      10.0f,
-      1.0f,
-      1.0f);
-  }
-  for (int i=0; i<CUBEMAP_SIDES; i++) {
-    threads[i].join();
+    inputFaces.run([this, i, &cubemapImages]() {
+      _cubemap_processor->SetInputFaceData(
+        i,
+        CP_VAL_FLOAT32,
+        NUM_CHANNELS,
+        cubemapImages.inputSize*NUM_CHANNELS*4,
+        orig_images[i],
+        10.0f,
+        1.0f,
+        1.0f);
+    });
   }
+  inputFaces.wait();
 
   bool bUseMultithread = true;
   int FilterTech = CP_FILTER_TYPE_CONE;
@@ -312,22 +312,23 @@ void Environment::processMipmappedCubemap(CubemapImages& cubemapImages) {
   int cur_size = cubemapImages.outputSize;
   for (int i=0; i<numLevels; i++) {
     int numBytes = cur_size*cur_size*NUM_CHANNELS*sizeof(float);
+    ThreadPool::TaskGroup outputFaces("cubemap output");
     for (int j=0; j<CUBEMAP_SIDES; j++) {
       cubemapImages.images[i][j] = new float[numBytes];
-      threads[j] = std::thread(&CCubeMapProcessor::GetOutputFaceData,
-        _cubemap_processor,
-        j,
-        i,
-        CP_VAL_FLOAT32,
-        NUM_CHANNELS,
-        cur_size*NUM_CHANNELS*sizeof(float),
-        cubemapImages.images[i][j],
-        1.0f,
-        1.0f);
-    }
-    for (int j=0; j<CUBEMAP_SIDES; j++) {
-      threads[j].join();
+      float* image = cubemapImages.images[i][j];
+      outputFaces.run([this, i, j, cur_size, image]() {
+        _cubemap_processor->GetOutputFaceData(
+          j,
+          i,
+          CP_VAL_FLOAT32,
+          NUM_CHANNELS,
+          cur_size*NUM_CHANNELS*sizeof(float),
+          image,
+          1.0f,
+          1.0f);
+      });
     }
+    outputFaces.wait();
     cur_size /= 2;
   }
 }
@@ -16,7 +16,7 @@ Files::~Files()
 Mesh* Files::loadSTL(std::istream& stream) const
 {
   Mesh *mesh = new Mesh();
-  VertexSet verticesSet; //detect already read vertices ...
+  VertexMap verticesMap; //detect already read vertices ...
   char header[80];
   int nbTrianglesFile;
   stream.read(header, 80); //header
@@ -36,18 +36,18 @@ Mesh* Files::loadSTL(std::istream& stream) const
     stream.read((char*)&x, 4); //vertex 1
     stream.read((char*)&y, 4);
     stream.read((char*)&z, 4);
-    v1 = Vertex(x, y, z, verticesSet.size());
-    iVer1 = detectNewVertex(v1, i, verticesSet,vertices);
+    v1 = Vertex(x, y, z);
+    iVer1 = detectNewVertex(v1, verticesMap,vertices);
     stream.read((char*)&x, 4); //vertex 2
     stream.read((char*)&y, 4);
     stream.read((char*)&z, 4);
-    v2 = Vertex(x, y, z, verticesSet.size());
-    iVer2 = detectNewVertex(v2, i, verticesSet,vertices);
+    v2 = Vertex(x, y, z);
+    iVer2 = detectNewVertex(v2, verticesMap,vertices);
     stream.read((char*)&x, 4); //vertex 3
     stream.read((char*)&y, 4);
     stream.read((char*)&z, 4);
-    v3 = Vertex(x, y, z, verticesSet.size());
-    iVer3 = detectNewVertex(v3, i, verticesSet,vertices);
+    v3 = Vertex(x, y, z);
+    iVer3 = detectNewVertex(v3, verticesMap,vertices);
     stream.read((char*)&x, 2); //attribute
     triangles.push_back(Triangle((v2-v1).cross(v3-v1).normalized(), iVer1, iVer2, iVer3, i));
   }
@@ -69,6 +69,7 @@ Mesh* Files::loadPLY(std::istream& stream) const {
   Mesh *mesh = new Mesh();
   TriangleVector &triangles = mesh->getTriangles();
   VertexVector &vertices = mesh->getVertices();
+  Vector3Vector &materials = mesh->getMaterials();
   std::string line;
   static const std::string ELEMENT_VERTEX = "element vertex ";
   static const std::string ELEMENT_FACE = "element face ";
@@ -117,7 +118,7 @@ Mesh* Files::loadPLY(std::istream& stream) const {
         std::stringstream ss;
         ss.str(line);
         ss >> x >> y >> z;
-        vertices.push_back(Vertex(x, y, z, vertices.size()));
+        vertices.push_back(Vertex(x, y, z));
         if (colorIndex >= 0) {
           int curIdx = 3;
           while (curIdx < colorIndex) {
@@ -125,7 +126,8 @@ Mesh* Files::loadPLY(std::istream& stream) const {
             curIdx++;
           }
           ss >> x >> y >> z;
-          vertices.back().material_ << x/255.0f, y/255.0f, z/255.0f;
+          materials.resize(vertices.size(), Vector3::Ones());
+          materials.back() << x/255.0f, y/255.0f, z/255.0f;
         }
       }
       for (int j=0; j<nbFaces; j++) {
@@ -141,17 +143,11 @@ Mesh* Files::loadPLY(std::istream& stream) const {
           Vertex& v2 = vertices[iv2];
           Vertex& v3 = vertices[iv3];
           int nbTriangles = triangles.size();
-          v1.tIndices_.push_back(nbTriangles);
-          v2.tIndices_.push_back(nbTriangles);
-          v3.tIndices_.push_back(nbTriangles);
           triangles.push_back(Triangle((v2-v1).cross(v3-v1).normalized(), iv1, iv2, iv3, nbTriangles));
           if (nbVert == 4) {
             nbTriangles++;
             ss >> iv4;
             Vertex& v4 = vertices[iv4];
-            v1.tIndices_.push_back(nbTriangles);
-            v3.tIndices_.push_back(nbTriangles);
-            v4.tIndices_.push_back(nbTriangles);
             triangles.push_back(Triangle((v3-v1).cross(v4-v1).normalized(), iv1, iv3, iv4, nbTriangles));
           }
         }
@@ -192,7 +188,7 @@ Mesh* Files::loadOBJ(std::istream& stream) const
       ss >> x;
       ss >> y;
       ss >> z;
-      vertices.push_back(Vertex(x, y, z, vertices.size()));
+      vertices.push_back(Vertex(x, y, z));
     }
     else if(memcmp(line.c_str(),"f ",2)==0) //face
     {
@@ -221,9 +217,6 @@ Mesh* Files::loadOBJ(std::istream& stream) const
       Vertex &v1 = vertices[iVer1];
       Vertex &v2 = vertices[iVer2];
       Vertex &v3 = vertices[iVer3];
-      v1.addTriangle(triangles.size());
-      v2.addTriangle(triangles.size());
-      v3.addTriangle(triangles.size());
       Vector3 normal =(v2-v1).cross(v3-v1).normalized();
       LM_ASSERT(fabs(normal.norm() - 1.0f) < 0.00001, "Bad normal");
       triangles.push_back(Triangle(normal, iVer1, iVer2, iVer3, triangles.size()));
@@ -235,9 +228,6 @@ Mesh* Files::loadOBJ(std::istream& stream) const
         else
           --iVer4;
         Vertex &v4 = vertices[iVer4];
-        v1.addTriangle(triangles.size());
-        v3.addTriangle(triangles.size());
-        v4.addTriangle(triangles.size());
         normal = (v3-v1).cross(v4-v1).normalized();
         LM_ASSERT(fabs(normal.norm() - 1.0f) < 0.00001, "Bad normal");
         triangles.push_back(Triangle(normal, iVer1, iVer3, iVer4, triangles.size()));
@@ -301,7 +291,7 @@ Mesh* Files::load3DS(std::istream& stream) const
         stream.read((char*)&x,sizeof(float));
         stream.read((char*)&y,sizeof(float));
         stream.read((char*)&z,sizeof(float));
-        vertices.push_back(Vertex(x,y,z,i));
+        vertices.push_back(Vertex(x,y,z));
       }
       break;
     case 0x4120: //face
@@ -317,9 +307,6 @@ Mesh* Files::load3DS(std::istream& stream) const
         Vertex &v1 = vertices[iVer1];
         Vertex &v2 = vertices[iVer2];
         Vertex &v3 = vertices[iVer3];
-        v1.addTriangle(i);
-        v2.addTriangle(i);
-        v3.addTriangle(i);
         triangles.push_back(Triangle((v2-v1).cross(v3-v1).normalized(),iVer1,iVer2,iVer3,i));
       }
       break;
@@ -353,42 +340,63 @@ Mesh* Files::load3DS(std::istream& stream) const
 
 
 /** Check if the vertex already exists */
-int Files::detectNewVertex(const Vertex &v, int iTri, VertexSet &verticesSet, VertexVector &vertices) const
+int Files::detectNewVertex(const Vertex &v, VertexMap &verticesMap, VertexVector &vertices) const
 {
-  std::pair<VertexSet::iterator, bool> pair = verticesSet.insert(v);
-  int iVert = (*pair.first).id_;
+  std::pair<VertexMap::iterator, bool> pair = verticesMap.insert(std::make_pair(v, (int)verticesMap.size()));
+  int iVert = (*pair.first).second;
   if (pair.second)
     vertices.push_back(v);
-  vertices[iVert].addTriangle(iTri);
   return iVert;
 }
 
-/** Save file in STL format */
+/** Save file in STL format (last published epoch of the mesh) */
 void Files::saveSTL(Mesh* mesh, const std::string& filename) const
+{
+  std::shared_ptr<const MeshSnapshot> snapshot = mesh->getSnapshot();
+  if (snapshot)
+    saveSTL(*snapshot, mesh->getTransformation(), filename);
+}
+
+void Files::saveOBJ(Mesh* mesh, std::ostream& ss) const {
+  std::shared_ptr<const MeshSnapshot> snapshot = mesh->getSnapshot();
+  if (snapshot) {
+    saveOBJ(*snapshot, ss);
+  }
+}
+
+void Files::savePLY(Mesh* mesh, std::ostream& ss) const {
+  std::shared_ptr<const MeshSnapshot> snapshot = mesh->getSnapshot();
+  if (snapshot) {
+    savePLY(*snapshot, ss);
+  }
+}
+
+/** Save file in STL format */
+void Files::saveSTL(const MeshSnapshot& snapshot, const Matrix4x4& transformation, const std::string& filename) const
 {
   std::ofstream file(filename.c_str(), std::ios::binary);
   if (file)
   {
-    TriangleVector &triangles = mesh->getTriangles();
-    VertexVector &vertices = mesh->getVertices();
-    float scale = 1/mesh->getScale();
+    float scale = 1/snapshot.getScale();
     char header[80];
     file.write(header, 80);
-    int nbTriangles = mesh->getNbTriangles();
+    int nbTriangles = snapshot.getNbTriangles();
     file.write((char*)&nbTriangles, 4);
     for (int i=0;i<nbTriangles;++i)
     {
-      Triangle &tri = triangles[i];
+      const GLuint* indices = snapshot.getTriangle(i);
+      Vector3 v1 = snapshot.getPosition(indices[0]);
+      Vector3 v2 = snapshot.getPosition(indices[1]);
+      Vector3 v3 = snapshot.getPosition(indices[2]);
       Vector4 normal;
-      normal << tri.normal_, 0.0;
-      normal = mesh->getTransformation()*normal;
+      normal << (v2-v1).cross(v3-v1).normalized(), 0.0;
+      normal = transformation*normal;
       float xTemp = normal.x();
       float yTemp = normal.y();
       float zTemp = normal.z();
       file.write((char*)&xTemp, 4); //normal
       file.write((char*)&yTemp, 4);
       file.write((char*)&zTemp, 4);
-      Vertex v1 = vertices[tri.vIndices_[0]];
       v1*=scale;
       xTemp = v1.x();
       yTemp = v1.y();
@@ -396,7 +404,6 @@ void Files::saveSTL(Mesh* mesh, const std::string& filename) const
       file.write((char*)&xTemp, 4); //vertex 1
       file.write((char*)&yTemp, 4);
       file.write((char*)&zTemp, 4);
-      Vertex v2 = vertices[tri.vIndices_[1]];
       v2*=scale;
       xTemp = v2.x();
       yTemp = v2.y();
@@ -404,7 +411,6 @@ void Files::saveSTL(Mesh* mesh, const std::string& filename) const
       file.write((char*)&xTemp, 4); //vertex 2
       file.write((char*)&yTemp, 4);
       file.write((char*)&zTemp, 4);
-      Vertex v3 = vertices[tri.vIndices_[2]];
       v3*=scale;
       xTemp = v3.x();
       yTemp = v3.y();
@@ -419,42 +425,31 @@ void Files::saveSTL(Mesh* mesh, const std::string& filename) const
   }
 }
 
-void Files::saveOBJ(Mesh* mesh, std::ostream& ss) const {
+void Files::saveOBJ(const MeshSnapshot& snapshot, std::ostream& ss) const {
   if (!ss) {
     return;
   }
-  const TriangleVector &triangles = mesh->getTriangles();
-  const VertexVector &vertices = mesh->getVertices();
-  const float scale = 1/mesh->getScale();
-  const int nbTriangles = triangles.size();
-  const int nbVertices = vertices.size();
+  const float scale = 1/snapshot.getScale();
+  const int nbTriangles = snapshot.getNbTriangles();
+  const int nbVertices = snapshot.getNbVertices();
   ss << "s 0" << std::endl;
   for (int i=0; i<nbVertices; i++) {
-    const Vector3 cur = scale*vertices[i];
+    const Vector3 cur = scale*snapshot.getPosition(i);
     ss << "v " << cur.x() << " " << cur.y() << " " << cur.z() << std::endl;
   }
   for (int i=0; i<nbTriangles; i++) {
-    const int* indices = triangles[i].vIndices_;
+    const GLuint* indices = snapshot.getTriangle(i);
     ss << "f " << indices[0]+1 << " " << indices[1]+1 << " " << indices[2]+1 << std::endl;
   }
 }
 
-void Files::savePLY(Mesh* mesh, std::ostream& ss) const {
-  if (!ss) {
-    return;
-  }
-  const TriangleVector &triangles = mesh->getTriangles();
-  const VertexVector &vertices = mesh->getVertices();
-  const float scale = 1/mesh->getScale();
-  savePLY(vertices, triangles, scale, ss);
-}
-
-void Files::savePLY(const VertexVector& vertices, const TriangleVector& triangles, float scale, std::ostream& ss) const {
+void Files::savePLY(const MeshSnapshot& snapshot, std::ostream& ss) const {
   if (!ss) {
     return;
   }
-  const int nbTriangles = triangles.size();
-  const int nbVertices = vertices.size();
+  const float scale = 1/snapshot.getScale();
+  const int nbTriangles = snapshot.getNbTriangles();
+  const int nbVertices = snapshot.getNbVertices();
 
   // write header
   ss << "ply" << std::endl;
@@ -472,15 +467,15 @@ void Files::savePLY(const VertexVector& vertices, const TriangleVector& triangle
 
   // write geometry
   for (int i=0; i<nbVertices; i++) {
-    const Vector3 cur = scale*vertices[i];
-    const Vector3& color = vertices[i].material_;
+    const Vector3 cur = scale*snapshot.getPosition(i);
+    const Vector3 color = snapshot.getColor(i);
     const unsigned int red = static_cast<unsigned int>(255.0f * color.x());
     const unsigned int green = static_cast<unsigned int>(255.0f * color.y());
     const unsigned int blue = static_cast<unsigned int>(255.0f * color.z());
     ss << cur.x() << " " << cur.y() << " " << cur.z() << " " << red << " " << green << " " << blue << std::endl;
   }
   for (int i=0; i<nbTriangles; i++) {
-    const int* indices = triangles[i].vIndices_;
+    const GLuint* indices = snapshot.getTriangle(i);
     ss << "3 " << indices[0] << " " << indices[1] << " " << indices[2] << std::endl;
   }
 }
@@ -9,6 +9,9 @@
 #include "ReplayUtil.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
+#if !_WIN32
+#include <unistd.h>
+#endif
 
 const float CAMERA_SPEED = 0.005f;
 
@@ -22,12 +25,13 @@ const float MAX_FOV = 90.0f;
 //*********************************************************
 FreeformApp::FreeformApp() : _environment(0), _aa_mode(MSAA), _theta(100.f), _phi(0.f), _draw_ui(true), _mouse_down(false),
   _fov(60.0f), _cam_dist(MIN_CAMERA_DIST), _exposure(1.0f), mesh_(0), _last_update_time(0.0),
-  drawOctree_(false), _shutdown(false), _draw_background(true), _focus_point(Vector3::Zero()),remeshRadius_(100.0f),
+  drawOctree_(false), _shutdown(false), _draw_background(true), _focus_point(Vector3::Zero()),remeshRadius_(100.0f),smoothIterations_(10),
   _lock_camera(false), _last_load_time(0.0), _first_environment_load(true), _have_shaders(true), _have_entered_immersive(false),
   _immersive_changed_time(0.0), _have_audio(true), m_activeLoop(nullptr, nullptr), _audio_paused(false), _wheel_zoom(0.0f),
   _immersive_mode(false), _immersive_entered_time(0.0)
 {
   _fov_modifier.Update(0.0f, 0.0, 0.5f);
+  _input_latency.Update(0.0f, 0.0, 0.5f);
   _camera_util = new CameraUtil();
   Menu::updateSculptMult(0.0, 0.0f);
 }
@@ -68,6 +72,9 @@ void FreeformApp::toggleFullscreen(const std::string& str)
 
 void FreeformApp::setup()
 {
+  // start the workers before the other threads can reach the pool (static initialization is not thread-safe on VS2010)
+  ThreadPool::getInstance();
+
 // osx path stuff
 #ifdef __APPLE__
 
@@ -178,6 +185,7 @@ void FreeformApp::setup()
   _params->addParam( "Bloom threshold", &_bloom_light_threshold, "min=0.0 max=2.0 step=0.01" );
   _params->addParam( "Draw Background", &_draw_background, "" );
   _params->addParam( "Remesh Radius", &remeshRadius_, "min=20, max=200, step=2.5" );
+  _params->addParam( "Smooth Iterations", &smoothIterations_, "min=1, max=100, step=1" );
 #endif
 
   _environment = new Environment();
@@ -228,11 +236,16 @@ void FreeformApp::setup()
   _ui->setRegularFont(ci::Font(loadResource( RES_FONT_FREIGHTSANS_TTF ), Menu::FONT_SIZE));
   _ui->setBoldFont(ci::Font(loadResource( RES_FONT_FREIGHTSANSBOLD_TTF ), Menu::FONT_SIZE));
 
+#if LM_SYNTHETIC_LEAP_FRAMES
+  _listener.startSyntheticFrames(115.0);
+#else
   _controller.addListener(_listener);
+#endif
 
   _leap_interaction = new LeapInteraction(&sculpt_, _ui);
 
   sculpt_.setSculptMode(Sculpt::SWEEP);
+  sculpt_.setLog(&_sculpt_log);
   _leap_interaction->setBrushRadius(10.0f);
   _leap_interaction->setBrushStrength(0.5f);
 
@@ -264,6 +277,7 @@ void FreeformApp::setup()
     }
     mesh_ = mesh;
     if (mesh_) {
+      setUndoFile();
       mesh_->startPushState();
       _last_load_time = ci::app::getElapsedSeconds();
       sculpt_.setMesh(mesh_);
@@ -280,8 +294,6 @@ void FreeformApp::setup()
 #if ! LM_DISABLE_THREADING_AND_ENVIRONMENT
   _mesh_thread = std::thread(&FreeformApp::updateLeapAndMesh, this);
 #endif
-
-  _auto_save.start();
 }
 
 void FreeformApp::doQuit()
@@ -296,6 +308,7 @@ void FreeformApp::shutdown() {
   {
     _mesh_thread.join();
   }
+  _auto_save.shutdown();
   if (_loading_thread.joinable())
   {
     _loading_thread.detach();
@@ -417,6 +430,9 @@ void FreeformApp::keyDown( KeyEvent event )
   case 'o': drawOctree_ = !drawOctree_; break;
   case 's': toggleSymmetry(); break;
   case 'r': sculpt_.setRemeshRadius(remeshRadius_); break;
+  case 'm': sculpt_.setSmoothMesh(smoothIterations_); break;
+  case 'l': toggleSculptLog(); break;
+  case 'k': sculpt_.setRecycling(!sculpt_.recycling()); break;
 #endif
 #if __APPLE__
   case 'y': if (event.isMetaDown()) { if (mesh_ && allowUndo) { mesh_->redo(); } } break;
@@ -481,6 +497,11 @@ void FreeformApp::update()
   LM_TRACK_CONST_VALUE(curTime);
   const float deltaTime = _last_update_time == 0.0 ? 0.0f : static_cast<float>(curTime - _last_update_time);
 
+  // motion-to-photon : reception to end of the sculpting step, then half a render frame
+  // on average until the next draw picks the mesh and one more frame until it is presented
+  const float renderPeriod = 1.0f/std::max(getAverageFps(), 1.0f);
+  _leap_interaction->setMotionToPhoton(0.001f*_input_latency.value + 1.5f*renderPeriod);
+
   static const float TIME_UNTIL_AUTOMATIC_ORBIT = 60.0f;
   static const float TIME_UNTIL_AUTOMATIC_FOV = 50.0f;
   const float timeSinceActivity = static_cast<float>(curTime - _leap_interaction->getLastActivityTime());
@@ -557,9 +578,13 @@ void FreeformApp::update()
     temp << _camera_util->isoState.refPosition, 1.0;
   }
   _focus_point = (trans * temp).head<3>();
-  // if mesh
+  // if mesh (read from its last epoch, the mesh thread may be sculpting it)
+  std::shared_ptr<const MeshSnapshot> snapshot;
   if (mesh_) {
-    _focus_radius = _camera_util->IsoQueryRadius(mesh_, &_camera_util->isoState);
+    snapshot = mesh_->getSnapshot();
+  }
+  if (snapshot) {
+    _focus_radius = _camera_util->IsoQueryRadius(*snapshot, &_camera_util->isoState);
   } else {
     _focus_radius = 0.0f;
   }
@@ -574,6 +599,7 @@ void FreeformApp::update()
   _camera.getProjectionMatrix();
 
   if (mesh_) {
+    mesh_->setSnapshotOctree(drawOctree_);
     mesh_->updateGPUBuffers();
   }
 
@@ -624,7 +650,9 @@ void FreeformApp::updateLeapAndMesh() {
           _camera_util->m_timeOfLastScupt = static_cast<lmReal>(sculpt_.getLastSculptTime());
         }
       }
-      _mesh_update_counter.Update(ci::app::getElapsedSeconds());
+      const double updateTime = ci::app::getElapsedSeconds();
+      _mesh_update_counter.Update(updateTime);
+      _input_latency.Update(1000.0f*static_cast<float>(updateTime - _leap_interaction->frameReceiveTime()), curTime, 0.9f);
     } else if (mesh_) {
       // Allow camera movement when leap is disconnected
       std::unique_lock<std::mutex> lock(_mesh_mutex);
@@ -679,7 +707,7 @@ void FreeformApp::renderSceneToFbo(Camera& _Camera)
   _environment->bindCubeMap(Environment::CUBEMAP_IRRADIANCE, 0);
   _environment->bindCubeMap(Environment::CUBEMAP_RADIANCE, 1);
 
-  BrushVector brushes = sculpt_.getBrushes();
+  const BrushVector& brushes = sculpt_.getBrushes();
   int numBrushes = brushes.size();
   std::vector<ci::Vec3f> brushPositions;
   std::vector<float> brushWeights;
@@ -1005,12 +1033,17 @@ void FreeformApp::draw() {
     if (_draw_ui) {
       int tris = 0;
       int verts = 0;
+      std::shared_ptr<const MeshSnapshot> snapshot;
       if (mesh_) {
-        tris = mesh_->getNbTriangles();
-        verts = mesh_->getNbVertices();
+        snapshot = mesh_->getSnapshot();
+      }
+      if (snapshot) {
+        tris = snapshot->getNbTriangles();
+        verts = snapshot->getNbVertices();
       }
       std::stringstream ss;
-      ss << getAverageFps() << " render fps, " << _mesh_update_counter.FPS() << " simulate fps, " << tris << " triangles, " << verts << " vertices";
+      ss << getAverageFps() << " render fps, " << _mesh_update_counter.FPS() << " simulate fps, " << sculpt_.getSculptDuration() << " ms sculpt, " << _input_latency.value << " ms input latency, "
+         << 1000.0f*_leap_interaction->getMotionToPhoton() << " ms motion-to-photon, " << _leap_interaction->getPredictionError() << "/" << _leap_interaction->getLagError() << " mm predicted/lag error, " << tris << " triangles, " << verts << " vertices";
       glPushMatrix();
       gl::scale(1, -1);
       ci::gl::drawString(ss.str(), Vec2f(5.0f, -(height-5.0f)), ColorA::white(), Font("Arial", 18));
@@ -1324,6 +1357,48 @@ void FreeformApp::toggleSymmetry() {
   sculpt_.setSymmetry(!sculpt_.symmetry());
 }
 
+void FreeformApp::toggleSculptLog() {
+  std::unique_lock<std::mutex> lock(_mesh_mutex);
+  if (_sculpt_log.isRecording()) {
+    std::cout << "Sculpt log stopped after " << _sculpt_log.getNbFrames() << " frames" << std::endl;
+    _sculpt_log.close();
+  } else if (mesh_) {
+    // the replay starts from the current mesh, saved beside the log
+    std::shared_ptr<const MeshSnapshot> snapshot = mesh_->getSnapshot();
+    const std::string meshPath = AutoSave::getUserPath("session.ply");
+    const std::string logPath = AutoSave::getUserPath("session.lmlog");
+    std::ofstream file(meshPath.c_str());
+    if (snapshot && file) {
+      Files files;
+      files.savePLY(*snapshot, file);
+      file.close();
+      if (_sculpt_log.openWrite(logPath, snapshot->getScale())) {
+        std::cout << "Sculpt log started: " << logPath << std::endl;
+      }
+    }
+  }
+}
+
+void FreeformApp::setUndoFile() {
+  // the oldest undo states of the new mesh go to the user directory instead of being dropped,
+  // the file is named after the process so that running instances don't share it
+#if _WIN32
+  const unsigned long processId = GetCurrentProcessId();
+#else
+  const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+  std::stringstream ss;
+  ss << "undo-" << processId << ".bin";
+  try {
+    const std::string undoPath = AutoSave::getUserPath(ss.str());
+    if (!mesh_->setUndoFile(undoPath)) {
+      std::cout << "Error creating undo file " << undoPath << ", the oldest undo states will be dropped" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cout << "Error creating undo file: " << e.what() << std::endl;
+  }
+}
+
 void FreeformApp::setEnvironment(const std::string& str) {
   if (!_environment || _environment->getLoadingState() != Environment::LOADING_STATE_NONE) {
     return;
@@ -1366,11 +1441,6 @@ int FreeformApp::loadFile()
   if (!path.empty()) {
     const std::string ext = path.extension().string();
     if (!ext.empty()) {
-      Mesh::stateMask_= 1;
-      Vertex::tagMask_ = 1;
-      Vertex::sculptMask_ = 1;
-      Triangle::tagMask_ = 1;
-
       Files files;
       Mesh* mesh = 0;
       const std::string pathString = path.string();
@@ -1403,9 +1473,11 @@ int FreeformApp::loadFile()
       mesh_->setRotationVelocity(rotationVel);
       if (mesh_) {
         _last_load_time = ci::app::getElapsedSeconds();
+        setUndoFile();
         mesh_->startPushState();
       }
       sculpt_.setMesh(mesh_);
+      _sculpt_log.close(); // the log only replays on the mesh it started from
       err = 1;
     }
   }
@@ -1414,11 +1486,6 @@ int FreeformApp::loadFile()
 }
 
 int FreeformApp::loadShape(Shape shape) {
-  Mesh::stateMask_= 1;
-  Vertex::tagMask_ = 1;
-  Vertex::sculptMask_ = 1;
-  Triangle::tagMask_ = 1;
-
   std::stringstream ss(shapes_[shape]);
   Files files;
   Mesh* newMesh = files.loadOBJ(ss);
@@ -1434,10 +1501,12 @@ int FreeformApp::loadShape(Shape shape) {
   mesh_ = newMesh;
   mesh_->setRotationVelocity(rotationVel);
   if (mesh_) {
+    setUndoFile();
     mesh_->startPushState();
     _last_load_time = ci::app::getElapsedSeconds();
   }
   sculpt_.setMesh(mesh_);
+  _sculpt_log.close(); // the log only replays on the mesh it started from
 
   return -1;
 }
@@ -19,6 +19,11 @@ void GLBuffer::allocate(const void* data, int count, GLenum pattern) {
   checkError("Allocate");
 }
 
+void GLBuffer::update(const void* data, int offset, int count) {
+  glBufferSubData(type_, offset, count, data);
+  checkError("Update");
+}
+
 void GLBuffer::release() {
   glBindBuffer(type_, 0);
   checkError("Release");
@@ -404,3 +404,188 @@ void Geometry::getClosestPoint_noNormal(const Geometry::GetClosestPointInput& in
     break;
   }
 }
+
+Geometry::RayPacket::RayPacket(const Vector3* starts, const Vector3* ends, int numRays) {
+  LM_ASSERT(0 < numRays && numRays <= RAY_PACKET_SIZE, "Bad ray packet size");
+  float o[3][RAY_PACKET_SIZE];
+  float d[3][RAY_PACKET_SIZE];
+  for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+    // unused lanes repeat the last ray and are masked out
+    const int ri = std::min(i, numRays-1);
+    for (int k = 0; k < 3; k++) {
+      o[k][i] = starts[ri][k];
+      d[k][i] = ends[ri][k] - starts[ri][k];
+    }
+  }
+  ox = _mm_loadu_ps(o[0]); oy = _mm_loadu_ps(o[1]); oz = _mm_loadu_ps(o[2]);
+  dx = _mm_loadu_ps(d[0]); dy = _mm_loadu_ps(d[1]); dz = _mm_loadu_ps(d[2]);
+  const __m128 one = _mm_set1_ps(1.0f);
+  idx = _mm_div_ps(one, dx); idy = _mm_div_ps(one, dy); idz = _mm_div_ps(one, dz);
+  mask = (1 << numRays) - 1;
+}
+
+int Geometry::intersectionRaysAabb(const RayPacket& packet, const Aabb& aabb, const float* tMax) {
+  __m128 tNear = _mm_setzero_ps();
+  __m128 tFar = _mm_loadu_ps(tMax);
+
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min_.x()), packet.ox), packet.idx);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max_.x()), packet.ox), packet.idx);
+  tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+  tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min_.y()), packet.oy), packet.idy);
+  t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max_.y()), packet.oy), packet.idy);
+  tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+  tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min_.z()), packet.oz), packet.idz);
+  t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max_.z()), packet.oz), packet.idz);
+  tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+  tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+  return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & packet.mask;
+}
+
+int Geometry::intersectionRaysTriangle(const RayPacket& packet, const Vector3& v1, const Vector3& v2, const Vector3& v3, float* tHit) {
+  const Vector3 edge1 = v2 - v1;
+  const Vector3 edge2 = v3 - v1;
+  const __m128 e1x = _mm_set1_ps(edge1.x()), e1y = _mm_set1_ps(edge1.y()), e1z = _mm_set1_ps(edge1.z());
+  const __m128 e2x = _mm_set1_ps(edge2.x()), e2y = _mm_set1_ps(edge2.y()), e2z = _mm_set1_ps(edge2.z());
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  // p = dir x edge2
+  const __m128 px = _mm_sub_ps(_mm_mul_ps(packet.dy, e2z), _mm_mul_ps(packet.dz, e2y));
+  const __m128 py = _mm_sub_ps(_mm_mul_ps(packet.dz, e2x), _mm_mul_ps(packet.dx, e2z));
+  const __m128 pz = _mm_sub_ps(_mm_mul_ps(packet.dx, e2y), _mm_mul_ps(packet.dy, e2x));
+  const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+  const __m128 invDet = _mm_div_ps(one, det);
+
+  // s = start - v1
+  const __m128 sx = _mm_sub_ps(packet.ox, _mm_set1_ps(v1.x()));
+  const __m128 sy = _mm_sub_ps(packet.oy, _mm_set1_ps(v1.y()));
+  const __m128 sz = _mm_sub_ps(packet.oz, _mm_set1_ps(v1.z()));
+  const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+  // q = s x edge1
+  const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(packet.dx, qx), _mm_mul_ps(packet.dy, qy)), _mm_mul_ps(packet.dz, qz)), invDet);
+  const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+  __m128 hit = _mm_cmpneq_ps(det, zero);
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(t, one));
+  _mm_storeu_ps(tHit, t);
+  return _mm_movemask_ps(hit) & packet.mask;
+}
+
+void Geometry::TriangleBatch::gather(const Mesh* mesh, const int* triIdx, int numTris) {
+  LM_ASSERT(0 < numTris && numTris <= TRIANGLE_BATCH_SIZE, "Bad triangle batch size");
+  float v[9][4];
+  float a[4];
+  for (int i = 0; i < 4; i++) {
+    // unused lanes repeat the last triangle and are masked out
+    const Triangle& tri = mesh->getTriangle(triIdx[std::min(i, numTris-1)]);
+    for (int k = 0; k < 3; k++) {
+      const Vertex& vert = mesh->getVertex(tri.vIndices_[k]);
+      v[3*k][i] = vert.x(); v[3*k+1][i] = vert.y(); v[3*k+2][i] = vert.z();
+    }
+    a[i] = tri.area;
+  }
+  v0x = _mm_loadu_ps(v[0]); v0y = _mm_loadu_ps(v[1]); v0z = _mm_loadu_ps(v[2]);
+  v1x = _mm_loadu_ps(v[3]); v1y = _mm_loadu_ps(v[4]); v1z = _mm_loadu_ps(v[5]);
+  v2x = _mm_loadu_ps(v[6]); v2y = _mm_loadu_ps(v[7]); v2z = _mm_loadu_ps(v[8]);
+  area = _mm_loadu_ps(a);
+  mask = (1 << numTris) - 1;
+}
+
+static inline __m128 lmSelect(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 lmDot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+// Closest point of a segment [a, a+e] to p: keeps it in (bestX, bestY, bestZ) if closer than bestDist.
+static inline void lmClosestOnEdge(__m128 ax, __m128 ay, __m128 az, __m128 ex, __m128 ey, __m128 ez,
+                                   __m128 px, __m128 py, __m128 pz,
+                                   __m128& bestDist, __m128& bestX, __m128& bestY, __m128& bestZ) {
+  const __m128 tx = _mm_sub_ps(px, ax), ty = _mm_sub_ps(py, ay), tz = _mm_sub_ps(pz, az);
+  // degenerate edges give NaN, clamped to 0
+  __m128 t = _mm_div_ps(lmDot(tx, ty, tz, ex, ey, ez), lmDot(ex, ey, ez, ex, ey, ez));
+  t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  const __m128 qx = _mm_add_ps(ax, _mm_mul_ps(t, ex));
+  const __m128 qy = _mm_add_ps(ay, _mm_mul_ps(t, ey));
+  const __m128 qz = _mm_add_ps(az, _mm_mul_ps(t, ez));
+  const __m128 dx = _mm_sub_ps(px, qx), dy = _mm_sub_ps(py, qy), dz = _mm_sub_ps(pz, qz);
+  const __m128 dist = lmDot(dx, dy, dz, dx, dy, dz);
+  const __m128 closer = _mm_cmplt_ps(dist, bestDist);
+  bestDist = lmSelect(closer, dist, bestDist);
+  bestX = lmSelect(closer, qx, bestX);
+  bestY = lmSelect(closer, qy, bestY);
+  bestZ = lmSelect(closer, qz, bestZ);
+}
+
+__m128 Geometry::getClosestPoints(const TriangleBatch& b, const Vector3& point, __m128* px, __m128* py, __m128* pz) {
+  const __m128 x = _mm_set1_ps(point.x()), y = _mm_set1_ps(point.y()), z = _mm_set1_ps(point.z());
+  const __m128 zero = _mm_setzero_ps();
+
+  // Triangle edges
+  const __m128 e0x = _mm_sub_ps(b.v1x, b.v0x), e0y = _mm_sub_ps(b.v1y, b.v0y), e0z = _mm_sub_ps(b.v1z, b.v0z);
+  const __m128 e1x = _mm_sub_ps(b.v2x, b.v1x), e1y = _mm_sub_ps(b.v2y, b.v1y), e1z = _mm_sub_ps(b.v2z, b.v1z);
+  const __m128 e2x = _mm_sub_ps(b.v0x, b.v2x), e2y = _mm_sub_ps(b.v0y, b.v2y), e2z = _mm_sub_ps(b.v0z, b.v2z);
+
+  // Front direction of the triangle
+  const __m128 nx = _mm_sub_ps(_mm_mul_ps(e0y, e1z), _mm_mul_ps(e0z, e1y));
+  const __m128 ny = _mm_sub_ps(_mm_mul_ps(e0z, e1x), _mm_mul_ps(e0x, e1z));
+  const __m128 nz = _mm_sub_ps(_mm_mul_ps(e0x, e1y), _mm_mul_ps(e0y, e1x));
+  const __m128 nSqr = lmDot(nx, ny, nz, nx, ny, nz);
+
+  // The point projects inside the triangle if it is on the inner side of the 3 edges
+  __m128 inside = _mm_cmpgt_ps(nSqr, zero);
+  const __m128 ve[3][6] = {
+    { b.v0x, b.v0y, b.v0z, e0x, e0y, e0z },
+    { b.v1x, b.v1y, b.v1z, e1x, e1y, e1z },
+    { b.v2x, b.v2y, b.v2z, e2x, e2y, e2z }
+  };
+  for (int i = 0; i < 3; i++) {
+    const __m128 tx = _mm_sub_ps(x, ve[i][0]), ty = _mm_sub_ps(y, ve[i][1]), tz = _mm_sub_ps(z, ve[i][2]);
+    const __m128 cx = _mm_sub_ps(_mm_mul_ps(ve[i][4], tz), _mm_mul_ps(ve[i][5], ty));
+    const __m128 cy = _mm_sub_ps(_mm_mul_ps(ve[i][5], tx), _mm_mul_ps(ve[i][3], tz));
+    const __m128 cz = _mm_sub_ps(_mm_mul_ps(ve[i][3], ty), _mm_mul_ps(ve[i][4], tx));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(lmDot(cx, cy, cz, nx, ny, nz), zero));
+  }
+
+  // Inside: distance to the plane
+  const __m128 tx = _mm_sub_ps(x, b.v0x), ty = _mm_sub_ps(y, b.v0y), tz = _mm_sub_ps(z, b.v0z);
+  const __m128 k = _mm_div_ps(lmDot(tx, ty, tz, nx, ny, nz), nSqr);
+  const __m128 planeDist = _mm_mul_ps(_mm_mul_ps(k, k), nSqr);
+
+  // Outside: closest edge
+  __m128 bestDist = _mm_set1_ps(FLT_MAX);
+  __m128 bestX = zero, bestY = zero, bestZ = zero;
+  for (int i = 0; i < 3; i++) {
+    lmClosestOnEdge(ve[i][0], ve[i][1], ve[i][2], ve[i][3], ve[i][4], ve[i][5], x, y, z, bestDist, bestX, bestY, bestZ);
+  }
+
+  __m128 distSqr = lmSelect(inside, planeDist, bestDist);
+  static const int laneMasks[16][4] = {
+    {0,0,0,0},{-1,0,0,0},{0,-1,0,0},{-1,-1,0,0},{0,0,-1,0},{-1,0,-1,0},{0,-1,-1,0},{-1,-1,-1,0},
+    {0,0,0,-1},{-1,0,0,-1},{0,-1,0,-1},{-1,-1,0,-1},{0,0,-1,-1},{-1,0,-1,-1},{0,-1,-1,-1},{-1,-1,-1,-1}
+  };
+  const __m128 active = _mm_loadu_ps(reinterpret_cast<const float*>(laneMasks[b.mask]));
+  distSqr = lmSelect(active, distSqr, _mm_set1_ps(FLT_MAX));
+
+  if (px && py && pz) {
+    *px = lmSelect(inside, _mm_sub_ps(x, _mm_mul_ps(k, nx)), bestX);
+    *py = lmSelect(inside, _mm_sub_ps(y, _mm_mul_ps(k, ny)), bestY);
+    *pz = lmSelect(inside, _mm_sub_ps(z, _mm_mul_ps(k, nz)), bestZ);
+  }
+  return distSqr;
+}
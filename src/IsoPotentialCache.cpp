@@ -0,0 +1,126 @@
+#include "StdAfx.h"
+#include "IsoPotentialCache.h"
+#include <cmath>
+
+const float IsoPotentialCache::radiusStep_ = 1.05f;
+
+/** Constructor */
+IsoPotentialCache::IsoPotentialCache() : queryRadius_(0), spacing_(0), radiusLevel_(0), spacingRatio_(0)
+{}
+
+/** Destructor */
+IsoPotentialCache::~IsoPotentialCache()
+{}
+
+/** Getters */
+lmReal IsoPotentialCache::getQueryRadius() const { return queryRadius_; }
+lmReal IsoPotentialCache::getSpacing() const { return spacing_; }
+int IsoPotentialCache::getNbBricks() const { return bricks_.size(); }
+
+/** Remove every sample */
+void IsoPotentialCache::clear()
+{
+  bricks_.clear();
+}
+
+/**
+* Quantize the query radius, the cache is flushed when the quantized radius
+* or the lattice spacing changes. Return the radius to evaluate the samples with
+*/
+lmReal IsoPotentialCache::setQueryRadius(lmReal queryRadius, lmReal spacingRatio)
+{
+  const int level = static_cast<int>(floorf(logf(std::max(queryRadius, 1e-6f))/logf(radiusStep_)+0.5f));
+  if(spacing_==0 || level!=radiusLevel_ || spacingRatio!=spacingRatio_)
+  {
+    clear();
+    radiusLevel_ = level;
+    spacingRatio_ = spacingRatio;
+    queryRadius_ = powf(radiusStep_, static_cast<float>(level));
+    spacing_ = queryRadius_*spacingRatio;
+  }
+  return queryRadius_;
+}
+
+/** Drop the bricks whose samples can see a triangle inside the aabb */
+void IsoPotentialCache::invalidate(const Aabb &aabb)
+{
+  if(bricks_.empty() || spacing_==0)
+    return;
+  const float brickLength = spacing_*brickSize_;
+  const Vector3 min = (aabb.min_-Vector3::Constant(queryRadius_))/brickLength;
+  const Vector3 max = (aabb.max_+Vector3::Constant(queryRadius_))/brickLength;
+  int bMin[3], bMax[3];
+  int64_t nbRange = 1;
+  for(int i=0;i<3;++i)
+  {
+    bMin[i] = static_cast<int>(floorf(min[i]));
+    bMax[i] = static_cast<int>(floorf(max[i]));
+    nbRange *= bMax[i]-bMin[i]+1;
+  }
+  if(nbRange > (int64_t)bricks_.size())
+  {
+    std::unordered_map<int64_t, Brick>::iterator it = bricks_.begin();
+    while(it!=bricks_.end())
+    {
+      const int64_t key = it->first;
+      const int bx = static_cast<int>((key >> 42) & 0x1fffff) - (1<<20);
+      const int by = static_cast<int>((key >> 21) & 0x1fffff) - (1<<20);
+      const int bz = static_cast<int>(key & 0x1fffff) - (1<<20);
+      if(bx>=bMin[0] && bx<=bMax[0] && by>=bMin[1] && by<=bMax[1] && bz>=bMin[2] && bz<=bMax[2])
+        it = bricks_.erase(it);
+      else
+        ++it;
+    }
+    return;
+  }
+  for(int bx=bMin[0];bx<=bMax[0];++bx)
+    for(int by=bMin[1];by<=bMax[1];++by)
+      for(int bz=bMin[2];bz<=bMax[2];++bz)
+        bricks_.erase(brickKey(bx, by, bz));
+}
+
+/** Return true and the value of a lattice sample if it is cached */
+bool IsoPotentialCache::getSample(int x, int y, int z, lmReal &value) const
+{
+  const int s = brickSize_;
+  std::unordered_map<int64_t, Brick>::const_iterator it = bricks_.find(brickKey(floorDiv(x, s), floorDiv(y, s), floorDiv(z, s)));
+  if(it==bricks_.end())
+    return false;
+  const int iSample = sampleIndex(x, y, z);
+  if(!(it->second.valid_ & (static_cast<uint64_t>(1) << iSample)))
+    return false;
+  value = it->second.values_[iSample];
+  return true;
+}
+
+/** Store a lattice sample */
+void IsoPotentialCache::setSample(int x, int y, int z, lmReal value)
+{
+  if((int)bricks_.size()>=maxBricks_)
+    clear();
+  const int s = brickSize_;
+  Brick &brick = bricks_[brickKey(floorDiv(x, s), floorDiv(y, s), floorDiv(z, s))];
+  const int iSample = sampleIndex(x, y, z);
+  brick.values_[iSample] = value;
+  brick.valid_ |= static_cast<uint64_t>(1) << iSample;
+}
+
+/** Integer division rounded toward minus infinity */
+int IsoPotentialCache::floorDiv(int a, int b)
+{
+  return a>=0 ? a/b : -((-a+b-1)/b);
+}
+
+/** Pack brick coordinates (21 bits each) */
+int64_t IsoPotentialCache::brickKey(int bx, int by, int bz)
+{
+  const int64_t offset = 1<<20;
+  return ((bx+offset) << 42) | ((by+offset) << 21) | (bz+offset);
+}
+
+/** Index of a sample inside its brick */
+int IsoPotentialCache::sampleIndex(int x, int y, int z)
+{
+  const int s = brickSize_;
+  return ((x-floorDiv(x, s)*s)*s + (y-floorDiv(y, s)*s))*s + (z-floorDiv(z, s)*s);
+}
@@ -0,0 +1,164 @@
+#include "StdAfx.h"
+#include "Laplacian.h"
+#include "Mesh.h"
+
+/** Constructor */
+Laplacian::Laplacian() : nbRows_(0)
+{}
+
+/** Destructor */
+Laplacian::~Laplacian()
+{}
+
+/** Getters */
+int Laplacian::getNbVertices() const { return nbRows_; }
+const std::vector<int>& Laplacian::getVertices() const { return iVerts_; }
+
+/** Remove the operator */
+void Laplacian::clear()
+{
+  iVerts_.clear();
+  nbRows_ = 0;
+  rowStart_.assign(1, 0);
+  columns_.clear();
+  rowWeights_.clear();
+}
+
+/** Build the operator of a region */
+void Laplacian::init(const Mesh *mesh, const std::vector<int> &iVerts)
+{
+  const Adjacency &vertTris = mesh->getVerticesTriangles();
+  const Adjacency &vertRings = mesh->getVerticesRing();
+  const int nbVertices = mesh->getNbVertices();
+  if(static_cast<int>(localIndex_.size()) < nbVertices)
+    localIndex_.resize(nbVertices, -1);
+
+  iVerts_ = iVerts;
+  nbRows_ = iVerts.size();
+  ThreadPool::parallelFor(0, nbRows_, [&](int i) {
+    localIndex_[iVerts_[i]] = i;
+  });
+
+  //count the neighbours of each row, and number the fixed neighbours
+  rowStart_.resize(nbRows_+1);
+  rowStart_[0] = 0;
+  for(int i=0;i<nbRows_;++i)
+  {
+    const int iVert = iVerts_[i];
+    Adjacency::Range ring = vertRings[iVert];
+    const int nbRing = ring.size();
+    const bool border = nbRing!=vertTris.size(iVert);
+    int nbCols = 0;
+    for(int j=0;j<nbRing;++j)
+    {
+      const int iNeighbour = ring[j];
+      if(border && vertTris.size(iNeighbour)==vertRings.size(iNeighbour))
+        continue;
+      if(localIndex_[iNeighbour]==-1)
+      {
+        localIndex_[iNeighbour] = iVerts_.size();
+        iVerts_.push_back(iNeighbour);
+      }
+      ++nbCols;
+    }
+    rowStart_[i+1] = rowStart_[i]+nbCols;
+  }
+
+  columns_.resize(rowStart_[nbRows_]);
+  rowWeights_.resize(nbRows_);
+  ThreadPool::parallelFor(0, nbRows_, [&](int i) {
+    const int iVert = iVerts_[i];
+    Adjacency::Range ring = vertRings[iVert];
+    const int nbRing = ring.size();
+    const bool border = nbRing!=vertTris.size(iVert);
+    int iCol = rowStart_[i];
+    for(int j=0;j<nbRing;++j)
+    {
+      const int iNeighbour = ring[j];
+      if(border && vertTris.size(iNeighbour)==vertRings.size(iNeighbour))
+        continue;
+      columns_[iCol++] = localIndex_[iNeighbour];
+    }
+    const int nbCols = rowStart_[i+1]-rowStart_[i];
+    rowWeights_[i] = nbCols>0 ? 1.0f/nbCols : 0.0f;
+  });
+
+  const int nbLocal = iVerts_.size();
+  ThreadPool::parallelFor(0, nbLocal, [&](int i) {
+    localIndex_[iVerts_[i]] = -1;
+  });
+}
+
+/** Copy the values of the region and of the fixed neighbours */
+void Laplacian::gather(const Vector3Vector &values)
+{
+  const int nbLocal = iVerts_.size();
+  values_.resize(nbLocal);
+  ThreadPool::parallelFor(0, nbLocal, [&](int i) {
+    values_[i] = values[iVerts_[i]];
+  });
+}
+
+/** Copy the positions of the region and of the fixed neighbours */
+void Laplacian::gatherPositions(const Mesh *mesh)
+{
+  const VertexVector &vertices = mesh->getVertices();
+  const int nbLocal = iVerts_.size();
+  values_.resize(nbLocal);
+  ThreadPool::parallelFor(0, nbLocal, [&](int i) {
+    values_[i] = vertices[iVerts_[i]];
+  });
+}
+
+/** Average of the neighbours of each row (a row without neighbours keeps its value) */
+void Laplacian::multiply(const Vector3Vector &values, Vector3Vector &result) const
+{
+  result.resize(nbRows_);
+  ThreadPool::parallelFor(0, nbRows_, [&](int i) {
+    const int iEnd = rowStart_[i+1];
+    if(rowStart_[i]==iEnd)
+    {
+      result[i] = values[i];
+      return;
+    }
+    Vector3 sum(Vector3::Zero());
+    for(int j=rowStart_[i];j<iEnd;++j)
+      sum += values[columns_[j]];
+    result[i] = sum*rowWeights_[i];
+  });
+}
+
+/** Average position and color of the neighbours of each vertex of the region */
+void Laplacian::average(const Mesh *mesh, Vector3Vector &smoothVerts, Vector3Vector &smoothColors)
+{
+  gatherPositions(mesh);
+  multiply(values_, smoothVerts);
+  gather(mesh->getMaterials());
+  multiply(values_, smoothColors);
+}
+
+/**
+* Smooth the positions of the region, the fixed neighbours don't move.
+* Each iteration is a Jacobi step p += lambda*(Lp - p), followed by a step with
+* mu if mu is not zero (Taubin lambda|mu smoothing, mu < -lambda prevents shrinkage).
+*/
+void Laplacian::iterate(Mesh *mesh, int nbIterations, float lambda, float mu)
+{
+  gatherPositions(mesh);
+  const int nbSteps = mu!=0.0f ? 2 : 1;
+  for(int k=0;k<nbIterations;++k)
+  {
+    for(int s=0;s<nbSteps;++s)
+    {
+      const float factor = s==0 ? lambda : mu;
+      multiply(values_, result_);
+      ThreadPool::parallelFor(0, nbRows_, [&](int i) {
+        values_[i] += (result_[i]-values_[i])*factor;
+      });
+    }
+  }
+  VertexVector &vertices = mesh->getVertices();
+  ThreadPool::parallelFor(0, nbRows_, [&](int i) {
+    vertices[iVerts_[i]] = values_[i];
+  });
+}
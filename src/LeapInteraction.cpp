@@ -12,10 +12,12 @@ using namespace ci;
 
 const float LeapInteraction::MIN_POINTABLE_LENGTH = 10.0f;
 const float LeapInteraction::MIN_POINTABLE_AGE = 0.05f;
+const float LeapInteraction::DEFAULT_PREDICTION_HORIZON = 0.05f;
 
-LeapInteraction::LeapInteraction(Sculpt* sculpt, UserInterface* ui) : _sculpt(sculpt), _ui(ui),
+LeapInteraction::LeapInteraction(Sculpt* sculpt, UserInterface* ui) : _cur_frame_receive_time(0.0), _sculpt(sculpt), _ui(ui),
   _desired_brush_radius(0.4f), _is_pinched(false), _last_camera_update_time(0.0), _autoBrush(true),
-  _last_activity_time(0.0)
+  _last_activity_time(0.0), _motion_to_photon(0.0f), _max_prediction_horizon(DEFAULT_PREDICTION_HORIZON),
+  _prediction_error(0.0f), _lag_error(0.0f)
 {
   _dphi.Update(0.0f, 0.0, 0.95f);
   _dtheta.Update(0.0f, 0.0, 0.95f);
@@ -41,19 +43,17 @@ bool LeapInteraction::processInteraction(LeapListener& listener, float aspect, c
   {
     _cur_frame = Leap::Frame::invalid();
     _last_frame = Leap::Frame::invalid();
-    std::unique_lock<std::mutex> brushLock(_sculpt->getBrushMutex());
-    std::unique_lock<std::mutex> tipsLock(_tips_mutex);
     _sculpt->clearBrushes();
+    _sculpt->publishBrushes();
     _tips.clear();
+    _published_tips.write(_tips);
     _dphi.value = 0.0f;
     _dtheta.value = 0.0f;
     _dzoom.value = 0.0f;
     _scaleFactor.value = 1.0f;
   }
-  else if (LM_RETURN_TRACKED(listener.waitForFrame(_cur_frame, 33)))
+  else if (LM_RETURN_TRACKED(listener.waitForFrame(_cur_frame, _cur_frame_receive_time, 33)))
   {
-    std::unique_lock<std::mutex> brushLock(_sculpt->getBrushMutex());
-    std::unique_lock<std::mutex> tipsLock(_tips_mutex);
     const double time = LM_RETURN_TRACKED(Utilities::TIME_STAMP_TICKS_TO_SECS*static_cast<double>(_cur_frame.timestamp()));
     const double prevTime = LM_RETURN_TRACKED(Utilities::TIME_STAMP_TICKS_TO_SECS*static_cast<double>(_last_frame.timestamp()));
     if (LM_RETURN_TRACKED(_last_frame.isValid() && _cur_frame.isValid()) && time - prevTime > MIN_TIME_BETWEEN_FRAMES) {
@@ -62,6 +62,9 @@ bool LeapInteraction::processInteraction(LeapListener& listener, float aspect, c
       updateHandInfos(time);
       cleanUpHandInfos(time);
       interact(time);
+      // the render thread picks the new brushes and tips without waiting for the sculpting
+      _sculpt->publishBrushes();
+      _published_tips.write(_tips);
     }
     _last_frame = _cur_frame;
     return true;
@@ -92,6 +95,8 @@ void LeapInteraction::interact(double curTime)
   const Vector3 scaledSize = calcSize(_fov, _reference_distance);
   const float frameScale = _cur_frame.scaleFactor(_last_frame);
   LM_TRACK_CONST_VALUE(frameScale);
+  // the brushes are shown about motion-to-photon after the frame : extrapolate the tips that far
+  const double predictionHorizon = LM_RETURN_TRACKED(static_cast<double>(getPredictionHorizon()));
 
   if (!_cur_frame.hands().isEmpty() || !_cur_frame.pointables().isEmpty()) {
     _last_activity_time = ci::app::getElapsedSeconds();
@@ -119,7 +124,7 @@ void LeapInteraction::interact(double curTime)
     for (HandInfoMap::iterator it = _hand_infos.begin(); it != _hand_infos.end(); ++it) {
       LM_ASSERT_IDENTICAL(0x12345678);
       const int id = it->first;
-      const HandInfo& cur = it->second;
+      HandInfo& cur = it->second;
       const float normalY = LM_RETURN_TRACKED(cur.getNormalY());
       if (LM_RETURN_TRACKED(cur.getLastUpdateTime() < curTime)) {
         continue;
@@ -144,6 +149,12 @@ void LeapInteraction::interact(double curTime)
             const float strengthMult = Utilities::SmootherStep(math<float>::clamp(LM_RETURN_TRACKED(std::min(timeSinceHandOpenChange,pointable.timeVisible()))/AGE_WARMUP_TIME));
 
             Leap::Vector tip_pos = LM_RETURN_TRACKED(pointable.tipPosition());
+            if (cur.getTipId() == pointable.id()) {
+              const Vector3 predicted = cur.predictTip(predictionHorizon);
+              tip_pos = Leap::Vector(predicted.x(), predicted.y(), predicted.z());
+              _prediction_error = cur.getPredictionError();
+              _lag_error = cur.getLagError();
+            }
             Leap::Vector tip_dir = LM_RETURN_TRACKED(pointable.direction());
             Leap::Vector tip_vel = LM_RETURN_TRACKED(pointable.tipVelocity());
 
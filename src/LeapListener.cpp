@@ -3,10 +3,16 @@
 #include "cinder/app/AppBasic.h"
 #include <boost/date_time.hpp>
 #include <iostream>
+#include <algorithm>
 
 using namespace ci;
 
-LeapListener::LeapListener() : _is_connected(false), _last_frame_time(0.0) { }
+LeapListener::LeapListener() : _is_connected(false), _last_frame_time(0.0), _max_frames_behind(MAX_FRAMES_BEHIND),
+  _consumer_waiting(0), _synthetic_running(false) { }
+
+LeapListener::~LeapListener() {
+  stopSyntheticFrames();
+}
 
 void LeapListener::onInit(const Leap::Controller& controller) {
   std::cout << "Initialized" << std::endl;
@@ -23,34 +29,82 @@ void LeapListener::onDisconnect(const Leap::Controller& controller) {
 }
 
 void LeapListener::onFrame(const Leap::Controller& controller) {
-  static const int MAX_FRAME_QUEUE_SIZE = 3; // max number of frames we can be "behind"
-  std::lock_guard<std::mutex> lock(_mutex);
-  if (!isConnected()) {
-    _frameQueue.clear();
-    _is_connected = true;
+  pushFrame(controller.frame());
+}
+
+void LeapListener::pushFrame(const Leap::Frame& _Frame) {
+  // stale frames left from before a reconnection are skipped by the consumer (see _max_frames_behind)
+  _is_connected = true;
+  _last_frame_time = ci::app::getElapsedSeconds();
+  ReceivedFrame received;
+  received.frame = _Frame;
+  received.time = _last_frame_time;
+  _frames.push(received);
+  // only take the lock when the mesh thread is actually sleeping
+  LockFree::fence();
+  if (LockFree::loadAcquire(_consumer_waiting)) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _condition.notify_all();
   }
-  _frameQueue.push_back(controller.frame());
-  if (_frameQueue.size() > MAX_FRAME_QUEUE_SIZE) {
-    _frameQueue.pop_front();
+}
+
+bool LeapListener::waitForFrame(Leap::Frame& _Frame, double& _ReceiveTime, int _MillisecondsTimeout) {
+  ReceivedFrame received;
+  if (!_frames.pop(received, _max_frames_behind)) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    LockFree::storeRelease(_consumer_waiting, 1);
+    LockFree::fence();
+    if (_frames.empty()) {
+      timedWait(lock, _condition, _MillisecondsTimeout);
+    }
+    LockFree::storeRelease(_consumer_waiting, 0);
+    if (!_frames.pop(received, _max_frames_behind)) {
+      return false;
+    }
   }
-  _last_frame_time = ci::app::getElapsedSeconds();
-  _condition.notify_all();
+  _Frame = received.frame;
+  _ReceiveTime = received.time;
+  return true;
 }
 
-bool LeapListener::waitForFrame(Leap::Frame& _Frame, int _MillisecondsTimeout) {
-  std::unique_lock<std::mutex> lock(_mutex);
-#if _WIN32
-  if (_frameQueue.empty() && !_condition.timed_wait(lock, boost::posix_time::milliseconds(_MillisecondsTimeout))) {
-    return false;
+void LeapListener::setLatestWins(bool _LatestWins) {
+  _max_frames_behind = _LatestWins ? 1 : MAX_FRAMES_BEHIND;
+}
+
+void LeapListener::startSyntheticFrames(double _Frequency) {
+  stopSyntheticFrames();
+  _synthetic_running = true;
+  _synthetic_thread = std::thread(&LeapListener::runSyntheticFrames, this, _Frequency);
+}
+
+void LeapListener::stopSyntheticFrames() {
+  {
+    std::lock_guard<std::mutex> lock(_synthetic_mutex);
+    _synthetic_running = false;
+    _synthetic_condition.notify_all();
   }
-#else
-  if (_frameQueue.empty() && _condition.wait_for(lock, std::chrono::milliseconds(_MillisecondsTimeout)) == std::cv_status::timeout) {
-    return false;
+  if (_synthetic_thread.joinable()) {
+    _synthetic_thread.join();
+  }
+}
+
+void LeapListener::runSyntheticFrames(double _Frequency) {
+  // empty frames at the rate of the device : measures the latency of the pipeline itself
+  const int period = std::max(1, static_cast<int>(1000.0/_Frequency));
+  std::unique_lock<std::mutex> lock(_synthetic_mutex);
+  while (_synthetic_running) {
+    if (!timedWait(lock, _synthetic_condition, period)) {
+      pushFrame(Leap::Frame::invalid());
+    }
   }
+}
+
+bool LeapListener::timedWait(std::unique_lock<std::mutex>& _Lock, std::condition_variable& _Condition, int _MillisecondsTimeout) {
+#if _WIN32
+  return _Condition.timed_wait(_Lock, boost::posix_time::milliseconds(_MillisecondsTimeout));
+#else
+  return _Condition.wait_for(_Lock, std::chrono::milliseconds(_MillisecondsTimeout)) != std::cv_status::timeout;
 #endif
-  _Frame = _frameQueue.front();
-  _frameQueue.pop_front();
-  return true;
 }
 
 bool LeapListener::isConnected() const {
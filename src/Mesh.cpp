@@ -1,6 +1,8 @@
 #include "StdAfx.h"
 #include "Mesh.h"
 #include "Octree.h"
+#include "MeshSnapshot.h"
+#include "LockFree.h"
 #include <iostream>
 
 // For meshVerify
@@ -8,8 +10,8 @@
 #include <map>
 
 const float Mesh::globalScale_ = 500.f;
-int Mesh::stateMask_ = 1;
-const int undoLimit_ = 20;
+const size_t Mesh::defaultUndoFileCapacity_ = 512*1024*1024;
+const size_t defaultUndoBudget = 64*1024*1024;
 
 /** Helper functions */
 inline static lmReal TriArea(const Mesh* mesh, const Triangle& tri) {
@@ -22,12 +24,14 @@ inline static lmReal TriArea(const Mesh* mesh, const Triangle& tri) {
 }
 
 /** Constructor */
-Mesh::Mesh() : center_(Vector3::Zero()), scale_(1), lastUpdateTime_(0.0), translation_(Vector3::Zero()),
-  octree_(0), rotationMatrix_(Matrix4x4::Identity()), beginIte_(false), verticesBuffer_(GL_ARRAY_BUFFER),
-  normalsBuffer_(GL_ARRAY_BUFFER), indicesBuffer_(GL_ELEMENT_ARRAY_BUFFER), colorsBuffer_(GL_ARRAY_BUFFER),
-  rotationOrigin_(Vector3::Zero()), rotationAxis_(Vector3::UnitY()), rotationVelocity_(0.0f), curRotation_(0.0f),
-  verticesBufferCount_(0), indicesBufferCount_(0), reallocateVerticesBuffer_(true), reallocateIndicesBuffer_(true),
-  undoPending_(false), redoPending_(false), nbGPUTriangles(0), pendingGPUTriangles(0), pendingGPUVertices(0)
+Mesh::Mesh() : triJournal_(), vertJournal_(), verticesBufferCount_(0), indicesBufferCount_(0),
+  verticesBuffer_(GL_ARRAY_BUFFER), normalsBuffer_(GL_ARRAY_BUFFER), indicesBuffer_(GL_ELEMENT_ARRAY_BUFFER),
+  colorsBuffer_(GL_ARRAY_BUFFER), snapshotOctree_(false), center_(Vector3::Zero()), scale_(1), octree_(0),
+  rotationMatrix_(Matrix4x4::Identity()), translation_(Vector3::Zero()), deferUpdates_(false),
+  nbFlushedTris_(0), nbFlushedVerts_(0), recycling_(false), undoPending_(false), redoPending_(false),
+  lastUpdateTime_(0.0), beginIte_(false), undoBudget_(defaultUndoBudget), stateFile_(), spilling_(0),
+  stateTasks_("undo"), rotationOrigin_(Vector3::Zero()), rotationAxis_(Vector3::UnitY()),
+  rotationVelocity_(0.0f), curRotation_(0.0f)
 {
   rotationVelocitySmoother_.Update(0.0f, 0.0, 0.5f);
 }
@@ -35,6 +39,7 @@ Mesh::Mesh() : center_(Vector3::Zero()), scale_(1), lastUpdateTime_(0.0), transl
 /** Destructor */
 Mesh::~Mesh()
 {
+  stateTasks_.wait();
   delete octree_;
 }
 
@@ -43,7 +48,15 @@ TriangleVector& Mesh::getTriangles() { return triangles_; }
 const TriangleVector& Mesh::getTriangles() const { return triangles_; }
 VertexVector& Mesh::getVertices() { return vertices_; }
 const VertexVector& Mesh::getVertices() const { return vertices_; }
-std::vector<Octree*>& Mesh::getLeavesUpdate() { return leavesUpdate_; }
+Vector3Vector& Mesh::getMaterials() { return materials_; }
+const Vector3Vector& Mesh::getMaterials() const { return materials_; }
+Adjacency& Mesh::getVerticesTriangles() { return vertTris_; }
+const Adjacency& Mesh::getVerticesTriangles() const { return vertTris_; }
+Adjacency& Mesh::getVerticesRing() { return vertRings_; }
+const Adjacency& Mesh::getVerticesRing() const { return vertRings_; }
+std::vector<int>& Mesh::getLeavesUpdate() { return leavesUpdate_; }
+Visitation& Mesh::getSelection() { return selection_; }
+std::vector<Aabb>& Mesh::getDirtyAabbs() { return dirtyAabbs_; }
 Triangle& Mesh::getTriangle(int i) { return triangles_[i]; }
 const Triangle& Mesh::getTriangle(int i) const { return triangles_[i]; }
 Vertex& Mesh::getVertex(int i) { return vertices_[i]; }
@@ -85,29 +98,38 @@ float Mesh::getRotationVelocity_notSmoothed() const { return rotationVelocity_;
 /** Return all the triangles linked to a group of vertices */
 void Mesh::getTrianglesFromVertices(const std::vector<int> &iVerts, std::vector<int>& triangles)
 {
-  ++Triangle::tagMask_;
+  getTrianglesFromVertices(iVerts, triangles, triVisitation_);
+}
+
+/** Return all the triangles linked to a group of vertices (the visitation is owned by the caller) */
+void Mesh::getTrianglesFromVertices(const std::vector<int> &iVerts, std::vector<int>& triangles, Visitation &visitation) const
+{
+  visitation.start(getNbTriangles());
   triangles.clear();
   const int nbVerts = iVerts.size();
   for(int i=0;i<nbVerts;++i)
   {
-    const std::vector<int> &iTris = vertices_[iVerts[i]].tIndices_;
+    Adjacency::Range iTris = vertTris_[iVerts[i]];
     int nbTris = iTris.size();
     for(int j=0;j<nbTris;++j)
     {
       const int iTri = iTris[j];
-      if(triangles_[iTri].tagFlag_!=Triangle::tagMask_)
-      {
+      if(visitation.visit(iTri))
         triangles.push_back(iTri);
-        triangles_[iTri].tagFlag_=Triangle::tagMask_;
-      }
     }
   }
 }
 
-/** Return all the triangles linked to a group of vertices */
+/** Return all the vertices of a group of triangles */
 void Mesh::getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<int>& vertices)
 {
-  ++Vertex::tagMask_;
+  getVerticesFromTriangles(iTris, vertices, vertVisitation_);
+}
+
+/** Return all the vertices of a group of triangles (the visitation is owned by the caller) */
+void Mesh::getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<int>& vertices, Visitation &visitation) const
+{
+  visitation.start(getNbVertices());
   vertices.clear();
   const int nbTris = iTris.size();
   for(int i=0;i<nbTris;++i)
@@ -115,10 +137,8 @@ void Mesh::getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<i
     const Triangle &t=triangles_[iTris[i]];
     for (int j=0; j<3; j++) {
       const int iVer = t.vIndices_[j];
-      if (vertices_[iVer].tagFlag_ != Vertex::tagMask_) {
+      if (visitation.visit(iVer))
         vertices.push_back(iVer);
-        vertices_[iVer].tagFlag_ = Vertex::tagMask_;
-      }
     }
   }
 }
@@ -126,10 +146,10 @@ void Mesh::getVerticesFromTriangles(const std::vector<int> &iTris, std::vector<i
 /** Get more triangles (n-ring) */
 void Mesh::expandTriangles(std::vector<int> &iTris, int nRing)
 {
-  ++Triangle::tagMask_;
+  triVisitation_.start(getNbTriangles());
   int nbTris = iTris.size();
   for(int i=0;i<nbTris;++i)
-    triangles_[iTris[i]].tagFlag_ = Triangle::tagMask_;
+    triVisitation_.visit(iTris[i]);
   int iBegin = 0;
   while(nRing)
   {
@@ -137,38 +157,26 @@ void Mesh::expandTriangles(std::vector<int> &iTris, int nRing)
     for(int i=iBegin;i<nbTris;++i)
     {
       Triangle &t=triangles_[iTris[i]];
-      std::vector<int> &iTris1 = vertices_[t.vIndices_[0]].tIndices_;
-      std::vector<int> &iTris2 = vertices_[t.vIndices_[1]].tIndices_;
-      std::vector<int> &iTris3 = vertices_[t.vIndices_[2]].tIndices_;
+      Adjacency::Range iTris1 = vertTris_[t.vIndices_[0]];
+      Adjacency::Range iTris2 = vertTris_[t.vIndices_[1]];
+      Adjacency::Range iTris3 = vertTris_[t.vIndices_[2]];
       int nbTris1 = iTris1.size();
       int nbTris2 = iTris2.size();
       int nbTris3 = iTris3.size();
       for(int j=0;j<nbTris1;++j)
       {
-        Triangle &t = triangles_[iTris1[j]];
-        if(t.tagFlag_!=Triangle::tagMask_)
-        {
-          t.tagFlag_ = Triangle::tagMask_;
+        if(triVisitation_.visit(iTris1[j]))
           iTris.push_back(iTris1[j]);
-        }
       }
       for(int j=0;j<nbTris2;++j)
       {
-        Triangle &t = triangles_[iTris2[j]];
-        if(t.tagFlag_!=Triangle::tagMask_)
-        {
-          t.tagFlag_ = Triangle::tagMask_;
+        if(triVisitation_.visit(iTris2[j]))
           iTris.push_back(iTris2[j]);
-        }
       }
       for(int j=0;j<nbTris3;++j)
       {
-        Triangle &t = triangles_[iTris3[j]];
-        if(t.tagFlag_!=Triangle::tagMask_)
-        {
-          t.tagFlag_ = Triangle::tagMask_;
+        if(triVisitation_.visit(iTris3[j]))
           iTris.push_back(iTris3[j]);
-        }
       }
     }
     iBegin = nbTris;
@@ -179,26 +187,22 @@ void Mesh::expandTriangles(std::vector<int> &iTris, int nRing)
 /** Get more vertices (n-ring) */
 void Mesh::expandVertices(std::vector<int> &iVerts, int nRing)
 {
-  ++Vertex::tagMask_;
+  vertVisitation_.start(getNbVertices());
   int nbVerts = iVerts.size();
   for(int i=0;i<nbVerts;++i)
-    vertices_[iVerts[i]].tagFlag_ = Vertex::tagMask_;
+    vertVisitation_.visit(iVerts[i]);
   int iBegin = 0;
   while(nRing)
   {
     --nRing;
     for(int i=iBegin;i<nbVerts;++i)
     {
-      std::vector<int> &ring = vertices_[iVerts[i]].ringVertices_;
+      Adjacency::Range ring = vertRings_[iVerts[i]];
       int nbRing = ring.size();
       for(int j=0;j<nbRing;++j)
       {
-        Vertex &vRing = vertices_[ring[j]];
-        if(vRing.tagFlag_!=Vertex::tagMask_)
-        {
-          vRing.tagFlag_ = Vertex::tagMask_;
+        if(vertVisitation_.visit(ring[j]))
           iVerts.push_back(ring[j]);
-        }
       }
     }
     iBegin = nbVerts;
@@ -209,9 +213,9 @@ void Mesh::expandVertices(std::vector<int> &iVerts, int nRing)
 /** Compute the vertices around a vertex */
 void Mesh::computeRingVertices(int iVert)
 {
-  ++Vertex::tagMask_;
-  std::vector<int> &iTris = vertices_[iVert].tIndices_;
-  std::vector<int> &ring = vertices_[iVert].ringVertices_;
+  vertVisitation_.start(getNbVertices());
+  Adjacency::Range iTris = vertTris_[iVert];
+  std::vector<int> &ring = queryRing_;
   ring.clear();
   int nbTris = iTris.size();
   for(int i=0;i<nbTris;++i)
@@ -220,64 +224,371 @@ void Mesh::computeRingVertices(int iVert)
     int iVer1 = t.vIndices_[0];
     int iVer2 = t.vIndices_[1];
     int iVer3 = t.vIndices_[2];
-    if(iVer1!=iVert && vertices_[iVer1].tagFlag_!=Vertex::tagMask_)
-    {
+    if(iVer1!=iVert && vertVisitation_.visit(iVer1))
       ring.push_back(iVer1);
-      vertices_[iVer1].tagFlag_=Vertex::tagMask_;
+    if(iVer2!=iVert && vertVisitation_.visit(iVer2))
+      ring.push_back(iVer2);
+    if(iVer3!=iVert && vertVisitation_.visit(iVer3))
+      ring.push_back(iVer3);
+  }
+  vertRings_.assign(iVert, ring);
+}
+
+/** Append a vertex with its color and empty adjacency (a new vertex doesn't need to be saved for undo) */
+int Mesh::addVertex(const Vertex &v, const Vector3 &material)
+{
+  if(!freeVerts_.empty()) //the hole was saved when its vertex was deleted
+  {
+    const int iVert = freeVerts_.back();
+    freeVerts_.pop_back();
+    vertices_[iVert] = v;
+    materials_[iVert] = material;
+    return iVert;
+  }
+  int iVert = vertices_.size();
+  vertices_.push_back(v);
+  materials_.push_back(material);
+  vertTris_.resize(iVert+1);
+  vertRings_.resize(iVert+1);
+  return iVert;
+}
+
+/** Move the last vertex into the slot iVert and shrink every stream (references to the last vertex are not updated) */
+void Mesh::removeVertex(int iVert)
+{
+  int lastPos = vertices_.size()-1;
+  if(iVert!=lastPos)
+  {
+    vertices_[iVert] = vertices_[lastPos];
+    materials_[iVert] = materials_[lastPos];
+    vertJournal_.move(iVert, lastPos);
+    vertTris_.move(iVert, lastPos);
+    vertRings_.move(iVert, lastPos);
+    if(deferUpdates_)
+      pendingVerts_.push_back(iVert);
+  }
+  vertices_.pop_back();
+  materials_.pop_back();
+  vertTris_.resize(lastPos);
+  vertRings_.resize(lastPos);
+}
+
+/** Index of the next vertex created by addVertex */
+int Mesh::getNextVertex() const
+{
+  return freeVerts_.empty() ? vertices_.size() : freeVerts_.back();
+}
+
+/** Slot for a new triangle (a hole left by a deleted triangle if there is one), the caller fills it */
+int Mesh::addTriangle()
+{
+  if(!freeTris_.empty())
+  {
+    const int iTri = freeTris_.back();
+    freeTris_.pop_back();
+    return iTri;
+  }
+  triangles_.push_back(Triangle());
+  return triangles_.size()-1;
+}
+
+/**
+* Recycling mode : the topology deletes elements by leaving a hole (a tombstone) instead of
+* moving the last element into it, which would renumber it and fix up every reference to it.
+* The holes are reused by the next new elements, the remaining ones are filled by compact
+* once the stroke is over.
+*/
+void Mesh::setRecycling(bool recycling)
+{
+  if(!recycling)
+    compact();
+  recycling_ = recycling;
+}
+
+bool Mesh::isRecycling() const { return recycling_; }
+
+/** Leave a hole in place of a triangle (already out of the octree and of the adjacency lists) */
+void Mesh::recycleTriangle(int iTri)
+{
+  pushTriangleState(iTri);
+  Triangle &t = triangles_[iTri];
+  t.tagFlag_ = -1;
+  t.vIndices_[0] = t.vIndices_[1] = t.vIndices_[2] = 0; //degenerate, nothing is drawn
+  t.leaf_ = -1;
+  t.posInLeaf_ = -1;
+  freeTris_.push_back(iTri);
+  recycledTris_.push_back(iTri);
+}
+
+/** Leave a hole in place of a vertex (no triangle uses it anymore) */
+void Mesh::recycleVertex(int iVert)
+{
+  pushVertexState(iVert);
+  vertices_[iVert].tagFlag_ = -1;
+  vertTris_.assign(iVert, 0, 0);
+  vertRings_.assign(iVert, 0, 0);
+  freeVerts_.push_back(iVert);
+}
+
+/**
+* Fill the holes left by the recycling mode with the last elements and shrink the arrays.
+* The moves are saved in the current undo state like any topology change, and the references
+* to the moved elements are fixed in parallel (each list or triangle is written by one task).
+*/
+void Mesh::compact()
+{
+  if(freeTris_.empty() && freeVerts_.empty())
+    return;
+  std::vector<int> iTrisChanged;
+  std::vector<int> iVertsMoved;
+  compactTriangles(iTrisChanged);
+  compactVertices(iVertsMoved, iTrisChanged);
+  publishSnapshot(iTrisChanged, iVertsMoved);
+}
+
+/** Move the last live triangles into the holes below the new end */
+void Mesh::compactTriangles(std::vector<int> &iTrisMoved)
+{
+  const int nbTriangles = triangles_.size();
+  const int nbTrianglesNew = nbTriangles-freeTris_.size();
+  std::vector<int> holes;
+  const int nbFree = freeTris_.size();
+  for(int i=0;i<nbFree;++i)
+  {
+    LM_ASSERT(triangles_[freeTris_[i]].leaf_==-1, "Free triangle in the octree");
+    if(freeTris_[i]<nbTrianglesNew)
+      holes.push_back(freeTris_[i]);
+  }
+  std::sort(holes.begin(), holes.end());
+  std::vector<int> moved;
+  for(int i=nbTrianglesNew;i<nbTriangles;++i)
+  {
+    if(triangles_[i].tagFlag_>=0)
+      moved.push_back(i);
+  }
+  LM_ASSERT(holes.size()==moved.size(), "Bad free triangles");
+  const int nbMoved = moved.size();
+
+  //undo-redo
+  std::vector<int> iVerts;
+  iVerts.reserve(3*nbMoved);
+  for(int i=0;i<nbMoved;++i)
+  {
+    pushTriangleState(holes[i]);
+    pushTriangleState(moved[i]);
+    const int *indices = triangles_[moved[i]].vIndices_;
+    iVerts.insert(iVerts.end(), indices, indices+3);
+  }
+  Tools::tidy(iVerts);
+  const int nbVerts = iVerts.size();
+  for(int i=0;i<nbVerts;++i)
+    pushVertexState(iVerts[i]);
+
+  std::vector<int> remap(nbTriangles-nbTrianglesNew, -1);
+  for(int i=0;i<nbMoved;++i)
+    remap[moved[i]-nbTrianglesNew] = holes[i];
+  ThreadPool::parallelFor(0, nbMoved, [&](int i) {
+    Triangle &t = triangles_[holes[i]];
+    t = triangles_[moved[i]];
+    t.id_ = holes[i];
+    octree_->renameTriangle(t, holes[i]);
+  });
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
+    const int iVert = iVerts[i];
+    Adjacency::Range iTris = vertTris_[iVert];
+    const int nbTris = iTris.size();
+    for(int j=0;j<nbTris;++j)
+    {
+      if(iTris[j]>=nbTrianglesNew)
+        vertTris_.set(iVert, j, remap[iTris[j]-nbTrianglesNew]);
     }
-    if(iVer2!=iVert && vertices_[iVer2].tagFlag_!=Vertex::tagMask_)
+  });
+  for(int i=0;i<nbMoved;++i)
+    triJournal_.move(holes[i], moved[i]);
+  triangles_.resize(nbTrianglesNew);
+  freeTris_.clear();
+  recycledTris_.clear();
+  iTrisMoved.swap(holes);
+}
+
+/** Move the last live vertices into the holes below the new end */
+void Mesh::compactVertices(std::vector<int> &iVertsMoved, std::vector<int> &iTrisChanged)
+{
+  const int nbVertices = vertices_.size();
+  const int nbVerticesNew = nbVertices-freeVerts_.size();
+  std::vector<int> holes;
+  const int nbFree = freeVerts_.size();
+  for(int i=0;i<nbFree;++i)
+  {
+    if(freeVerts_[i]<nbVerticesNew)
+      holes.push_back(freeVerts_[i]);
+  }
+  std::sort(holes.begin(), holes.end());
+  std::vector<int> moved;
+  for(int i=nbVerticesNew;i<nbVertices;++i)
+  {
+    if(vertices_[i].tagFlag_>=0)
+      moved.push_back(i);
+  }
+  LM_ASSERT(holes.size()==moved.size(), "Bad free vertices");
+  const int nbMoved = moved.size();
+
+  //undo-redo
+  std::vector<int> iTris;
+  std::vector<int> iRing;
+  for(int i=0;i<nbMoved;++i)
+  {
+    pushVertexState(holes[i]);
+    pushVertexState(moved[i]);
+    Adjacency::Range tris = vertTris_[moved[i]];
+    Adjacency::Range ring = vertRings_[moved[i]];
+    iTris.insert(iTris.end(), tris.begin(), tris.end());
+    iRing.insert(iRing.end(), ring.begin(), ring.end());
+  }
+  Tools::tidy(iTris);
+  Tools::tidy(iRing);
+  pushState(iTris, iRing);
+
+  std::vector<int> remap(nbVertices-nbVerticesNew, -1);
+  for(int i=0;i<nbMoved;++i)
+    remap[moved[i]-nbVerticesNew] = holes[i];
+  const int nbTris = iTris.size();
+  ThreadPool::parallelFor(0, nbTris, [&](int i) {
+    int *indices = triangles_[iTris[i]].vIndices_;
+    for(int j=0;j<3;++j)
     {
-      ring.push_back(iVer2);
-      vertices_[iVer2].tagFlag_=Vertex::tagMask_;
+      if(indices[j]>=nbVerticesNew)
+        indices[j] = remap[indices[j]-nbVerticesNew];
     }
-    if(iVer3!=iVert && vertices_[iVer3].tagFlag_!=Vertex::tagMask_)
+  });
+  const int nbRings = iRing.size();
+  ThreadPool::parallelFor(0, nbRings, [&](int i) {
+    const int iVert = iRing[i];
+    Adjacency::Range ring = vertRings_[iVert];
+    const int nbRing = ring.size();
+    for(int j=0;j<nbRing;++j)
     {
-      ring.push_back(iVer3);
-      vertices_[iVer3].tagFlag_=Vertex::tagMask_;
+      if(ring[j]>=nbVerticesNew)
+        vertRings_.set(iVert, j, remap[ring[j]-nbVerticesNew]);
     }
+  });
+  for(int i=0;i<nbMoved;++i)
+  {
+    vertices_[holes[i]] = vertices_[moved[i]];
+    materials_[holes[i]] = materials_[moved[i]];
+    vertTris_.move(holes[i], moved[i]);
+    vertRings_.move(holes[i], moved[i]);
+    vertJournal_.move(holes[i], moved[i]);
   }
+  vertices_.resize(nbVerticesNew);
+  materials_.resize(nbVerticesNew);
+  vertTris_.resize(nbVerticesNew);
+  vertRings_.resize(nbVerticesNew);
+  freeVerts_.clear();
+  iTrisChanged.insert(iTrisChanged.end(), iTris.begin(), iTris.end());
+  iVertsMoved.swap(holes);
 }
 
 void Mesh::getVerticesInsideSphere(const Vector3& point, float radiusWorldSquared, std::vector<int>& result) {
   VertexVector &vertices = getVertices();
-  std::vector<Octree*> &leavesHit = getLeavesUpdate();
+  std::vector<int> &leavesHit = getLeavesUpdate();
   queryTriangles_.clear();
   getOctree()->intersectSphere(point,radiusWorldSquared,leavesHit,queryTriangles_);
   queryVertices_.clear();
   getVerticesFromTriangles(queryTriangles_, queryVertices_);
   int nbVerts = queryVertices_.size();
-  ++Vertex::sculptMask_;
+  selection_.start(getNbVertices());
   for (int i=0;i<nbVerts;++i)
   {
     Vertex &v=vertices[queryVertices_[i]];
     const float distSquared = (v-point).squaredNorm();
     if(distSquared<radiusWorldSquared)
     {
-      v.sculptFlag_ = Vertex::sculptMask_;
+      selection_.visit(queryVertices_[i]);
       result.push_back(queryVertices_[i]);
     }
   }
 }
 
-void Mesh::getVerticesInsideBrush(const Brush& brush, std::vector<int>& result) {
+/** Vertices inside a brush, the leaves of the previous query of the brush are reused if a cache is given */
+void Mesh::getVerticesInsideBrush(const Brush& brush, std::vector<int>& result, SphereQueryCache* cache) {
   VertexVector &vertices = getVertices();
-  std::vector<Octree*> &leavesHit = getLeavesUpdate();
+  std::vector<int> &leavesHit = getLeavesUpdate();
   queryTriangles_.clear();
-  getOctree()->intersectSphere(brush.boundingSphereCenter(),brush.boundingSphereRadiusSq(),leavesHit, queryTriangles_);
+  if (cache)
+    getOctree()->intersectSphere(*cache, brush.boundingSphereCenter(),brush.boundingSphereRadiusSq(),leavesHit, queryTriangles_);
+  else
+    getOctree()->intersectSphere(brush.boundingSphereCenter(),brush.boundingSphereRadiusSq(),leavesHit, queryTriangles_);
   queryVertices_.clear();
   getVerticesFromTriangles(queryTriangles_, queryVertices_);
   int nbVerts = queryVertices_.size();
-  ++Vertex::sculptMask_;
+  selection_.start(getNbVertices());
   for (int i=0;i<nbVerts;++i)
   {
     Vertex &v=vertices[queryVertices_[i]];
     if (brush.contains(v)) {
-      v.sculptFlag_ = Vertex::sculptMask_;
+      selection_.visit(queryVertices_[i]);
       result.push_back(queryVertices_[i]);
     }
   }
 }
 
+/**
+* Vertices swept by a moving brush, given as successive samples of the same brush.
+* The path of the brush is the polyline joining the samples, so the swept volume is a
+* chain of capsules : one octree query gathers every vertex touched during the motion.
+* times receives, for each vertex, the (fractional) sample index of closest approach.
+*/
+void Mesh::getVerticesInsideSweptBrush(const BrushVector& samples, std::vector<int>& result, std::vector<float>& times)
+{
+  const int nbSamples = samples.size();
+  if(nbSamples==0)
+    return;
+  const float radius = samples[0].boundingSphereRadius();
+  const float radiusSquared = radius*radius;
+  Aabb aabbPath(samples[0].boundingSphereCenter(),samples[0].boundingSphereCenter());
+  for (int i=1;i<nbSamples;++i)
+    aabbPath.expand(samples[i].boundingSphereCenter());
+  const Vector3 center = aabbPath.getCenter();
+  float radiusQuery = 0.0f;
+  for (int i=0;i<nbSamples;++i)
+    radiusQuery = std::max(radiusQuery, (samples[i].boundingSphereCenter()-center).norm());
+  radiusQuery += radius;
+
+  VertexVector &vertices = getVertices();
+  std::vector<int> &leavesHit = getLeavesUpdate();
+  queryTriangles_.clear();
+  getOctree()->intersectSphere(center,radiusQuery*radiusQuery,leavesHit,queryTriangles_);
+  queryVertices_.clear();
+  getVerticesFromTriangles(queryTriangles_, queryVertices_);
+  int nbVerts = queryVertices_.size();
+  for (int i=0;i<nbVerts;++i)
+  {
+    const Vertex &v=vertices[queryVertices_[i]];
+    float distMin = (v-samples[0].boundingSphereCenter()).squaredNorm();
+    float timeMin = 0.0f;
+    for (int j=1;j<nbSamples;++j)
+    {
+      const Vector3 a = samples[j-1].boundingSphereCenter();
+      const Vector3 ab = samples[j].boundingSphereCenter()-a;
+      const float lenSquared = ab.squaredNorm();
+      float t = lenSquared>0.0f ? (v-a).dot(ab)/lenSquared : 0.0f;
+      t = std::min(std::max(t,0.0f),1.0f);
+      const float dist = (v-(a+t*ab)).squaredNorm();
+      if(dist<distMin)
+      {
+        distMin = dist;
+        timeMin = (j-1)+t;
+      }
+    }
+    if(distMin<radiusSquared)
+    {
+      result.push_back(queryVertices_[i]);
+      times.push_back(timeMin);
+    }
+  }
+}
+
 /** Return center of a triangle */
 Vector3 Mesh::getTriangleCenter(int iTri) const
 {
@@ -292,6 +603,7 @@ void Mesh::moveTo(const Vector3& destination)
 }
 
 void Mesh::draw(GLint vertex, GLint normal, GLint color) {
+  const int nbTriangles = gpuSnapshot_ ? gpuSnapshot_->getNbTriangles() : 0;
   verticesBuffer_.bind();
   glEnableVertexAttribArray(vertex);
   GLBuffer::checkError("Draw verts 1");
@@ -311,7 +623,7 @@ void Mesh::draw(GLint vertex, GLint normal, GLint color) {
   GLBuffer::checkError("Draw verts 6");
 
   indicesBuffer_.bind();
-  glDrawElements(GL_TRIANGLES, nbGPUTriangles*3, GL_UNSIGNED_INT, 0);
+  glDrawElements(GL_TRIANGLES, nbTriangles*3, GL_UNSIGNED_INT, 0);
   indicesBuffer_.release();
   glDisableVertexAttribArray(vertex);
   glDisableVertexAttribArray(normal);
@@ -323,6 +635,7 @@ void Mesh::draw(GLint vertex, GLint normal, GLint color) {
 }
 
 void Mesh::drawVerticesOnly(GLint vertex) {
+  const int nbTriangles = gpuSnapshot_ ? gpuSnapshot_->getNbTriangles() : 0;
   verticesBuffer_.bind();
   glEnableVertexAttribArray(vertex);
   GLBuffer::checkError("Draw verts only 1");
@@ -330,7 +643,7 @@ void Mesh::drawVerticesOnly(GLint vertex) {
   GLBuffer::checkError("Draw verts only 2");
 
   indicesBuffer_.bind();
-  glDrawElements(GL_TRIANGLES, nbGPUTriangles*3, GL_UNSIGNED_INT, 0);
+  glDrawElements(GL_TRIANGLES, nbTriangles*3, GL_UNSIGNED_INT, 0);
   indicesBuffer_.release();
   glDisableVertexAttribArray(vertex);
 
@@ -338,14 +651,16 @@ void Mesh::drawVerticesOnly(GLint vertex) {
 }
 
 void Mesh::drawOctree() const {
+  if (!gpuSnapshot_) {
+    return;
+  }
   glPushMatrix();
   glMultMatrixf(getTransformation().data());
-  octree_->draw();
+  gpuSnapshot_->drawOctree();
   glPopMatrix();
 }
 
-void Mesh::initVertexVBO() {
-  const int nbVertices = pendingGPUVertices;
+void Mesh::initVertexVBO(int nbVertices) {
   verticesBufferCount_ = 2*nbVertices;
   const int verticesBytes = verticesBufferCount_*3*sizeof(GLfloat);
 
@@ -372,12 +687,9 @@ void Mesh::initVertexVBO() {
   colorsBuffer_.bind();
   colorsBuffer_.allocate(0, verticesBytes, GL_DYNAMIC_DRAW);
   colorsBuffer_.release();
-
-  reallocateVerticesBuffer_ = false;
 }
 
-void Mesh::initIndexVBO() {
-  const int nbTriangles = pendingGPUTriangles;
+void Mesh::initIndexVBO(int nbTriangles) {
   indicesBufferCount_ = 2*nbTriangles;
   const int indicesBytes = indicesBufferCount_*3*sizeof(GLuint);
 
@@ -388,36 +700,6 @@ void Mesh::initIndexVBO() {
   indicesBuffer_.bind();
   indicesBuffer_.allocate(0, indicesBytes, GL_DYNAMIC_DRAW);
   indicesBuffer_.release();
-
-  reallocateIndicesBuffer_ = false;
-}
-
-void Mesh::reinitVerticesBuffer() {
-  vertexUpdates_.clear();
-
-  const int nbVertices = getNbVertices();
-  for (int i=0; i<nbVertices; i++) {
-    VertexUpdate update;
-    update.idx = vertices_[i].id_;
-    update.color = vertices_[i].material_;
-    update.normal = vertices_[i].normal_;
-    update.pos = vertices_[i];
-    vertexUpdates_.push_back(update);
-  }
-}
-
-void Mesh::reinitIndicesBuffer() {
-  indexUpdates_.clear();
-
-  const int nbTriangles = getNbTriangles();
-  for (int i=0; i<nbTriangles; i++) {
-    IndexUpdate update;
-    update.idx = triangles_[i].id_;
-    update.indices[0] = triangles_[i].vIndices_[0];
-    update.indices[1] = triangles_[i].vIndices_[1];
-    update.indices[2] = triangles_[i].vIndices_[2];
-    indexUpdates_.push_back(update);
-  }
 }
 
 /** Initialize the mesh information : center, octree, scale ... */
@@ -429,6 +711,24 @@ bool Mesh::initMesh()
   if (vertices_.size() == 0) {
     return false;
   }
+  std::vector<int> valences(nbVertices, 0);
+  for(int i=0;i<nbTriangles;++i)
+  {
+    const Triangle &t = triangles_[i];
+    ++valences[t.vIndices_[0]];
+    ++valences[t.vIndices_[1]];
+    ++valences[t.vIndices_[2]];
+  }
+  materials_.resize(nbVertices, Vector3::Ones());
+  vertTris_.init(valences);
+  vertRings_.init(valences);
+  for(int i=0;i<nbTriangles;++i)
+  {
+    const Triangle &t = triangles_[i];
+    vertTris_.add(t.vIndices_[0], i);
+    vertTris_.add(t.vIndices_[1], i);
+    vertTris_.add(t.vIndices_[2], i);
+  }
   aabb.min_ = vertices_[0];
   aabb.max_ = vertices_[0];
   for(int i=0;i<nbVertices;++i)
@@ -441,38 +741,36 @@ bool Mesh::initMesh()
   center_ = Vector3::Zero();
   float diag = aabb.max_.cwiseAbs().cwiseMax(aabb.min_.cwiseAbs()).norm();
   scale_ = Mesh::globalScale_/diag;
-#pragma omp parallel for
-  for(int i=0;i<nbVertices;++i)
+  ThreadPool::parallelFor(0, nbVertices, [&](int i) {
     vertices_[i] = scale_*(vertices_[i] - center_);
+  });
   aabb.min_ -= center_;
   aabb.max_ -= center_;
   //matTransform_ = Tools::scaleMatrix(scale_)*matTransform_;
   aabb.max_*=scale_;
   aabb.min_*=scale_;
   center_*=scale_;
-#pragma omp parallel for
-  for(int i=0;i<nbTriangles;++i)
-  {
+  ThreadPool::parallelFor(0, nbTriangles, [&](int i) {
     Triangle &t = triangles_[i];
     t.aabb_ = Geometry::computeTriangleAabb(vertices_[t.vIndices_[0]],vertices_[t.vIndices_[1]],vertices_[t.vIndices_[2]]);
     t.area = TriArea(this, t);
-  }
+  });
   aabb.checkFlat((aabb.max_-aabb.min_).norm()*0.02f);
   Vector3 vecShift = (aabb.max_-aabb.min_)*0.2f; //root octree bigger than minimum aabb...
   aabb.min_-=vecShift;
   aabb.max_+=vecShift;
   std::vector<int> triangles(nbTriangles);
-#pragma omp parallel for
-  for (int i=0;i<nbTriangles;++i)
+  ThreadPool::parallelFor(0, nbTriangles, [&](int i) {
     triangles[i] = i;
-  ++Triangle::tagMask_;
+  });
   if(octree_)
     delete octree_;
   octree_ = new Octree();
   octree_->build(this,triangles,aabb);
+  addDirtyAabb(octree_->getAabbLoose());
   for (int i=0;i<nbVertices;++i) {
     Vertex &ver=vertices_[i];
-    const std::vector<int> &iTri=ver.tIndices_;
+    Adjacency::Range iTri=vertTris_[i];
     int nbTri = iTri.size();
     Vector3 normal(Vector3::Zero());
     for (int j=0;j<nbTri;++j) {
@@ -491,137 +789,209 @@ bool Mesh::initMesh()
     ver.normal_=normal;
   }
 
-  reinitIndicesBuffer();
-  reinitVerticesBuffer();
-  reallocateVerticesBuffer_ = true;
-  reallocateIndicesBuffer_ = true;
-  pendingGPUTriangles = getNbTriangles();
-  pendingGPUVertices = getNbVertices();
+  publishSnapshot();
   return true;
 }
 
 /** Update geometry  */
 void Mesh::updateMesh(const std::vector<int> &iTris, const std::vector<int> &iVerts)
+{
+  if(deferUpdates_)
+  {
+    pendingTris_.insert(pendingTris_.end(), iTris.begin(), iTris.end());
+    pendingVerts_.insert(pendingVerts_.end(), iVerts.begin(), iVerts.end());
+    return;
+  }
+  updateGeometry(iTris, iVerts);
+  addDirtyTriangles(iTris);
+
+#if _WIN32
+  LM_ASSERT(_CrtCheckMemory(), "Bad heap");
+#endif
+
+  publishSnapshot(iTris, iVerts);
+}
+
+/** Normals, areas and octree placement of the modified elements */
+void Mesh::updateGeometry(const std::vector<int> &iTris, const std::vector<int> &iVerts)
 {
   computeTriangleNormals(iTris);
   computeTriangleAreas(iTris);
   updateOctree(iTris);
   computeVertexNormals(iVerts);
+}
 
-#if _WIN32
-  LM_ASSERT(_CrtCheckMemory(), "Bad heap");
-#endif
+/**
+* Defer the snapshot of updateMesh until endDeferredUpdate, so that overlapping edits
+* (several brush samples in one frame) publish the modified chunks only once.
+* Normals and octree boxes are brought up to date by flushDeferredUpdate.
+*/
+void Mesh::startDeferredUpdate()
+{
+  deferUpdates_ = true;
+  nbFlushedTris_ = 0;
+  nbFlushedVerts_ = 0;
+}
+
+/**
+* Update normals and octree placement of the elements modified since the last flush,
+* so that the next brush sample of the frame queries the current geometry
+*/
+void Mesh::flushDeferredUpdate()
+{
+  if(!deferUpdates_)
+    return;
+  if(nbFlushedTris_==(int)pendingTris_.size() && nbFlushedVerts_==(int)pendingVerts_.size())
+    return;
+  std::vector<int> iTris(pendingTris_.begin()+nbFlushedTris_, pendingTris_.end());
+  std::vector<int> iVerts(pendingVerts_.begin()+nbFlushedVerts_, pendingVerts_.end());
+  tidyPending(iTris, iVerts);
+  updateGeometry(iTris, iVerts);
+  nbFlushedTris_ = pendingTris_.size();
+  nbFlushedVerts_ = pendingVerts_.size();
+}
 
-  const int totalTris = getNbTriangles();
-  const int totalVerts = getNbVertices();
+/** Publish every element modified since startDeferredUpdate */
+void Mesh::endDeferredUpdate()
+{
+  flushDeferredUpdate();
+  deferUpdates_ = false;
+  tidyPending(pendingTris_, pendingVerts_);
+  if(!pendingTris_.empty() || !pendingVerts_.empty())
+  {
+    addDirtyTriangles(pendingTris_);
+    publishSnapshot(pendingTris_, pendingVerts_);
+  }
+  pendingTris_.clear();
+  pendingVerts_.clear();
+}
 
-  std::unique_lock<std::mutex> lock(bufferMutex_);
+/**
+* Sort the modified elements and drop the ones decimation removed from the end of the
+* arrays (or left as holes when recycling), the elements moved into their slots were
+* recorded by removeVertex and moveTriangle
+*/
+void Mesh::tidyPending(std::vector<int> &iTris, std::vector<int> &iVerts) const
+{
+  Tools::tidy(iTris);
+  Tools::tidy(iVerts);
+  iTris.erase(std::lower_bound(iTris.begin(), iTris.end(), getNbTriangles()), iTris.end());
+  iVerts.erase(std::lower_bound(iVerts.begin(), iVerts.end(), getNbVertices()), iVerts.end());
+  if(!freeTris_.empty() || !freeVerts_.empty())
+  {
+    iTris.erase(std::remove_if(iTris.begin(), iTris.end(),
+      [this](int iTri) { return triangles_[iTri].tagFlag_<0; }), iTris.end());
+    iVerts.erase(std::remove_if(iVerts.begin(), iVerts.end(),
+      [this](int iVert) { return vertices_[iVert].tagFlag_<0; }), iVerts.end());
+  }
+}
 
-  pendingGPUTriangles = totalTris;
-  pendingGPUVertices = totalVerts;
+/** Last published epoch of the mesh, it stays valid while the pointer is held */
+std::shared_ptr<const MeshSnapshot> Mesh::getSnapshot() const
+{
+  std::unique_lock<std::mutex> lock(snapshotMutex_);
+  return snapshot_;
+}
 
-  if (totalTris < indicesBufferCount_) {
-    // within storage bounds, so it's OK to only update part of the buffer
-    const int nbTris=iTris.size();
-    for (int i=0; i<nbTris; i++) {
-      IndexUpdate update;
-      update.idx = iTris[i];
-      update.indices[0] = triangles_[update.idx].vIndices_[0];
-      update.indices[1] = triangles_[update.idx].vIndices_[1];
-      update.indices[2] = triangles_[update.idx].vIndices_[2];
-      indexUpdates_.push_back(update);
-    }
-  } else {
-    // not enough space, reallocate
-    reinitIndicesBuffer();
-    reallocateIndicesBuffer_ = true;
-  }
-
-  if (totalVerts < verticesBufferCount_) {
-    // within storage bounds, so it's OK to only update part of the buffer
-    const int nbVerts=iVerts.size();
-    for (int i=0; i<nbVerts; i++) {
-      VertexUpdate update;
-      update.idx = iVerts[i];
-      update.color = vertices_[update.idx].material_;
-      update.normal = vertices_[update.idx].normal_;
-      update.pos = vertices_[update.idx];
-      vertexUpdates_.push_back(update);
-    }
-  } else {
-    // not enough space, reallocate
-    reinitVerticesBuffer();
-    reallocateVerticesBuffer_ = true;
+/** Copy (or not) the octree cells in the next snapshots */
+void Mesh::setSnapshotOctree(bool snapshotOctree)
+{
+  snapshotOctree_ = snapshotOctree;
+}
+
+/** Publish a full copy of the mesh */
+void Mesh::publishSnapshot()
+{
+  const int epoch = snapshot_ ? snapshot_->getEpoch()+1 : 0;
+  std::shared_ptr<const MeshSnapshot> snapshot = std::make_shared<MeshSnapshot>(*this, epoch, snapshotOctree_);
+  recycledTris_.clear();
+  std::unique_lock<std::mutex> lock(snapshotMutex_);
+  snapshot_.swap(snapshot);
+}
+
+/**
+* Publish the next epoch of the mesh, only the chunks holding the modified triangles
+* (and the holes left since the last epoch) and vertices are copied. Only the sculpting
+* thread writes snapshot_, so it can be read here without the lock : the lock is held for
+* the swap only and readers never wait for the copy. The previous epoch is released once
+* its last reader is done.
+*/
+void Mesh::publishSnapshot(const std::vector<int> &iTris, const std::vector<int> &iVerts)
+{
+  if(!snapshot_)
+  {
+    publishSnapshot();
+    return;
+  }
+  std::shared_ptr<const MeshSnapshot> snapshot;
+  if(recycledTris_.empty())
+    snapshot = std::make_shared<MeshSnapshot>(*snapshot_, *this, iTris, iVerts, snapshotOctree_);
+  else
+  {
+    recycledTris_.insert(recycledTris_.end(), iTris.begin(), iTris.end());
+    snapshot = std::make_shared<MeshSnapshot>(*snapshot_, *this, recycledTris_, iVerts, snapshotOctree_);
+    recycledTris_.clear();
   }
+  std::unique_lock<std::mutex> lock(snapshotMutex_);
+  snapshot_.swap(snapshot);
 }
 
+/**
+* Upload the last published epoch to the GPU. Only the chunks that differ from the
+* epoch already in the buffers are sent, however many epochs were skipped meanwhile.
+*/
 void Mesh::updateGPUBuffers() {
-  std::unique_lock<std::mutex> lock(bufferMutex_);
-
-  if (reallocateIndicesBuffer_) {
-    initIndexVBO();
+  std::shared_ptr<const MeshSnapshot> snapshot = getSnapshot();
+  if (!snapshot || snapshot == gpuSnapshot_) {
+    return;
   }
+  const MeshSnapshot* previous = gpuSnapshot_.get();
 
-  const int nbTris = indexUpdates_.size();
-  if (nbTris > 0) {
-    GLuint* indicesArray;
-    indicesBuffer_.bind(); indicesArray = (GLuint*)indicesBuffer_.map(GL_WRITE_ONLY); indicesBuffer_.release();
-    if (indicesArray == nullptr)
-    {
-      initIndexVBO();
-      indicesBuffer_.bind(); indicesArray = (GLuint*)indicesBuffer_.map(GL_WRITE_ONLY); indicesBuffer_.release();
-    }
-    for (int i=0; i<nbTris; i++) {
-      const IndexUpdate& cur = indexUpdates_[i];
-      const int j = cur.idx;
-      indicesArray[j*3] = cur.indices[0];
-      indicesArray[j*3+1] = cur.indices[1];
-      indicesArray[j*3+2] = cur.indices[2];
+  bool allIndices = !previous;
+  if (snapshot->getNbTriangles() >= indicesBufferCount_) {
+    initIndexVBO(snapshot->getNbTriangles());
+    allIndices = true;
+  }
+  const int nbIndexChunks = snapshot->getNbIndexChunks();
+  const int nbPreviousIndexChunks = previous ? previous->getNbIndexChunks() : 0;
+  indicesBuffer_.bind();
+  for (int i=0; i<nbIndexChunks; i++) {
+    const MeshSnapshot::IndexChunkPtr& chunk = snapshot->getIndexChunk(i);
+    if (allIndices || i >= nbPreviousIndexChunks || chunk != previous->getIndexChunk(i)) {
+      const int offset = i*MeshSnapshot::chunkSize_*3*sizeof(GLuint);
+      indicesBuffer_.update(&chunk->indices_[0], offset, chunk->indices_.size()*sizeof(GLuint));
     }
-    indexUpdates_.clear();
-    indicesBuffer_.bind(); indicesBuffer_.unmap(); indicesBuffer_.release();
-  }
-
-  nbGPUTriangles = pendingGPUTriangles;
-
-  if (reallocateVerticesBuffer_) {
-    initVertexVBO();
-  }
-
-  const int nbVerts = vertexUpdates_.size();
-  if (nbVerts > 0) {
-    GLfloat* verticesArray;
-    GLfloat* normalsArray;
-    GLfloat* colorsArray;
-    verticesBuffer_.bind(); verticesArray = (GLfloat*)verticesBuffer_.map(GL_WRITE_ONLY); verticesBuffer_.release();
-    normalsBuffer_.bind(); normalsArray = (GLfloat*)normalsBuffer_.map(GL_WRITE_ONLY); normalsBuffer_.release();
-    colorsBuffer_.bind(); colorsArray = (GLfloat*)colorsBuffer_.map(GL_WRITE_ONLY); colorsBuffer_.release();
-    for (int i=0; i<nbVerts; i++) {
-      const VertexUpdate& cur = vertexUpdates_[i];
-      const int j = cur.idx;
-      verticesArray[j*3] = cur.pos.x();
-      verticesArray[j*3+1] = cur.pos.y();
-      verticesArray[j*3+2] = cur.pos.z();
-      normalsArray[j*3] = cur.normal.x();
-      normalsArray[j*3+1] = cur.normal.y();
-      normalsArray[j*3+2] = cur.normal.z();
-      colorsArray[j*3] = cur.color.x();
-      colorsArray[j*3+1] = cur.color.y();
-      colorsArray[j*3+2] = cur.color.z();
+  }
+  indicesBuffer_.release();
+
+  bool allVertices = !previous;
+  if (snapshot->getNbVertices() >= verticesBufferCount_) {
+    initVertexVBO(snapshot->getNbVertices());
+    allVertices = true;
+  }
+  const int nbVertexChunks = snapshot->getNbVertexChunks();
+  const int nbPreviousVertexChunks = previous ? previous->getNbVertexChunks() : 0;
+  for (int i=0; i<nbVertexChunks; i++) {
+    const MeshSnapshot::VertexChunkPtr& chunk = snapshot->getVertexChunk(i);
+    if (allVertices || i >= nbPreviousVertexChunks || chunk != previous->getVertexChunk(i)) {
+      const int offset = i*MeshSnapshot::chunkSize_*3*sizeof(GLfloat);
+      const int bytes = chunk->positions_.size()*sizeof(GLfloat);
+      verticesBuffer_.bind(); verticesBuffer_.update(&chunk->positions_[0], offset, bytes); verticesBuffer_.release();
+      normalsBuffer_.bind(); normalsBuffer_.update(&chunk->normals_[0], offset, bytes); normalsBuffer_.release();
+      colorsBuffer_.bind(); colorsBuffer_.update(&chunk->colors_[0], offset, bytes); colorsBuffer_.release();
     }
-    vertexUpdates_.clear();
-    verticesBuffer_.bind(); verticesBuffer_.unmap(); verticesBuffer_.release();
-    normalsBuffer_.bind(); normalsBuffer_.unmap(); normalsBuffer_.release();
-    colorsBuffer_.bind(); colorsBuffer_.unmap(); colorsBuffer_.release();
   }
 
+  gpuSnapshot_ = snapshot;
 }
 
 /**
 * Update Octree
 * For each triangle we check if its position inside the octree has changed
 * if so... we mark this triangle and we remove it from its former cells
-* We push back the marked triangles into the octree
+* We push back the marked triangles into the octree (as well as the triangles
+* that are not in the octree yet, leaf_ is -1)
+* The leaves losing or receiving triangles are checked by checkLeavesUpdate
 */
 void Mesh::updateOctree(const std::vector<int> &iTris)
 {
@@ -630,23 +1000,16 @@ void Mesh::updateOctree(const std::vector<int> &iTris)
   for (int i=0;i<nbTris;++i) //recompute position inside the octree
   {
     Triangle &t=triangles_[iTris[i]];
-    Octree *leaf=t.leaf_;
-    if(!leaf->getAabbSplit().pointInside(t.aabb_.getCenter()))
+    if(t.leaf_==-1)
+      trisToMove.push_back(iTris[i]);
+    else if(!octree_->getAabbSplit(t.leaf_).pointInside(t.aabb_.getCenter()))
     {
       trisToMove.push_back(iTris[i]);
-      std::vector<int> &trisLeaf = leaf->getTriangles();
-      if(trisLeaf.size()>0)
-      {
-        int iTriLast = trisLeaf.back();
-        int iPos = t.posInLeaf_;
-        trisLeaf[iPos] = iTriLast;
-        triangles_[iTriLast].posInLeaf_ = iPos;
-        trisLeaf.pop_back();
-      }
-    }
-    else if(!t.aabb_.isInside(leaf->getAabbLoose())) {
-      leaf->getAabbLoose().expand(t.aabb_);
+      leavesUpdate_.push_back(t.leaf_);
+      octree_->removeTriangle(triangles_, t);
     }
+    else
+      octree_->expandLoose(t.leaf_, t.aabb_);
   }
   int nbTrisToMove = trisToMove.size();
   for(int i=0;i<nbTrisToMove;++i) //add triangle to the octree
@@ -661,23 +1024,20 @@ void Mesh::updateOctree(const std::vector<int> &iTris)
       aabb.max_+=vecShift;
       std::vector<int> triangles;
       for (int i=0;i<getNbTriangles();++i)
-        triangles.push_back(i);
+      {
+        if(triangles_[i].tagFlag_>=0) //holes left by recycling stay out of the octree
+          triangles.push_back(i);
+      }
       octree_ = new Octree();
-      ++Triangle::tagMask_;
       octree_->build(this, triangles, aabb );
+      addDirtyAabb(octree_->getAabbLoose());
       leavesUpdate_.clear();
       break;
     }
     else
     {
-      Octree* leaf=tri.leaf_;
-      octree_->addTriangle(this,tri);
-      if(leaf==tri.leaf_)
-      {
-        std::vector<int> &trisLeaf = leaf->getTriangles();
-        tri.posInLeaf_=trisLeaf.size();
-        trisLeaf.push_back(trisToMove[i]);
-      }
+      octree_->addTriangle(tri);
+      leavesUpdate_.push_back(tri.leaf_);
     }
   }
 }
@@ -719,7 +1079,7 @@ void Mesh::computeVertexNormals(const std::vector<int> &iVerts)
   for (int i=0;i<nbVers;++i)
   {
     Vertex &vert=vertices_[iVerts[i]];
-    const std::vector<int> &iTri = vert.tIndices_;
+    Adjacency::Range iTri = vertTris_[iVerts[i]];
     int nbTri = iTri.size();
     LM_ASSERT(nbTri > 0, "Bad vertex");
     Vector3 normal(Vector3::Zero());
@@ -740,32 +1100,42 @@ void Mesh::computeVertexNormals(const std::vector<int> &iVerts)
   }
 }
 
+/** Record the region covered by some triangles */
+void Mesh::addDirtyTriangles(const std::vector<int> &iTris)
+{
+  if(iTris.empty())
+    return;
+  Aabb aabb = triangles_[iTris[0]].aabb_;
+  const int nbTris = iTris.size();
+  for(int i=1;i<nbTris;++i)
+    aabb.expand(triangles_[iTris[i]].aabb_);
+  addDirtyAabb(aabb);
+}
+
+/** Record a modified region (merged into one box if nobody consumes them) */
+void Mesh::addDirtyAabb(const Aabb &aabb)
+{
+  const int maxDirtyAabbs = 256;
+  if((int)dirtyAabbs_.size()>=maxDirtyAabbs)
+  {
+    Aabb merged = aabb;
+    const int nbAabbs = dirtyAabbs_.size();
+    for(int i=0;i<nbAabbs;++i)
+      merged.expand(dirtyAabbs_[i]);
+    dirtyAabbs_.assign(1, merged);
+    return;
+  }
+  dirtyAabbs_.push_back(aabb);
+}
+
 /** End of stroke, update octree (cut empty leaves or go deeper if needed) */
 void Mesh::checkLeavesUpdate()
 {
   Tools::tidy(leavesUpdate_);
-  int nbLeaves = leavesUpdate_.size();
-  std::vector<Octree*> cutLeaves;
-  ++Triangle::tagMask_;
+  const int nbLeaves = leavesUpdate_.size();
   for(int i=0;i<nbLeaves;++i)
-  {
-    Octree* leaf = leavesUpdate_[i];
-    if(!leaf)
-      break;
-    if(!leaf->getTriangles().size())
-      Octree::checkEmptiness(leaf,cutLeaves);
-    else if((int)leaf->getTriangles().size() > Octree::maxTriangles_ && leaf->getDepth() < Octree::maxDepth_)
-      leaf->constructCells(this);
-  }
-  Tools::tidy(cutLeaves);
-  int nbCutLeaves = cutLeaves.size();
-  for(int i=0;i<nbCutLeaves;++i)
-  {
-    Octree *oc = cutLeaves[i];
-    Octree **child = oc->getChildren();
-    for(int j=0;j<8;++j)
-      child[j]=0;
-  }
+    addDirtyAabb(octree_->getAabbLoose(leavesUpdate_[i]));
+  octree_->checkLeaves(this, leavesUpdate_);
   leavesUpdate_.clear();
 }
 
@@ -781,18 +1151,19 @@ void Mesh::checkLeavesUpdate()
 *****************************************
 */
 
-/** Undo setters/Getters */
-TriangleVector& Mesh::getTrianglesState() { return undoIte_->tState_; }
-VertexVector& Mesh::getVerticesState() { return undoIte_->vState_; }
-
 /** Start push state */
 void Mesh::startPushState()
 {
-  ++Mesh::stateMask_;
+  compact(); //the holes belong to the state being closed
+  triJournal_.start(triangles_.size());
+  vertJournal_.start(vertices_.size());
+  if(beginIte_ || !redo_.empty()) {
+    stateTasks_.wait(); //the states dropped below might still be compressed
+  }
   if(beginIte_) {
     undo_.clear();
-  } else if(undo_.size()>undoLimit_) {
-    undo_.pop_front();
+  } else if(undo_.size()) {
+    closeState(*undoIte_);
   }
   beginIte_ = false;
   redo_.clear();
@@ -812,35 +1183,227 @@ void Mesh::startPushState()
   undoIte_->nbTrianglesState_ = triangles_.size();
   undoIte_->nbVerticesState_ = vertices_.size();
   undoIte_->aabbState_ = octree_->getAabbSplit();
+  trimHistory();
+}
+
+/** Keep only the differences of a finished state and compress them in the background */
+void Mesh::closeState(State &state)
+{
+  if(!state.isClosed()) {
+    state.close(*this);
+  }
+  state.releaseCopies();
+  if(!state.compressRequested_)
+  {
+    state.compressRequested_ = true;
+    State *closed = &state;
+    stateTasks_.run([closed] { closed->compress(); });
+  }
+}
+
+/** Keep the history in the memory budget, the oldest states go to the undo file if there is one
+and are dropped otherwise or when a write to the file failed (the current state is always kept) */
+void Mesh::trimHistory()
+{
+  size_t nbBytes = getUndoSize();
+  if(nbBytes<=undoBudget_)
+    return;
+  if(stateFile_.isOpen())
+  {
+    spillStates(nbBytes);
+    //a state the file could not take stays in memory : the oldest states are then dropped as without a file
+    bool failed = false;
+    for(std::list<State>::iterator it=undo_.begin();it!=undoIte_ && !failed;++it)
+      failed = it->isSpillFailed();
+    if(!failed)
+      return;
+  }
+  while(nbBytes>undoBudget_ && undo_.begin()!=undoIte_)
+  {
+    const State &oldest = undo_.front();
+    if(!oldest.isCompressed() || (oldest.spillRequested_ && !oldest.isSpillDone())) //still packed or written
+    {
+      stateTasks_.wait();
+      nbBytes = getUndoSize();
+      continue;
+    }
+    nbBytes -= oldest.getNbBytes();
+    undo_.pop_front();
+  }
+}
+
+/**
+* Give the oldest compressed states a place in the undo file and write them in the background.
+* The file is used as a ring in the order of the history : a state goes right after the
+* previous spilled one (or back at the start of the file), the oldest states in the way are
+* dropped. Nothing is spilled while the previous batch is still written.
+*/
+void Mesh::spillStates(size_t nbBytes)
+{
+  if(LockFree::loadAcquire(spilling_)) {
+    return;
+  }
+  const size_t capacity = stateFile_.getCapacity();
+  size_t offset = 0;
+  std::list<State>::iterator it = undo_.begin();
+  for(;it!=undoIte_ && it->spillRequested_;++it) {
+    offset = it->fileOffset_+it->getNbPackedBytes();
+  }
+  std::vector<State*> spilled;
+  for(;it!=undoIte_ && nbBytes>undoBudget_;++it)
+  {
+    State &state = *it;
+    const size_t nb = state.getNbPackedBytes();
+    if(!state.isCompressed() || nb>capacity) {
+      break;
+    }
+    const size_t start = offset;
+    if(offset+nb>capacity) {
+      offset = 0;
+    }
+    //in the order of the ring, the states in the way are the oldest ones
+    bool blocked = false;
+    while(undo_.begin()!=it && undo_.front().spillRequested_)
+    {
+      State &oldest = undo_.front();
+      const size_t begin = oldest.fileOffset_;
+      const size_t end = begin+oldest.getNbPackedBytes();
+      const bool inTheWay = offset==start ? begin<offset+nb && end>offset : end>start || begin<offset+nb;
+      if(!inTheWay) {
+        break;
+      }
+      if(!oldest.isSpillDone()) { //spilled by this batch
+        blocked = true;
+        break;
+      }
+      nbBytes -= oldest.getNbBytes();
+      undo_.pop_front();
+    }
+    if(blocked) {
+      break;
+    }
+    state.spillRequested_ = true;
+    state.fileOffset_ = offset;
+    offset += nb;
+    nbBytes -= nb;
+    spilled.push_back(&state);
+  }
+  if(spilled.empty()) {
+    return;
+  }
+  LockFree::storeRelease(spilling_, 1);
+  stateTasks_.run([this, spilled] {
+    const int nbSpilled = spilled.size();
+    for(int i=0;i<nbSpilled;++i) {
+      spilled[i]->spill(stateFile_);
+    }
+    LockFree::storeRelease(spilling_, 0);
+  });
+}
+
+/** Setters/Getters */
+void Mesh::setUndoBudget(size_t nbBytes) { undoBudget_ = nbBytes; }
+size_t Mesh::getUndoBudget() const { return undoBudget_; }
+
+/** Spill the states beyond the memory budget to a file instead of dropping them (before the first state) */
+bool Mesh::setUndoFile(const std::string &path, size_t capacity)
+{
+  stateTasks_.wait();
+  return stateFile_.open(path, capacity);
+}
+
+/** Memory used by the undo and redo states */
+size_t Mesh::getUndoSize() const
+{
+  size_t nbBytes = 0;
+  for(std::list<State>::const_iterator it = undo_.begin(); it!=undo_.end(); ++it) nbBytes += it->getNbBytes();
+  for(std::list<State>::const_iterator it = redo_.begin(); it!=redo_.end(); ++it) nbBytes += it->getNbBytes();
+  return nbBytes;
 }
 
 /** Push verts and tris */
 void Mesh::pushState(const std::vector<int> &iTris, const std::vector<int> &iVerts)
 {
-  TriangleVector &tState = undoIte_->tState_;
-  VertexVector &vState = undoIte_->vState_;
   int nbTris = iTris.size();
   for(int i=0;i<nbTris;++i)
   {
-    Triangle &t = triangles_[iTris[i]];
-    if(t.stateFlag_!=Mesh::stateMask_)
-    {
-      t.stateFlag_ = Mesh::stateMask_;
-      tState.push_back(t);
-    }
+    if(triJournal_.mark(iTris[i]))
+      saveTriangle(*undoIte_, iTris[i]);
   }
   int nbVerts = iVerts.size();
   for(int i=0;i<nbVerts;++i)
   {
-    Vertex &v = vertices_[iVerts[i]];
-    if(v.stateFlag_!=Mesh::stateMask_)
-    {
-      v.stateFlag_ = Mesh::stateMask_;
-      vState.push_back(v);
-    }
+    if(vertJournal_.mark(iVerts[i]))
+      saveVertex(*undoIte_, iVerts[i]);
   }
 }
 
+/** Push one triangle (if it's not already saved) */
+void Mesh::pushTriangleState(int iTri)
+{
+  if(triJournal_.mark(iTri))
+    saveTriangle(*undoIte_, iTri);
+}
+
+/** Push one vertex (if it's not already saved) */
+void Mesh::pushVertexState(int iVert)
+{
+  if(vertJournal_.mark(iVert))
+    saveVertex(*undoIte_, iVert);
+}
+
+/**
+* The triangle iTriFrom moved to iTri (swap delete) : the slot iTri is saved if iTriFrom was,
+* and it is updated at the end of a deferred update
+*/
+void Mesh::moveTriangle(int iTri, int iTriFrom)
+{
+  triJournal_.move(iTri, iTriFrom);
+  if(deferUpdates_)
+    pendingTris_.push_back(iTri);
+}
+
+/** Copy the vertices of a triangle into a state (normal, aabb and leaf are recomputed on restore) */
+void Mesh::saveTriangle(State &state, int iTri)
+{
+  const int *indices = triangles_[iTri].vIndices_;
+  state.tIdState_.push_back(iTri);
+  state.tIndicesState_.insert(state.tIndicesState_.end(), indices, indices+3);
+}
+
+/** Copy back the vertices of a saved triangle */
+void Mesh::restoreTriangle(const State &state, int iState)
+{
+  const int iTri = state.tIdState_[iState];
+  Triangle &t = triangles_[iTri];
+  t.id_ = iTri;
+  t.tagFlag_ = 1;
+  for(int i=0;i<3;++i)
+    t.vIndices_[i] = state.tIndicesState_[3*iState+i];
+}
+
+/** Copy a vertex and its adjacency into a state */
+void Mesh::saveVertex(State &state, int iVert)
+{
+  state.vState_.push_back(vertices_[iVert]);
+  state.vIdState_.push_back(iVert);
+  state.vMaterialState_.push_back(materials_[iVert]);
+  state.vTrisState_.append(vertTris_[iVert]);
+  state.vRingState_.append(vertRings_[iVert]);
+}
+
+/** Copy back a saved vertex and its adjacency */
+void Mesh::restoreVertex(const State &state, int iState)
+{
+  const int iVert = state.vIdState_[iState];
+  vertices_[iVert] = state.vState_[iState];
+  materials_[iVert] = state.vMaterialState_[iState];
+  Adjacency::Range iTris = state.vTrisState_[iState];
+  Adjacency::Range ring = state.vRingState_[iState];
+  vertTris_.assign(iVert, iTris.begin(), iTris.end());
+  vertRings_.assign(iVert, ring.begin(), ring.end());
+}
+
 void Mesh::undo() {
   undoPending_ = true;
 }
@@ -865,85 +1428,72 @@ void Mesh::performUndo()
   if(!undo_.size() || beginIte_) {
     return;
   }
-  State redo;
+  compact();
+  stateTasks_.wait();
+  State &undo = *undoIte_;
+  if(!undo.isClosed()) {
+    undo.close(*this);
+  }
+  undo.open(*this);
+  redo_.push_back(State());
+  State &redo = redo_.back();
   int nbTriangles = triangles_.size();
   int nbVertices = vertices_.size();
   redo.nbTrianglesState_ = nbTriangles;
   redo.nbVerticesState_ = nbVertices;
   redo.aabbState_ = octree_->getAabbSplit();
-  TriangleVector &tRedoState = redo.tState_;
-  VertexVector &vRedoState = redo.vState_;
 
-  int nbTrianglesState  = undoIte_->nbTrianglesState_;
-  int nbVerticesState  = undoIte_->nbVerticesState_;
-  TriangleVector &tUndoState = undoIte_->tState_;
-  VertexVector &vUndoState = undoIte_->vState_;
+  int nbTrianglesState  = undo.nbTrianglesState_;
+  int nbVerticesState  = undo.nbVerticesState_;
+  const std::vector<int> &tIdUndoState = undo.tIdState_;
+  const std::vector<int> &vIdUndoState = undo.vIdState_;
 
-  int nbTris = tUndoState.size();
-  int nbVerts = vUndoState.size();
+  int nbTris = tIdUndoState.size();
+  int nbVerts = vIdUndoState.size();
   //REDO
-  if(nbTrianglesState<nbTriangles)
-  {
-    for(int i=nbTrianglesState;i<nbTriangles;++i) tRedoState.push_back(triangles_[i]);
-    for(int i=0;i<nbTris;++i)
-    {
-      Triangle &t = tUndoState[i];
-      if(t.id_<nbTrianglesState) tRedoState.push_back(triangles_[t.id_]);
-    }
-    triangles_.resize(nbTrianglesState);
-  }
-  else
-  {
-    triangles_.resize(nbTrianglesState);
-    for(int i=0;i<nbTris;++i)
-    {
-      Triangle &t = tUndoState[i];
-      if(t.id_<nbTriangles) tRedoState.push_back(triangles_[t.id_]);
-    }
-  }
-  if(nbVerticesState<nbVertices)
+  const int nbTrianglesKept = std::min(nbTriangles, nbTrianglesState);
+  for(int i=nbTrianglesState;i<nbTriangles;++i) saveTriangle(redo, i);
+  for(int i=0;i<nbTris;++i)
   {
-    for(int i=nbVerticesState;i<nbVertices;++i) vRedoState.push_back(vertices_[i]);
-    for(int i=0;i<nbVerts;++i)
-    {
-      Vertex &v = vUndoState[i];
-      if(v.id_<nbVerticesState) vRedoState.push_back(vertices_[v.id_]);
-    }
-    vertices_.resize(nbVerticesState, Vertex(Vector3::Zero()));
+    if(tIdUndoState[i]<nbTrianglesKept) saveTriangle(redo, tIdUndoState[i]);
   }
-  else
+  const int nbVerticesKept = std::min(nbVertices, nbVerticesState);
+  for(int i=nbVerticesState;i<nbVertices;++i) saveVertex(redo, i);
+  for(int i=0;i<nbVerts;++i)
   {
-    vertices_.resize(nbVerticesState, Vertex(Vector3::Zero()));
-    for(int i=0;i<nbVerts;++i)
-    {
-      Vertex &v = vUndoState[i];
-      if(v.id_<nbVertices) vRedoState.push_back(vertices_[v.id_]);
-    }
+    if(vIdUndoState[i]<nbVerticesKept) saveVertex(redo, vIdUndoState[i]);
   }
+  startRestore(tIdUndoState, nbTrianglesState);
+  triangles_.resize(nbTrianglesState);
+  vertices_.resize(nbVerticesState, Vertex(Vector3::Zero()));
+  materials_.resize(nbVerticesState, Vector3::Ones());
+  vertTris_.resize(nbVerticesState);
+  vertRings_.resize(nbVerticesState);
   //UNDO
+  std::vector<int> iTrisRestored;
+  iTrisRestored.reserve(nbTris);
   for(int i=0;i<nbTris;++i)
   {
-    Triangle &t = tUndoState[i];
-    if(t.id_<nbTrianglesState) {
-      triangles_[t.id_] = t;
+    if(tIdUndoState[i]<nbTrianglesState) {
+      restoreTriangle(undo, i);
+      iTrisRestored.push_back(tIdUndoState[i]);
     }
   }
+  std::vector<int> iVertsRestored;
+  iVertsRestored.reserve(nbVerts);
   for(int i=0;i<nbVerts;++i)
   {
-    Vertex &v = vUndoState[i];
-    if(v.id_<nbVerticesState) {
-      vertices_[v.id_] = v;
+    if(vIdUndoState[i]<nbVerticesState) {
+      restoreVertex(undo, i);
+      iVertsRestored.push_back(vIdUndoState[i]);
     }
   }
-  recomputeOctree(undoIte_->aabbState_);
-  std::unique_lock<std::mutex> lock(bufferMutex_);
-  reallocateIndicesBuffer_ = true;
-  reallocateVerticesBuffer_ = true;
-  reinitVerticesBuffer();
-  reinitIndicesBuffer();
-  pendingGPUTriangles = getNbTriangles();
-  pendingGPUVertices = getNbVertices();
-  redo_.push_back(redo);
+  computeTriangleNormals(iTrisRestored);
+  computeTriangleAreas(iTrisRestored);
+  endRestore(iTrisRestored, undo.aabbState_);
+  publishSnapshot(iTrisRestored, iVertsRestored);
+  closeState(undo);
+  closeState(redo);
   if(undoIte_!=undo_.begin())
   {
     beginIte_ = false;
@@ -962,34 +1512,27 @@ void Mesh::performRedo()
   if(!redo_.size()) {
     return;
   }
-  std::list<State>::iterator redoIte_ = redo_.end();
-  --redoIte_;
-  int nbTrianglesState  = redoIte_->nbTrianglesState_;
-  int nbVerticesState  = redoIte_->nbVerticesState_;
-  TriangleVector &tRedoState = redoIte_->tState_;
-  VertexVector &vRedoState = redoIte_->vState_;
+  stateTasks_.wait();
+  State &redo = redo_.back();
+  redo.open(*this);
+  int nbTrianglesState  = redo.nbTrianglesState_;
+  int nbVerticesState  = redo.nbVerticesState_;
+  startRestore(redo.tIdState_, nbTrianglesState);
   triangles_.resize(nbTrianglesState);
   vertices_.resize(nbVerticesState, Vertex(Vector3::Zero()));
-  int nbTris = tRedoState.size();
+  materials_.resize(nbVerticesState, Vector3::Ones());
+  vertTris_.resize(nbVerticesState);
+  vertRings_.resize(nbVerticesState);
+  int nbTris = redo.tIdState_.size();
   for(int i=0;i<nbTris;++i)
-  {
-    Triangle &t = tRedoState[i];
-    triangles_[t.id_] = t;
-  }
-  int nbVerts = vRedoState.size();
+    restoreTriangle(redo, i);
+  int nbVerts = redo.vIdState_.size();
   for(int i=0;i<nbVerts;++i)
-  {
-    Vertex &v = vRedoState[i];
-    vertices_[v.id_] = v;
-  }
-  recomputeOctree(redoIte_->aabbState_);
-  std::unique_lock<std::mutex> lock(bufferMutex_);
-  reallocateIndicesBuffer_ = true;
-  reallocateVerticesBuffer_ = true;
-  reinitVerticesBuffer();
-  reinitIndicesBuffer();
-  pendingGPUTriangles = getNbTriangles();
-  pendingGPUVertices = getNbVertices();
+    restoreVertex(redo, i);
+  computeTriangleNormals(redo.tIdState_);
+  computeTriangleAreas(redo.tIdState_);
+  endRestore(redo.tIdState_, redo.aabbState_);
+  publishSnapshot(redo.tIdState_, redo.vIdState_);
   if(!beginIte_) {
     ++undoIte_;
   } else {
@@ -999,19 +1542,60 @@ void Mesh::performRedo()
   redoPending_ = false;
 }
 
+/**
+* Before a state is restored : record the region of the triangles it is about to change
+* and take the triangles past the end of the state out of the octree
+*/
+void Mesh::startRestore(const std::vector<int> &iTris, int nbTrianglesState)
+{
+  const int nbTriangles = triangles_.size();
+  const int nbTris = iTris.size();
+  std::vector<int> iTrisChanged;
+  iTrisChanged.reserve(nbTris+std::max(0, nbTriangles-nbTrianglesState));
+  for(int i=0;i<nbTris;++i)
+  {
+    if(iTris[i]<nbTriangles)
+      iTrisChanged.push_back(iTris[i]);
+  }
+  for(int i=nbTrianglesState;i<nbTriangles;++i)
+  {
+    Triangle &t = triangles_[i];
+    iTrisChanged.push_back(i);
+    leavesUpdate_.push_back(t.leaf_);
+    octree_->removeTriangle(triangles_, t);
+  }
+  addDirtyTriangles(iTrisChanged);
+}
+
+/**
+* After a state is restored : only the restored triangles move in the octree, so that an undo
+* costs as much as the edit it reverts. The octree is rebuilt if most of the mesh changed.
+*/
+void Mesh::endRestore(const std::vector<int> &iTris, const Aabb &aabbSplit)
+{
+  if(iTris.size()*4>triangles_.size())
+  {
+    leavesUpdate_.clear();
+    recomputeOctree(aabbSplit);
+    return;
+  }
+  updateOctree(iTris);
+  addDirtyTriangles(iTris);
+  checkLeavesUpdate();
+}
+
 /** Recompute octree */
 void Mesh::recomputeOctree(const Aabb &aabbSplit)
 {
   int nbTriangles = triangles_.size();
   std::vector<int> triangles(nbTriangles);
-#pragma omp parallel for
-  for (int i=0;i<nbTriangles;++i) {
+  ThreadPool::parallelFor(0, nbTriangles, [&](int i) {
     triangles[i] = i;
-  }
-  ++Triangle::tagMask_;
+  });
   delete octree_;
   octree_ = new Octree();
   octree_->build(this, triangles, aabbSplit);
+  addDirtyAabb(octree_->getAabbLoose());
 }
 
 void Mesh::checkNormals() {
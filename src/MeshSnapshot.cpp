@@ -0,0 +1,179 @@
+#include "StdAfx.h"
+#include "MeshSnapshot.h"
+#include "Mesh.h"
+#include "Octree.h"
+#include "ThreadPool.h"
+
+/** Constructor, copy the whole mesh */
+MeshSnapshot::MeshSnapshot(const Mesh &mesh, int epoch, bool withOctree) : epoch_(epoch), octreeId_(-1), octreeStamp_(0)
+{
+  init(mesh);
+  const int nbVertexChunks = getNbChunks(nbVertices_);
+  const int nbIndexChunks = getNbChunks(nbTriangles_);
+  vertexChunks_.resize(nbVertexChunks);
+  indexChunks_.resize(nbIndexChunks);
+  ThreadPool::parallelFor(0, nbVertexChunks, [&](int i) {
+    vertexChunks_[i] = createVertexChunk(mesh, i);
+  }, 1);
+  ThreadPool::parallelFor(0, nbIndexChunks, [&](int i) {
+    indexChunks_[i] = createIndexChunk(mesh, i);
+  }, 1);
+  snapshotOctree(mesh, 0, withOctree);
+}
+
+/**
+* Constructor, next epoch of previous : only the chunks holding the modified
+* triangles and vertices (or past the end of the previous epoch) are copied
+*/
+MeshSnapshot::MeshSnapshot(const MeshSnapshot &previous, const Mesh &mesh, const std::vector<int> &iTris,
+  const std::vector<int> &iVerts, bool withOctree) : epoch_(previous.epoch_+1), octreeId_(-1), octreeStamp_(0)
+{
+  init(mesh);
+  const int nbVertexChunks = getNbChunks(nbVertices_);
+  const int nbIndexChunks = getNbChunks(nbTriangles_);
+  std::vector<bool> vertexDirty(nbVertexChunks, false);
+  std::vector<bool> indexDirty(nbIndexChunks, false);
+  const int nbVerts = iVerts.size();
+  for(int i=0;i<nbVerts;++i)
+  {
+    if(iVerts[i]<nbVertices_)
+      vertexDirty[iVerts[i]>>chunkShift_] = true;
+  }
+  const int nbTris = iTris.size();
+  for(int i=0;i<nbTris;++i)
+  {
+    if(iTris[i]<nbTriangles_)
+      indexDirty[iTris[i]>>chunkShift_] = true;
+  }
+  //the last chunk of the previous epoch changes size if elements were added or removed
+  if(nbVertices_!=previous.nbVertices_ && nbVertices_>0)
+    vertexDirty[std::min(previous.nbVertices_, nbVertices_-1)>>chunkShift_] = true;
+  if(nbTriangles_!=previous.nbTriangles_ && nbTriangles_>0)
+    indexDirty[std::min(previous.nbTriangles_, nbTriangles_-1)>>chunkShift_] = true;
+
+  const int nbPreviousVertexChunks = previous.vertexChunks_.size();
+  const int nbPreviousIndexChunks = previous.indexChunks_.size();
+  vertexChunks_.resize(nbVertexChunks);
+  indexChunks_.resize(nbIndexChunks);
+  ThreadPool::parallelFor(0, nbVertexChunks, [&](int i) {
+    if(vertexDirty[i] || i>=nbPreviousVertexChunks)
+      vertexChunks_[i] = createVertexChunk(mesh, i);
+    else
+      vertexChunks_[i] = previous.vertexChunks_[i];
+  }, 1);
+  ThreadPool::parallelFor(0, nbIndexChunks, [&](int i) {
+    if(indexDirty[i] || i>=nbPreviousIndexChunks)
+      indexChunks_[i] = createIndexChunk(mesh, i);
+    else
+      indexChunks_[i] = previous.indexChunks_[i];
+  }, 1);
+  snapshotOctree(mesh, &previous, withOctree);
+}
+
+/** Destructor */
+MeshSnapshot::~MeshSnapshot()
+{}
+
+/** Getters */
+int MeshSnapshot::getEpoch() const { return epoch_; }
+int MeshSnapshot::getNbVertices() const { return nbVertices_; }
+int MeshSnapshot::getNbTriangles() const { return nbTriangles_; }
+float MeshSnapshot::getScale() const { return scale_; }
+const Aabb& MeshSnapshot::getAabbSplit() const { return aabbSplit_; }
+int MeshSnapshot::getNbVertexChunks() const { return vertexChunks_.size(); }
+int MeshSnapshot::getNbIndexChunks() const { return indexChunks_.size(); }
+const MeshSnapshot::VertexChunkPtr& MeshSnapshot::getVertexChunk(int i) const { return vertexChunks_[i]; }
+const MeshSnapshot::IndexChunkPtr& MeshSnapshot::getIndexChunk(int i) const { return indexChunks_[i]; }
+
+/** Draw the octree cells (if they were requested) */
+void MeshSnapshot::drawOctree() const
+{
+  if(!octreeCells_)
+    return;
+  const std::vector<Aabb> &cells = *octreeCells_;
+  const int nbCells = cells.size()/2;
+  for(int i=0;i<nbCells;++i)
+  {
+    glColor3f(0, 1, 0);
+    cells[2*i].draw();
+    glColor3f(1, 0, 0);
+    cells[2*i+1].draw();
+  }
+}
+
+/** Copy the vertices of a chunk */
+MeshSnapshot::VertexChunkPtr MeshSnapshot::createVertexChunk(const Mesh &mesh, int iChunk)
+{
+  const VertexVector &vertices = mesh.getVertices();
+  const Vector3Vector &materials = mesh.getMaterials();
+  const int first = iChunk<<chunkShift_;
+  const int nbVerts = std::min(chunkSize_, static_cast<int>(vertices.size())-first);
+  std::shared_ptr<VertexChunk> chunk = std::make_shared<VertexChunk>();
+  chunk->positions_.resize(nbVerts*3);
+  chunk->normals_.resize(nbVerts*3);
+  chunk->colors_.resize(nbVerts*3);
+  for(int i=0;i<nbVerts;++i)
+  {
+    const Vertex &v = vertices[first+i];
+    const Vector3 &color = materials[first+i];
+    for(int j=0;j<3;++j)
+    {
+      chunk->positions_[i*3+j] = v[j];
+      chunk->normals_[i*3+j] = v.normal_[j];
+      chunk->colors_[i*3+j] = color[j];
+    }
+  }
+  return chunk;
+}
+
+/** Copy the triangles of a chunk */
+MeshSnapshot::IndexChunkPtr MeshSnapshot::createIndexChunk(const Mesh &mesh, int iChunk)
+{
+  const TriangleVector &triangles = mesh.getTriangles();
+  const int first = iChunk<<chunkShift_;
+  const int nbTris = std::min(chunkSize_, static_cast<int>(triangles.size())-first);
+  std::shared_ptr<IndexChunk> chunk = std::make_shared<IndexChunk>();
+  chunk->indices_.resize(nbTris*3);
+  for(int i=0;i<nbTris;++i)
+  {
+    const int *iVerts = triangles[first+i].vIndices_;
+    chunk->indices_[i*3] = iVerts[0];
+    chunk->indices_[i*3+1] = iVerts[1];
+    chunk->indices_[i*3+2] = iVerts[2];
+  }
+  return chunk;
+}
+
+/** Number of chunks needed for nbElements */
+int MeshSnapshot::getNbChunks(int nbElements)
+{
+  return (nbElements+chunkSize_-1)>>chunkShift_;
+}
+
+/** Copy the sizes of the mesh */
+void MeshSnapshot::init(const Mesh &mesh)
+{
+  nbVertices_ = mesh.getNbVertices();
+  nbTriangles_ = mesh.getNbTriangles();
+  scale_ = mesh.getScale();
+  if(mesh.getOctree())
+    aabbSplit_ = mesh.getOctree()->getAabbSplit();
+}
+
+/** Copy the octree cells, shared with the previous epoch if the octree didn't change */
+void MeshSnapshot::snapshotOctree(const Mesh &mesh, const MeshSnapshot *previous, bool withOctree)
+{
+  Octree *octree = mesh.getOctree();
+  if(!withOctree || !octree)
+    return;
+  octreeId_ = octree->getId();
+  octreeStamp_ = octree->getVersion();
+  if(previous && previous->octreeCells_ && previous->octreeId_==octreeId_ && previous->octreeStamp_==octreeStamp_)
+  {
+    octreeCells_ = previous->octreeCells_;
+    return;
+  }
+  std::shared_ptr<std::vector<Aabb> > cells = std::make_shared<std::vector<Aabb> >();
+  octree->getCells(*cells);
+  octreeCells_ = cells;
+}
@@ -1,174 +1,646 @@
 #include "StdAfx.h"
 #include "Octree.h"
+#include "ThreadPool.h"
+
+/** Spread the lower bits of an integer coordinate (two zero bits between each bit) */
+static uint64_t spreadBits(uint64_t x)
+{
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+/** Morton code of a position expressed in cells of the finest level (x is the lowest bit of each octant digit) */
+static uint64_t mortonCode(const Vector3 &pos, int resolution)
+{
+  uint64_t code = 0;
+  for(int i=0;i<3;++i)
+  {
+    int q = static_cast<int>(pos[i]);
+    q = std::max(0, std::min(resolution-1, q));
+    code |= spreadBits(q) << i;
+  }
+  return code;
+}
+
+/** Sort a vector, each thread sorts a chunk and the chunks are then merged two by two */
+template <class T>
+static void parallelSort(std::vector<T> &values)
+{
+  int nbValues = values.size();
+  int nbChunks = ThreadPool::getInstance().getNbThreads();
+  if(nbChunks<2 || nbValues<(1<<16))
+  {
+    std::sort(values.begin(), values.end());
+    return;
+  }
+  std::vector<int> bounds(nbChunks+1);
+  for(int i=0;i<=nbChunks;++i)
+    bounds[i] = static_cast<int>(static_cast<int64_t>(nbValues)*i/nbChunks);
+  ThreadPool::parallelFor(0, nbChunks, [&](int i) {
+    std::sort(values.begin()+bounds[i], values.begin()+bounds[i+1]);
+  }, 1);
+  for(int step=1;step<nbChunks;step*=2)
+  {
+    ThreadPool::parallelFor(0, (nbChunks+2*step-1)/(2*step), [&](int k) {
+      const int i = 2*step*k;
+      if(i+step<nbChunks)
+        std::inplace_merge(values.begin()+bounds[i], values.begin()+bounds[i+step], values.begin()+bounds[std::min(i+2*step, nbChunks)]);
+    }, 1);
+  }
+}
+
+/** First sorted code in [iFirst, iLast[ whose octant digit (code >> shift) is greater or equal to octant */
+static int lowerOctant(const std::vector<std::pair<uint64_t, int> > &codes, int iFirst, int iLast, int shift, int octant)
+{
+  while(iFirst<iLast)
+  {
+    int iMid = (iFirst+iLast)/2;
+    if(static_cast<int>((codes[iMid].first >> shift) & 7) < octant)
+      iFirst = iMid+1;
+    else
+      iLast = iMid;
+  }
+  return iFirst;
+}
+
+const float Octree::sphereCacheMargin_ = 0.25f;
+int Octree::nbIds_ = 0;
 
 /** Constructor */
-Octree::Octree(Octree* parent, int depth) : parent_(parent), depth_(depth)
+Octree::Octree() : id_(++nbIds_), stamp_(0), structureStamp_(0)
 {
-  for (int i=0;i<8;++i)
-    child_[i]=0;
+  nodes_.push_back(Node());
+  leafTris_.resize(1);
 }
 
 /** Destructor */
 Octree::~Octree()
 {
-  parent_ = 0;
-  if(child_[0]!=0)
+}
+
+Aabb &Octree::getAabbLoose() { return nodes_[0].aabbLoose_; }
+Aabb &Octree::getAabbSplit() { return nodes_[0].aabbSplit_; }
+const Aabb &Octree::getAabbSplit(int iNode) const { return nodes_[iNode].aabbSplit_; }
+const Aabb &Octree::getAabbLoose(int iNode) const { return nodes_[iNode].aabbLoose_; }
+int Octree::getNbTriangles(int iLeaf) const { return leafTris_.size(iLeaf); }
+
+/**
+* Build octree
+* The triangles are sorted by the Morton code of their center, so that every cell
+* of the octree is a contiguous range of the sorted array. The cells are then split
+* breadth first, the children of a node being always stored after it (and the nodes
+* sorted by depth). The codes, the sort, the leaves and each level of loose boxes
+* are computed in parallel.
+*/
+void Octree::build(Mesh *mesh, const std::vector<int> &iTris, const Aabb &aabb)
+{
+  TriangleVector &triangles = mesh->getTriangles();
+  nodes_.clear();
+  freeChildren_.clear();
+  cutChildren_.clear();
+  leafTris_.clear();
+  id_ = ++nbIds_;
+  structureStamp_ = ++stamp_;
+  nodes_.push_back(Node());
+  leafTris_.resize(1);
+  nodes_[0].aabbSplit_ = aabb;
+  nodes_[0].aabbLoose_ = aabb;
+
+  int nbTris = iTris.size();
+  const int resolution = 1<<maxDepth_;
+  Vector3 extent = (aabb.max_-aabb.min_).cwiseMax(Vector3::Constant(1e-10f));
+  Vector3 scale = Vector3::Constant(static_cast<float>(resolution)).cwiseQuotient(extent);
+  std::vector<std::pair<uint64_t, int> > codes(nbTris);
+  ThreadPool::parallelFor(0, nbTris, [&](int i) {
+    const Triangle &t = triangles[iTris[i]];
+    codes[i] = std::make_pair(mortonCode((t.aabb_.getCenter()-aabb.min_).cwiseProduct(scale), resolution), iTris[i]);
+  });
+  parallelSort(codes);
+
+  std::vector<int> first(1, 0); //first sorted triangle of each node
+  std::vector<int> last(1, nbTris); //end of the sorted triangles of each node
+  for(int iNode=0;iNode<(int)nodes_.size();++iNode)
   {
-    for (int i=0;i<8;++i)
+    int depth = nodes_[iNode].depth_;
+    if(last[iNode]-first[iNode] <= maxTriangles_ || depth >= maxDepth_)
+      continue;
+    int iChild = createChildren(iNode);
+    first.resize(nodes_.size());
+    last.resize(nodes_.size());
+    int shift = 3*(maxDepth_-1-depth);
+    int iBegin = first[iNode];
+    for(int i=0;i<8;++i)
     {
-      delete child_[i];
-      child_[i] = 0;
+      int iEnd = i==7 ? last[iNode] : lowerOctant(codes, iBegin, last[iNode], shift, i+1);
+      first[iChild+i] = iBegin;
+      last[iChild+i] = iEnd;
+      iBegin = iEnd;
     }
   }
+
+  int nbNodes = nodes_.size();
+  std::vector<int> sizes(nbNodes, 0);
+  for(int i=0;i<nbNodes;++i)
+    if(nodes_[i].child_==-1)
+      sizes[i] = last[i]-first[i];
+  leafTris_.init(sizes); //capacities are reserved, leaves can be filled concurrently
+  ThreadPool::parallelFor(0, nbNodes, [&](int i) {
+    if(nodes_[i].child_!=-1)
+      return;
+    Aabb &aabbLoose = nodes_[i].aabbLoose_;
+    int iFirst = first[i];
+    int iLast = last[i];
+    for(int j=iFirst;j<iLast;++j)
+    {
+      Triangle &t = triangles[codes[j].second];
+      aabbLoose.expand(t.aabb_);
+      t.leaf_ = i;
+      t.posInLeaf_ = j-iFirst;
+      leafTris_.add(i, t.id_);
+    }
+  }, 64);
+  std::vector<int> levels(1, 0); //first node of each depth
+  for(int i=1;i<nbNodes;++i)
+    if(nodes_[i].depth_!=nodes_[i-1].depth_)
+      levels.push_back(i);
+  levels.push_back(nbNodes);
+  for(int d=levels.size()-2;d>=0;--d) //from the deepest level to the root
+  {
+    int iEnd = levels[d+1];
+    ThreadPool::parallelFor(levels[d], iEnd, [&](int i) {
+      Node &node = nodes_[i];
+      if(node.child_==-1)
+        return;
+      for(int j=0;j<8;++j)
+        node.aabbLoose_.expand(nodes_[node.child_+j].aabbLoose_);
+    });
+  }
 }
 
-/** Return triangles (in case of a leaf) */
-std::vector<int> &Octree::getTriangles() { return iTris_; }
-Aabb &Octree::getAabbLoose() { return aabbLoose_; }
-Aabb &Octree::getAabbSplit() { return aabbSplit_; }
-int Octree::getDepth() const { return depth_; }
-Octree* Octree::getParent() { return parent_; }
-Octree** Octree::getChildren() { return child_; }
+/** Create (or recycle) the 8 children of a leaf, return the index of the first child */
+int Octree::createChildren(int iNode)
+{
+  int iChild = -1;
+  if(!freeChildren_.empty())
+  {
+    iChild = freeChildren_.back();
+    freeChildren_.pop_back();
+  }
+  else
+  {
+    iChild = nodes_.size();
+    nodes_.resize(iChild+8);
+    leafTris_.resize(iChild+8);
+  }
+  Node &node = nodes_[iNode];
+  node.child_ = iChild;
+  for(int i=0;i<8;++i)
+  {
+    Node &child = nodes_[iChild+i];
+    child = Node(iNode, node.depth_+1);
+    child.aabbSplit_ = getOctantAabb(node.aabbSplit_, i);
+    child.aabbLoose_ = child.aabbSplit_;
+  }
+  return iChild;
+}
 
-/** Build octree */
-void Octree::build(Mesh *mesh, const std::vector<int> &iTris, const Aabb &aabb)
+/** Split a leaf into 8 children, recursively if needed */
+void Octree::constructCells(Mesh *mesh, int iLeaf)
 {
-  aabbSplit_ = aabb;
-  aabbLoose_ = aabb;
-  iTris_.clear();
   TriangleVector &triangles = mesh->getTriangles();
-  int nbTriangles=iTris.size();
-  if(parent_ && parent_->child_[7]==this) {
-    for(int i=0;i<nbTriangles;++i) {
-      Triangle &t = triangles[iTris[i]];
-      if(t.tagFlag_!=Triangle::tagMask_) {
-        aabbLoose_.expand(t.aabb_);
-        iTris_.push_back(iTris[i]);
-      }
-    }
-  } else {
-    for(int i=0;i<nbTriangles;++i) {
-      Triangle &t = triangles[iTris[i]];
-      if(aabbSplit_.pointInside(t.aabb_.getCenter()) && t.tagFlag_!=Triangle::tagMask_) {
-        aabbLoose_.expand(t.aabb_);
-        iTris_.push_back(iTris[i]);
-      }
-    }
+  std::vector<int> iTris = leafTris_[iLeaf].toVector();
+  leafTris_.assign(iLeaf, std::vector<int>());
+  int iChild = createChildren(iLeaf);
+  const Aabb aabbSplit = nodes_[iLeaf].aabbSplit_;
+  int nbTris = iTris.size();
+  for(int i=0;i<nbTris;++i)
+  {
+    Triangle &t = triangles[iTris[i]];
+    int iNode = iChild+getOctant(aabbSplit, t.aabb_.getCenter());
+    nodes_[iNode].aabbLoose_.expand(t.aabb_);
+    addTriangle(iNode, t);
   }
-  int nbTrianglesCell=iTris_.size();
-  if (nbTrianglesCell > Octree::maxTriangles_ && depth_ < Octree::maxDepth_) {
-    constructCells(mesh);
-  } else {
-    for(int i=0;i<nbTrianglesCell;++i) {
-      Triangle &t = triangles[iTris_[i]];
-      t.tagFlag_ = Triangle::tagMask_;
-      t.leaf_ = this;
-      t.posInLeaf_ = i;
+  for(int i=0;i<8;++i)
+  {
+    int iNode = iChild+i;
+    if(getNbTriangles(iNode) > maxTriangles_ && nodes_[iNode].depth_ < maxDepth_)
+      constructCells(mesh, iNode);
+  }
+}
+
+/** Return the octant of a point inside a split aabb (consistent with Aabb::pointInside) */
+int Octree::getOctant(const Aabb &aabbSplit, const Vector3 &point)
+{
+  Vector3 center = (aabbSplit.min_+aabbSplit.max_)*0.5f;
+  return (point.x()>center.x() ? 1 : 0) | (point.y()>center.y() ? 2 : 0) | (point.z()>center.z() ? 4 : 0);
+}
+
+/** Return the split aabb of an octant */
+Aabb Octree::getOctantAabb(const Aabb &aabbSplit, int octant)
+{
+  Vector3 center = (aabbSplit.min_+aabbSplit.max_)*0.5f;
+  Aabb aabb(aabbSplit.min_, center);
+  for(int i=0;i<3;++i)
+  {
+    if(octant & (1<<i))
+    {
+      aabb.min_[i] = center[i];
+      aabb.max_[i] = aabbSplit.max_[i];
     }
   }
+  return aabb;
+}
+
+/** Get the split and loose aabb of every cell (for drawing) */
+void Octree::getCells(std::vector<Aabb> &cells) const
+{
+  cells.clear();
+  std::vector<int> stack(1, 0);
+  while(!stack.empty())
+  {
+    const Node &node = nodes_[stack.back()];
+    stack.pop_back();
+    cells.push_back(node.aabbSplit_);
+    cells.push_back(node.aabbLoose_);
+    if(node.child_!=-1)
+      for(int i=0;i<8;++i)
+        stack.push_back(node.child_+i);
+  }
 }
 
-/** Construct cell */
-void Octree::constructCells(Mesh *mesh)
-{
-  const Vector3& min = aabbSplit_.min_;
-  const Vector3& max = aabbSplit_.max_;
-  Vector3 center = (max+min)/2;
-  float deltaX = (max.x()-min.x())/2;
-  float deltaY = (max.y()-min.y())/2;
-  float deltaZ = (max.z()-min.z())/2;
-  int nextDepth = depth_+1;
-  child_[0] = new Octree(this,nextDepth);
-  child_[0]->build(mesh, iTris_, Aabb(min, center));
-  child_[1] = new Octree(this,nextDepth);
-  child_[1]->build(mesh, iTris_, Aabb(Vector3(min.x()+deltaX,min.y(),min.z()),Vector3(center.x()+deltaX,center.y(),center.z())));
-  child_[2] = new Octree(this,nextDepth);
-  child_[2]->build(mesh, iTris_, Aabb(Vector3(center.x(),center.y()-deltaY,center.z()),Vector3(max.x(),max.y()-deltaY,max.z())));
-  child_[3] = new Octree(this,nextDepth);
-  child_[3]->build(mesh, iTris_, Aabb(Vector3(min.x(),min.y(),min.z()+deltaZ),Vector3(center.x(),center.y(),center.z()+deltaZ)));
-  child_[4] = new Octree(this,nextDepth);
-  child_[4]->build(mesh, iTris_, Aabb(Vector3(min.x(),min.y()+deltaY,min.z()),Vector3(center.x(),center.y()+deltaY,center.z())));
-  child_[5] = new Octree(this,nextDepth);
-  child_[5]->build(mesh, iTris_, Aabb(Vector3(center.x(),center.y(),center.z()-deltaZ),Vector3(max.x(),max.y(),max.z()-deltaZ)));
-  child_[6] = new Octree(this,nextDepth);
-  child_[6]->build(mesh, iTris_, Aabb(center,max));
-  child_[7] = new Octree(this,nextDepth);
-  child_[7]->build(mesh, iTris_, Aabb(Vector3(center.x()-deltaX,center.y(),center.z()),Vector3(max.x()-deltaX,max.y(),max.z())));
-  iTris_.clear();
-}
-
-/** Draw the octree */
-void Octree::draw() const
-{
-  glColor3f(0, 1, 0);
-  aabbSplit_.draw();
-  glColor3f(1, 0, 0);
-  aabbLoose_.draw();
-  if (child_[0]!=0)
-    for (int i=0;i<8;++i)
-      child_[i]->draw();
+/** Identity of the cells, changes when the octree is rebuilt */
+int Octree::getId() const
+{
+  return id_;
+}
+
+/** Version of the cells, changes whenever a cell is split, cut or its loose aabb grows */
+uint64_t Octree::getVersion() const
+{
+  return stamp_;
 }
 
 /** Return triangles in cells hit by a ray */
-void Octree::intersectRay(const Vector3& vert, const Vector3& dir, std::vector<int>& trisHit) const {
-  if(aabbLoose_.intersectRay(vert,dir)) {
-    if (child_[0]!=0) {
-      for (int i=0;i<8;++i) {
-        child_[i]->intersectRay(vert, dir, trisHit);
+void Octree::intersectRay(const Vector3& vert, const Vector3& dir, std::vector<int>& trisHit) const
+{
+  int stack[8*(maxDepth_+1)];
+  int nbStack = 0;
+  stack[nbStack++] = 0;
+  while(nbStack)
+  {
+    int iNode = stack[--nbStack];
+    const Node &node = nodes_[iNode];
+    if(!node.aabbLoose_.intersectRay(vert,dir))
+      continue;
+    if(node.child_!=-1)
+    {
+      for(int i=7;i>=0;--i)
+        stack[nbStack++] = node.child_+i;
+    }
+    else
+    {
+      Adjacency::Range iTris = leafTris_[iNode];
+      trisHit.insert(trisHit.end(), iTris.begin(), iTris.end());
+    }
+  }
+}
+
+/** Closest triangle hit by the segment [start, end] (-1 if none) */
+int Octree::intersectRayClosest(const Mesh *mesh, const Vector3& start, const Vector3& end, Vector3& vertInter) const
+{
+  return traverseRay(mesh, start, end, false, vertInter);
+}
+
+/** Return true if any triangle is hit by the segment [start, end] */
+bool Octree::intersectRayAny(const Mesh *mesh, const Vector3& start, const Vector3& end) const
+{
+  Vector3 vertInter;
+  return traverseRay(mesh, start, end, true, vertInter)!=-1;
+}
+
+/**
+* Segment traversal
+* The children are visited front to back (by entry distance of their loose box) and
+* a node is skipped as soon as the best hit is closer than its entry point
+*/
+int Octree::traverseRay(const Mesh *mesh, const Vector3& start, const Vector3& end, bool anyHit, Vector3& vertInter) const
+{
+  const VertexVector &vertices = mesh->getVertices();
+  const TriangleVector &triangles = mesh->getTriangles();
+  Vector3 dir = end-start;
+  float lengthSquared = dir.squaredNorm();
+  float tNear = 0.0f;
+  if(lengthSquared==0.0f || !nodes_[0].aabbLoose_.intersectSegment(start, dir, tNear))
+    return -1;
+  int iTriHit = -1;
+  float tHit = std::numeric_limits<float>::max();
+  std::pair<float, int> stack[8*(maxDepth_+1)];
+  int nbStack = 0;
+  stack[nbStack++] = std::make_pair(tNear, 0);
+  while(nbStack)
+  {
+    --nbStack;
+    if(stack[nbStack].first>tHit)
+      continue;
+    const int iNode = stack[nbStack].second;
+    const Node &node = nodes_[iNode];
+    if(node.child_!=-1)
+    {
+      std::pair<float, int> childrenHit[8];
+      int nbChildrenHit = 0;
+      for(int i=0;i<8;++i)
+      {
+        if(nodes_[node.child_+i].aabbLoose_.intersectSegment(start, dir, tNear) && tNear<=tHit)
+          childrenHit[nbChildrenHit++] = std::make_pair(tNear, node.child_+i);
+      }
+      std::sort(childrenHit, childrenHit+nbChildrenHit, std::greater<std::pair<float, int> >()); //nearest on top of the stack
+      for(int i=0;i<nbChildrenHit;++i)
+        stack[nbStack++] = childrenHit[i];
+      continue;
+    }
+    Adjacency::Range iTris = leafTris_[iNode];
+    int nbTris = iTris.size();
+    for(int i=0;i<nbTris;++i)
+    {
+      const Triangle &t = triangles[iTris[i]];
+      Vector3 inter;
+      if(!Geometry::intersectionRayTriangle(start, end, vertices[t.vIndices_[0]], vertices[t.vIndices_[1]], vertices[t.vIndices_[2]], t.normal_, inter))
+        continue;
+      float tInter = (inter-start).dot(dir)/lengthSquared;
+      if(tInter<tHit)
+      {
+        tHit = tInter;
+        iTriHit = iTris[i];
+        vertInter = inter;
+        if(anyHit)
+          return iTriHit;
       }
-    } else {
-      trisHit.insert(trisHit.end(), iTris_.begin(), iTris_.end());
     }
   }
+  return iTriHit;
 }
 
-/** Return triangles inside a sphere */
-void Octree::intersectSphere(const Vector3& vert, float radiusSquared, std::vector<Octree*> &leavesHit, std::vector<int>& trisHit) {
-  if(aabbLoose_.intersectSphere(vert,radiusSquared)) {
-    if (child_[0]!=0) {
-      for (int i=0;i<8;++i) {
-        child_[i]->intersectSphere(vert, radiusSquared,leavesHit, trisHit);
+/** Closest triangle hit by each segment of a packet (-1 if none) and its parameter on the segment */
+void Octree::intersectRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, int *iTrisHit, float *tHit) const
+{
+  for(int i=0;i<Geometry::RAY_PACKET_SIZE;++i)
+  {
+    iTrisHit[i] = -1;
+    tHit[i] = 1.0f;
+  }
+  traverseRayPacket(mesh, packet, tHit, iTrisHit, 0);
+}
+
+/** All the triangles hit by each segment of a packet (parameter on the segment, triangle) */
+void Octree::intersectRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, std::vector<std::pair<float, int> > *hits) const
+{
+  float tMax[Geometry::RAY_PACKET_SIZE];
+  for(int i=0;i<Geometry::RAY_PACKET_SIZE;++i)
+    tMax[i] = 1.0f;
+  traverseRayPacket(mesh, packet, tMax, 0, hits);
+}
+
+/**
+* Packet traversal
+* A node is visited if one of the segments enters it before its current tMax, the
+* triangles of a leaf are tested against the whole packet at once. If hits is null
+* only the closest hit is kept and tMax shrinks as the segments hit triangles
+*/
+void Octree::traverseRayPacket(const Mesh *mesh, const Geometry::RayPacket& packet, float *tMax, int *iTrisHit, std::vector<std::pair<float, int> > *hits) const
+{
+  const VertexVector &vertices = mesh->getVertices();
+  const TriangleVector &triangles = mesh->getTriangles();
+  int stack[8*(maxDepth_+1)];
+  int nbStack = 0;
+  stack[nbStack++] = 0;
+  while(nbStack)
+  {
+    const int iNode = stack[--nbStack];
+    const Node &node = nodes_[iNode];
+    if(!Geometry::intersectionRaysAabb(packet, node.aabbLoose_, tMax))
+      continue;
+    if(node.child_!=-1)
+    {
+      for(int i=7;i>=0;--i)
+        stack[nbStack++] = node.child_+i;
+      continue;
+    }
+    Adjacency::Range iTris = leafTris_[iNode];
+    int nbTris = iTris.size();
+    for(int i=0;i<nbTris;++i)
+    {
+      const Triangle &t = triangles[iTris[i]];
+      float tInter[Geometry::RAY_PACKET_SIZE];
+      int mask = Geometry::intersectionRaysTriangle(packet, vertices[t.vIndices_[0]], vertices[t.vIndices_[1]], vertices[t.vIndices_[2]], tInter);
+      for(int j=0;mask;++j, mask>>=1)
+      {
+        if(!(mask & 1))
+          continue;
+        if(hits)
+          hits[j].push_back(std::make_pair(tInter[j], iTris[i]));
+        else if(tInter[j]<tMax[j])
+        {
+          tMax[j] = tInter[j];
+          iTrisHit[j] = iTris[i];
+        }
       }
-    } else {
-      leavesHit.push_back(this);
-      trisHit.insert(trisHit.end(), iTris_.begin(), iTris_.end());
     }
   }
 }
 
-/** Add triangle in the octree, subdivide the cell if necessary */
-void Octree::addTriangle(Mesh *mesh, Triangle &tri)
+/** Return triangles inside a sphere */
+void Octree::intersectSphere(const Vector3& vert, float radiusSquared, std::vector<int> &leavesHit, std::vector<int>& trisHit) const
 {
-  if (aabbSplit_.pointInside(tri.aabb_.getCenter()))
+  int stack[8*(maxDepth_+1)];
+  int nbStack = 0;
+  stack[nbStack++] = 0;
+  while(nbStack)
   {
-    aabbLoose_.expand(tri.aabb_);
-    if (child_[0]!=0)
+    int iNode = stack[--nbStack];
+    const Node &node = nodes_[iNode];
+    if(!node.aabbLoose_.intersectSphere(vert,radiusSquared))
+      continue;
+    if(node.child_!=-1)
     {
-      for (int i=0;i<8;++i)
-        child_[i]->addTriangle(mesh,tri);
+      for(int i=7;i>=0;--i)
+        stack[nbStack++] = node.child_+i;
     }
     else
     {
-      tri.posInLeaf_ = iTris_.size();
-      tri.leaf_ = this;
-      iTris_.push_back(tri.id_);
+      leavesHit.push_back(iNode);
+      Adjacency::Range iTris = leafTris_[iNode];
+      trisHit.insert(trisHit.end(), iTris.begin(), iTris.end());
+    }
+  }
+}
+
+/**
+* Return triangles inside a sphere, reusing the leaves of a previous query.
+* As long as the sphere stays inside the cached region and no node has been split or
+* cut, the leaves intersecting the sphere are either cached or have a loose aabb that
+* grew since : only the nodes stamped after the cache are traversed. Otherwise a new
+* (larger) region is cached with a full traversal. Only the cache is written, so
+* queries with their own caches can run concurrently.
+*/
+void Octree::intersectSphere(SphereQueryCache &cache, const Vector3& vert, float radiusSquared, std::vector<int> &leavesHit, std::vector<int>& trisHit) const
+{
+  float radius = sqrtf(radiusSquared);
+  if(cache.octreeId_!=id_ || cache.structureStamp_!=structureStamp_ || (vert-cache.center_).norm()+radius > cache.radius_)
+  {
+    cache.center_ = vert;
+    cache.radius_ = radius*(1.0f+sphereCacheMargin_);
+    cache.octreeId_ = id_;
+    cache.structureStamp_ = structureStamp_;
+    cache.leaves_.clear();
+    collectLeaves(cache.center_, cache.radius_*cache.radius_, 0, cache.leaves_);
+  }
+  else
+  {
+    collectLeaves(cache.center_, cache.radius_*cache.radius_, cache.stamp_+1, cache.leaves_);
+    Tools::tidy(cache.leaves_);
+  }
+  cache.stamp_ = stamp_;
+  int nbLeaves = cache.leaves_.size();
+  for(int i=0;i<nbLeaves;++i)
+  {
+    int iLeaf = cache.leaves_[i];
+    if(!nodes_[iLeaf].aabbLoose_.intersectSphere(vert,radiusSquared))
+      continue;
+    leavesHit.push_back(iLeaf);
+    Adjacency::Range iTris = leafTris_[iLeaf];
+    trisHit.insert(trisHit.end(), iTris.begin(), iTris.end());
+  }
+}
+
+/** Leaves intersecting a sphere, only through the nodes stamped minStamp or later */
+void Octree::collectLeaves(const Vector3& vert, float radiusSquared, uint64_t minStamp, std::vector<int> &leaves) const
+{
+  int stack[8*(maxDepth_+1)];
+  int nbStack = 0;
+  stack[nbStack++] = 0;
+  while(nbStack)
+  {
+    int iNode = stack[--nbStack];
+    const Node &node = nodes_[iNode];
+    if(node.stamp_<minStamp || !node.aabbLoose_.intersectSphere(vert,radiusSquared))
+      continue;
+    if(node.child_!=-1)
+    {
+      for(int i=7;i>=0;--i)
+        stack[nbStack++] = node.child_+i;
     }
+    else
+      leaves.push_back(iNode);
+  }
+}
+
+/**
+* Stamp a node and its ancestors as modified. Every change gets a new stamp, so that it
+* is newer than the stamp recorded by any query done before it.
+*/
+void Octree::markChanged(int iNode)
+{
+  ++stamp_;
+  while(iNode!=-1)
+  {
+    nodes_[iNode].stamp_ = stamp_;
+    iNode = nodes_[iNode].parent_;
+  }
+}
+
+/** Add triangle in the octree (the cells are subdivided later, see checkLeaves) */
+void Octree::addTriangle(Triangle &tri)
+{
+  Vector3 center = tri.aabb_.getCenter();
+  int iNode = 0;
+  nodes_[0].aabbLoose_.expand(tri.aabb_);
+  while(nodes_[iNode].child_!=-1)
+  {
+    iNode = nodes_[iNode].child_+getOctant(nodes_[iNode].aabbSplit_, center);
+    nodes_[iNode].aabbLoose_.expand(tri.aabb_);
+  }
+  markChanged(iNode);
+  addTriangle(iNode, tri);
+}
+
+/** Add triangle at the end of a leaf */
+void Octree::addTriangle(int iLeaf, Triangle &tri)
+{
+  tri.leaf_ = iLeaf;
+  tri.posInLeaf_ = leafTris_.size(iLeaf);
+  leafTris_.add(iLeaf, tri.id_);
+}
+
+/** Remove triangle from its leaf (the last triangle of the leaf takes its place) */
+void Octree::removeTriangle(TriangleVector &triangles, const Triangle &tri)
+{
+  int iLeaf = tri.leaf_;
+  int iPos = tri.posInLeaf_;
+  Adjacency::Range iTris = leafTris_[iLeaf];
+  int iTriLast = iTris.back();
+  leafTris_.removeAt(iLeaf, iPos);
+  if(iTriLast!=tri.id_)
+    triangles[iTriLast].posInLeaf_ = iPos;
+}
+
+/** The triangle has a new index */
+void Octree::renameTriangle(const Triangle &tri, int iTriNew)
+{
+  leafTris_.set(tri.leaf_, tri.posInLeaf_, iTriNew);
+}
+
+/** Expand the loose aabb of a node and its ancestors */
+void Octree::expandLoose(int iNode, const Aabb &aabb)
+{
+  if(iNode!=-1 && !aabb.isInside(nodes_[iNode].aabbLoose_))
+    markChanged(iNode);
+  while(iNode!=-1 && !aabb.isInside(nodes_[iNode].aabbLoose_))
+  {
+    nodes_[iNode].aabbLoose_.expand(aabb);
+    iNode = nodes_[iNode].parent_;
+  }
+}
+
+/** End of stroke, cut empty leaves or go deeper if needed */
+void Octree::checkLeaves(Mesh *mesh, std::vector<int> &leaves)
+{
+  Tools::tidy(leaves);
+  int nbLeaves = leaves.size();
+  int nbNodes = nodes_.size();
+  for(int i=0;i<nbLeaves;++i)
+  {
+    int iLeaf = leaves[i];
+    if(iLeaf<0 || iLeaf>=nbNodes || nodes_[iLeaf].depth_<0 || nodes_[iLeaf].child_!=-1)
+      continue; //cut or split since the query
+    int nbTris = getNbTriangles(iLeaf);
+    if(nbTris==0)
+      checkEmptiness(iLeaf);
+    else if(nbTris > maxTriangles_ && nodes_[iLeaf].depth_ < maxDepth_)
+      constructCells(mesh, iLeaf);
   }
+  freeChildren_.insert(freeChildren_.end(), cutChildren_.begin(), cutChildren_.end());
+  cutChildren_.clear();
+  structureStamp_ = ++stamp_;
 }
 
-/** Cut leaves if needed */
-void Octree::checkEmptiness(Octree* leaf, std::vector<Octree*> &cutLeaves)
+/** Cut the children of the parent if they are all empty leaves, and so on up to the root */
+void Octree::checkEmptiness(int iLeaf)
 {
-  Octree* parent = leaf->getParent();
-  if(parent)
+  int iParent = nodes_[iLeaf].parent_;
+  while(iParent!=-1)
   {
-    Octree **child=parent->getChildren();
+    int iChild = nodes_[iParent].child_;
     for(int i=0;i<8;++i)
-      if(child[i]->getTriangles().size() || child[i]->getChildren()[0]!=0)
+      if(getNbTriangles(iChild+i) || nodes_[iChild+i].child_!=-1)
         return;
-    cutLeaves.push_back(parent);
     for(int i=0;i<8;++i)
-      cutLeaves.push_back(child[i]);
-    Octree::checkEmptiness(parent,cutLeaves);
+      nodes_[iChild+i].depth_ = -1;
+    nodes_[iParent].child_ = -1;
+    cutChildren_.push_back(iChild);
+    iParent = nodes_[iParent].parent_;
   }
 }
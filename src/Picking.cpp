@@ -29,35 +29,7 @@ void Picking::intersectionRayMesh(Mesh *mesh, const Vector3& vertexNear, const V
 {
   mesh_ = 0;
   pickedTriangle_ = -1;
-  VertexVector &vertices = mesh->getVertices();
-  TriangleVector &triangles = mesh->getTriangles();
-  std::vector<int> iTrisCandidates;
-  mesh->getOctree()->intersectRay(vertexNear,(vertexFar-vertexNear).normalized(), iTrisCandidates);
-  float distance = std::numeric_limits<float>::max();
-  int nbTrisCandidates = iTrisCandidates.size();
-#pragma omp parallel for
-  for (int i = 0; i<nbTrisCandidates; ++i)
-  {
-    Vector3 vertInter(Vector3::Zero());
-    Triangle &t=triangles[iTrisCandidates[i]];
-    if (Geometry::intersectionRayTriangle(vertexNear, vertexFar,
-      vertices[t.vIndices_[0]],
-      vertices[t.vIndices_[1]],
-      vertices[t.vIndices_[2]],
-      t.normal_, vertInter))
-    {
-      float testDistance = (vertexNear-vertInter).squaredNorm();
-#pragma omp critical
-      {
-        if (testDistance<distance)
-        {
-          distance=testDistance;
-          intersectionPoint_ = vertInter;
-          pickedTriangle_ = iTrisCandidates[i];
-        }
-      }
-    }
-  }
+  pickedTriangle_ = mesh->getOctree()->intersectRayClosest(mesh, vertexNear, vertexFar, intersectionPoint_);
   if(pickedTriangle_!=-1)
   {
     mesh_ = mesh;
@@ -77,22 +49,18 @@ void Picking::setPickedVerticesInsideSphere(float radiusWorldSquared)
 {
   pickedVertices_.clear();
   VertexVector &vertices = mesh_->getVertices();
-  std::vector<Octree*> &leavesHit = mesh_->getLeavesUpdate();
+  std::vector<int> &leavesHit = mesh_->getLeavesUpdate();
   std::vector<int> iTrisInCells;
   mesh_->getOctree()->intersectSphere(intersectionPoint_,radiusWorldSquared,leavesHit,iTrisInCells);
   std::vector<int> iVerts;
-  mesh_->getVerticesFromTriangles(iTrisInCells, iVerts);
+  mesh_->getVerticesFromTriangles(iTrisInCells, iVerts, visitation_);
   int nbVerts = iVerts.size();
-  ++Vertex::sculptMask_;
   for (int i=0;i<nbVerts;++i)
   {
     Vertex &v=vertices[iVerts[i]];
     float distSquared = (v-intersectionPoint_).squaredNorm();
     if(distSquared<radiusWorldSquared)
-    {
-      v.sculptFlag_ = Vertex::sculptMask_;
       pickedVertices_.push_back(iVerts[i]);
-    }
   }
   if(pickedVertices_.empty() && pickedTriangle_!=-1) //no vertices inside the brush radius (big triangle or small radius)
   {
@@ -0,0 +1,169 @@
+#include "StdAfx.h"
+#include "ReplayHarness.h"
+#include "SculptLog.h"
+#include "Sculpt.h"
+#include "Mesh.h"
+#include "Files.h"
+#include <algorithm>
+#include <fstream>
+
+/** Constructor */
+ReplayHarness::ReplayHarness() : totalMs_(0.0)
+{}
+
+/** Destructor */
+ReplayHarness::~ReplayHarness()
+{}
+
+/** Replay a log on a mesh (modified in place) */
+bool ReplayHarness::run(Mesh *mesh, const std::string& logFilename)
+{
+  timings_.clear();
+  totalMs_ = 0.0;
+  SculptLog log;
+  if (!mesh || !log.openRead(logFilename)) {
+    return false;
+  }
+
+  // the reloaded mesh was normalized again, the brushes follow its new scale
+  const float brushScale = mesh->getScale()/log.getMeshScale();
+  Sculpt sculpt;
+  sculpt.setMesh(mesh);
+  mesh->startPushState();
+  SculptLog::Frame frame;
+  while (log.read(frame)) {
+    // same order as the sculpting thread : settings, spin of the mesh, then the brushes
+    sculpt.setSculptMode(static_cast<Sculpt::SculptMode>(frame.sculptMode_));
+    sculpt.setTopoMode(static_cast<Sculpt::TopoMode>(frame.topoMode_));
+    sculpt.setMaterialColor(frame.materialColor_);
+    Sculpt::setDetail(frame.detail_);
+    if (frame.remeshRadius_ > 0.0f) {
+      sculpt.setRemeshRadius(frame.remeshRadius_);
+    }
+    if (frame.smoothMeshIterations_ > 0) {
+      sculpt.setSmoothMesh(frame.smoothMeshIterations_);
+    }
+    if (frame.undo_) {
+      mesh->undo();
+    }
+    if (frame.redo_) {
+      mesh->redo();
+    }
+    mesh->setRotationVelocity(frame.rotationVelocity_);
+    mesh->updateRotation(frame.time_);
+    for (size_t i=0; i<frame.brushes_.size(); ++i) {
+      Brush &brush = frame.brushes_[i];
+      brush._radius *= brushScale;
+      brush._radius_squared = brush._radius*brush._radius;
+      brush._length *= brushScale;
+      brush._position *= brushScale;
+      brush._velocity *= brushScale;
+      brush._worldPos *= brushScale;
+    }
+    sculpt.setBrushes(frame.brushes_);
+    sculpt.applyBrushes(frame.time_, 0);
+
+    FrameTiming timing;
+    timing.frame_ = static_cast<int>(timings_.size());
+    timing.time_ = frame.time_;
+    timing.nbBrushes_ = static_cast<int>(frame.brushes_.size());
+    timing.sculptMs_ = sculpt.getLastSculptDuration();
+    timing.nbTriangles_ = mesh->getNbTriangles();
+    timing.nbVertices_ = mesh->getNbVertices();
+    timings_.push_back(timing);
+    totalMs_ += timing.sculptMs_;
+  }
+  return true;
+}
+
+/** Load a mesh (ply, obj or stl) and replay a log on it */
+bool ReplayHarness::run(const std::string& meshFilename, const std::string& logFilename)
+{
+  Files files;
+  Mesh *mesh = 0;
+  const std::string ext = meshFilename.substr(std::min(meshFilename.size(), meshFilename.rfind('.') + 1));
+  try {
+    if (ext == "ply" || ext == "PLY") {
+      std::ifstream stream(meshFilename.c_str(), std::ios::in);
+      mesh = files.loadPLY(stream);
+    } else if (ext == "obj" || ext == "OBJ") {
+      std::ifstream stream(meshFilename.c_str(), std::ios::in);
+      mesh = files.loadOBJ(stream);
+    } else if (ext == "stl" || ext == "STL") {
+      std::ifstream stream(meshFilename.c_str(), std::ios::in | std::ios::binary);
+      mesh = files.loadSTL(stream);
+    }
+  } catch (...) {
+    mesh = 0;
+  }
+  const bool result = run(mesh, logFilename);
+  delete mesh;
+  return result;
+}
+
+const std::vector<ReplayHarness::FrameTiming>& ReplayHarness::getTimings() const { return timings_; }
+
+/** One line per step (csv) */
+void ReplayHarness::writeTimings(std::ostream& os) const
+{
+  os << "frame,time,brushes,sculpt_ms,triangles,vertices" << std::endl;
+  for (size_t i=0; i<timings_.size(); ++i) {
+    const FrameTiming &timing = timings_[i];
+    os << timing.frame_ << "," << timing.time_ << "," << timing.nbBrushes_ << "," << timing.sculptMs_ << ","
+       << timing.nbTriangles_ << "," << timing.nbVertices_ << std::endl;
+  }
+}
+
+/** Totals and percentiles of the step durations */
+void ReplayHarness::writeSummary(std::ostream& os) const
+{
+  const int nbFrames = static_cast<int>(timings_.size());
+  os << "frames " << nbFrames << ", total " << totalMs_ << " ms, mean " << (nbFrames > 0 ? totalMs_/nbFrames : 0.0)
+     << " ms, p50 " << getPercentile(0.5f) << " ms, p95 " << getPercentile(0.95f) << " ms, max " << getPercentile(1.0f) << " ms";
+  if (nbFrames > 0) {
+    os << ", final mesh " << timings_.back().nbTriangles_ << " triangles " << timings_.back().nbVertices_ << " vertices";
+  }
+  os << std::endl;
+}
+
+/** Duration of the step at the given percentile (0 to 1) */
+float ReplayHarness::getPercentile(float percentile) const
+{
+  if (timings_.empty()) {
+    return 0.0f;
+  }
+  std::vector<float> durations(timings_.size());
+  for (size_t i=0; i<timings_.size(); ++i) {
+    durations[i] = timings_[i].sculptMs_;
+  }
+  const int nth = std::min(static_cast<int>(percentile*(durations.size()-1) + 0.5f), static_cast<int>(durations.size())-1);
+  std::nth_element(durations.begin(), durations.begin()+nth, durations.end());
+  return durations[nth];
+}
+
+/** Command line : replay <mesh> <log> [timings.csv], the summary goes to the standard output */
+int ReplayHarness::main(int argc, char** argv)
+{
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " mesh.ply session.lmlog [timings.csv]" << std::endl;
+    return 2;
+  }
+  ReplayHarness harness;
+  if (!harness.run(argv[1], argv[2])) {
+    std::cerr << "cannot replay " << argv[2] << " on " << argv[1] << std::endl;
+    return 1;
+  }
+  if (argc > 3) {
+    std::ofstream file(argv[3]);
+    harness.writeTimings(file);
+  }
+  harness.writeSummary(std::cout);
+  return 0;
+}
+
+#if LM_HEADLESS_REPLAY
+int main(int argc, char** argv)
+{
+  return ReplayHarness::main(argc, argv);
+}
+#endif
@@ -2,8 +2,11 @@
 #include "Sculpt.h"
 #include "Utilities.h"
 #include "AutoSave.h"
+#include "SculptLog.h"
 #include <algorithm>
+#include <xmmintrin.h>
 #include <cinder/gl/gl.h>
+#include <cinder/Timer.h>
 
 float Sculpt::detail_ = 1.0f;
 float Sculpt::d2Min_ = 0.0f;
@@ -12,10 +15,13 @@ float Sculpt::d2Thickness_ = 0.0f;
 float Sculpt::d2Move_ = 0.0f;
 
 /** Constructor */
-Sculpt::Sculpt() : mesh_(0), sculptMode_(INVALID), topoMode_(ADAPTIVE), lastSculptTime_(0.0),
-  prevSculpt_(false), material_(0), materialColor_(Vector3::Ones()), autoSmoothStrength_(0.15f),
-  remeshRadius_(-1.0f), lastUpdateTime_(0.0), symmetry_(false)
-{}
+Sculpt::Sculpt() : mesh_(0), sculptMode_(INVALID), topoMode_(ADAPTIVE), prevSculpt_(false),
+  material_(0), materialColor_(Vector3::Ones()), autoSmoothStrength_(0.15f), lastSculptTime_(0.0),
+  lastUpdateTime_(0.0), remeshRadius_(-1.0f), smoothMeshIterations_(0), symmetry_(false), recycling_(false),
+  lastSculptDuration_(0.0f), log_(0)
+{
+  sculptDuration_.Update(0.0f, 0.0, 0.5f);
+}
 
 /** Destructor */
 Sculpt::~Sculpt()
@@ -70,6 +76,32 @@ void Sculpt::remesh(float remeshRadius) {
 
   mesh_->getVerticesFromTriangles(iTris, vertIndices);
   mesh_->updateMesh(iTris, vertIndices);
+  mesh_->compact();
+}
+
+/**
+* Taubin smoothing of the whole mesh, the laplacian is built once and applied
+* as a sparse product at each iteration
+*/
+void Sculpt::smoothMesh(int nbIterations) {
+  const int numVertices = mesh_->getNbVertices();
+  std::vector<int> vertIndices(numVertices);
+  for (int i=0; i<numVertices; i++) {
+    vertIndices[i] = i;
+  }
+  std::vector<int> iTris(mesh_->getNbTriangles());
+  for (int i=0; i<static_cast<int>(iTris.size()); i++) {
+    iTris[i] = i;
+  }
+
+  mesh_->startPushState();
+  mesh_->pushState(iTris,vertIndices);
+
+  Laplacian laplacian;
+  laplacian.init(mesh_, vertIndices);
+  laplacian.iterate(mesh_, nbIterations, 0.5f, -0.53f);
+
+  mesh_->updateMesh(iTris, vertIndices);
 }
 
 /**
@@ -85,8 +117,6 @@ void Sculpt::remesh(float remeshRadius) {
 */
 void Sculpt::sculptMesh(std::vector<int> &iVertsSelected, const Brush& brush)
 {
-  VertexVector &vertices = mesh_->getVertices();
-
   mesh_->getTrianglesFromVertices(iVertsSelected, iTris_);
 
   //undo-redo
@@ -116,27 +146,32 @@ void Sculpt::sculptMesh(std::vector<int> &iVertsSelected, const Brush& brush)
 
   mesh_->getVerticesFromTriangles(iTris_, iVertsSelected);
 
-  MaskMatch pred(vertices);
+  MaskMatch pred(mesh_->getSelection());
   std::vector<int>::iterator it = std::remove_if(iVertsSelected.begin(), iVertsSelected.end(), pred);
   iVertsSelected.resize(it - iVertsSelected.begin());
 
   if (!iVertsSelected.empty()) {
+    const bool autoSmooth = sculptMode_ == DEFLATE || sculptMode_ == SWEEP || sculptMode_ == PUSH || sculptMode_ == INFLATE;
+    if (autoSmooth || sculptMode_ == SMOOTH) {
+      laplacian_.init(mesh_, iVertsSelected);
+    }
+
     switch(sculptMode_) {
-    case INFLATE: draw(mesh_, iVertsSelected, brush, false); break;
-    case DEFLATE: draw(mesh_, iVertsSelected, brush, true); break;
-    case SMOOTH: smooth(mesh_, iVertsSelected, brush); break;
-    case FLATTEN: flatten(mesh_, iVertsSelected, brush); break;
-    case SWEEP: sweep(mesh_, iVertsSelected, brush); break;
-    case PUSH: push(mesh_, iVertsSelected, brush); break;
-    case PAINT: paint(mesh_, iVertsSelected, brush, materialColor_); break;
-    case CREASE: crease(mesh_, iVertsSelected, brush); break;
+    case INFLATE: draw(mesh_, iVertsSelected, brush, strengths_, false); break;
+    case DEFLATE: draw(mesh_, iVertsSelected, brush, strengths_, true); break;
+    case SMOOTH: smooth(mesh_, laplacian_, brush); break;
+    case FLATTEN: flatten(mesh_, iVertsSelected, brush, strengths_); break;
+    case SWEEP: sweep(mesh_, iVertsSelected, brush, strengths_); break;
+    case PUSH: push(mesh_, iVertsSelected, brush, strengths_); break;
+    case PAINT: paint(mesh_, iVertsSelected, brush, materialColor_, strengths_); break;
+    case CREASE: crease(mesh_, iVertsSelected, brush, strengths_); break;
     default: break;
     }
 
-    if (sculptMode_ == DEFLATE || sculptMode_ == SWEEP || sculptMode_ == PUSH || sculptMode_ == INFLATE) {
+    if (autoSmooth) {
       Brush autoSmoothBrush(brush);
       autoSmoothBrush._strength *= autoSmoothStrength_;
-      smooth(mesh_, iVertsSelected, autoSmoothBrush);
+      smooth(mesh_, laplacian_, autoSmoothBrush);
     }
   }
 
@@ -151,22 +186,23 @@ void Sculpt::sculptMesh(std::vector<int> &iVertsSelected, const Brush& brush)
   mesh_->updateMesh(iTris_,iVertsSelected);
 }
 
-/** Smooth a group of vertices. New position is given by simple averaging */
-void Sculpt::smooth(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, bool limit)
+/** Smooth the region of a laplacian operator (its vertices may have moved since it was built) */
+void Sculpt::smooth(Mesh* mesh, Laplacian &laplacian, const Brush& brush, bool limit)
 {
   VertexVector &vertices = mesh->getVertices();
-  int nbVerts = iVerts.size();
-  Vector3Vector smoothVerts(nbVerts, Vector3::Zero());
-  Vector3Vector smoothColors(nbVerts, Vector3::Zero());
-  laplacianSmooth(mesh, iVerts, smoothVerts, smoothColors);
+  Vector3Vector &materials = mesh->getMaterials();
+  const std::vector<int> &iVerts = laplacian.getVertices();
+  int nbVerts = laplacian.getNbVertices();
+  Vector3Vector smoothVerts;
+  Vector3Vector smoothColors;
+  laplacian.average(mesh, smoothVerts, smoothColors);
 
   float dMove = sqrtf(d2Move_);
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &vert = vertices[iVerts[i]];
     Vector3 displ = (smoothVerts[i]-vert)*brush._strength;
-    vert.material_ = brush._strength*smoothColors[i] + (1.0f-brush._strength)*vert.material_;
+    Vector3 &material = materials[iVerts[i]];
+    material = brush._strength*smoothColors[i] + (1.0f-brush._strength)*material;
     if (limit) {
       float displLength = displ.squaredNorm();
       if (displLength >= d2Move_) {
@@ -174,28 +210,28 @@ void Sculpt::smooth(Mesh* mesh, const std::vector<int> &iVerts, const Brush& bru
       }
     }
     vert += displ;
-  }
+  });
 }
 
-/** Smooth a group of vertices along the plane defined by the normal of the vertex */
-void Sculpt::smoothFlat(Mesh* mesh, const std::vector<int> &iVerts)
+/** Smooth the region of a laplacian operator along the plane defined by the normal of the vertex */
+void Sculpt::smoothFlat(Mesh* mesh, Laplacian &laplacian)
 {
   VertexVector &vertices = mesh->getVertices();
-  int nbVerts = iVerts.size();
-  Vector3Vector smoothVerts(nbVerts, Vector3::Zero());
-  Vector3Vector smoothColors(nbVerts, Vector3::Zero());
-  laplacianSmooth(mesh, iVerts,smoothVerts, smoothColors);
-
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  Vector3Vector &materials = mesh->getMaterials();
+  const std::vector<int> &iVerts = laplacian.getVertices();
+  int nbVerts = laplacian.getNbVertices();
+  Vector3Vector smoothVerts;
+  Vector3Vector smoothColors;
+  laplacian.average(mesh, smoothVerts, smoothColors);
+
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &vert = vertices[iVerts[i]];
     Vector3& vertSmo = smoothVerts[i];
     Vector3& n = vert.normal_;
     float dot = n.dot(vertSmo-vert);
     vert += (vertSmo - dot*n - vert);
-    vert.material_ = smoothColors[i];
-  }
+    materials[iVerts[i]] = smoothColors[i];
+  });
 }
 
 /**
@@ -203,19 +239,71 @@ void Sculpt::smoothFlat(Mesh* mesh, const std::vector<int> &iVerts)
 * representative of all the sculpting vertices. I couldn't come up with a good
 * falloff function, so it's just something that fall off strongly at the border of brush radius
 */
-void Sculpt::draw(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, bool negate)
+void Sculpt::draw(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths, bool negate)
 {
   VertexVector &vertices = mesh->getVertices();
   int nbVerts = iVerts.size();
   const float dMove = std::sqrt(d2Move_);
   const float deformationIntensity = brush._radius*0.05f;
   const float negationFactor = negate ? -1.0f : 1.0f;
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  computeStrengths(vertices, iVerts, brush, strengths);
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &vert=vertices[iVerts[i]];
-    const float strength = brush.strengthAt(vert);
+    const float strength = strengths[i];
     vert += vert.normal_ * negationFactor * std::min(dMove, deformationIntensity*strength);
+  });
+}
+
+/**
+* Strength of the brush at each vertex (see Brush::strengthAt). The positions are
+* gathered by blocks of 4 so that the distance and the falloff are computed with SSE,
+* the last nbVerts%4 vertices go through the same formula in scalar. The brush is a sphere
+* here, as in Brush::distanceSq. The buffer belongs to the caller (see strengths_), so its
+* storage is reused by the next samples.
+* There is no 8-wide AVX2 path : VS2010 has no AVX2 intrinsics, and the positions would still
+* be gathered one by one from the vertex records.
+*/
+void Sculpt::computeStrengths(const VertexVector &vertices, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths)
+{
+  int nbVerts = iVerts.size();
+  strengths.resize(nbVerts);
+  const __m128 posX = _mm_set1_ps(brush._position.x());
+  const __m128 posY = _mm_set1_ps(brush._position.y());
+  const __m128 posZ = _mm_set1_ps(brush._position.z());
+  const __m128 invRadius = _mm_set1_ps(1.0f/brush._radius);
+  const __m128 strength = _mm_set1_ps(brush._strength);
+  const __m128 three = _mm_set1_ps(3.0f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const int nbBlocks = nbVerts/4;
+  ThreadPool::parallelFor(0, nbBlocks, [&](int b) {
+    const int first = 4*b;
+    float x[4], y[4], z[4];
+    for (int j = 0; j<4; ++j)
+    {
+      const Vertex &v = vertices[iVerts[first+j]];
+      x[j] = v.x();
+      y[j] = v.y();
+      z[j] = v.z();
+    }
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x), posX);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y), posY);
+    const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z), posZ);
+    const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    const __m128 t = _mm_mul_ps(_mm_sqrt_ps(distSq), invRadius);
+    const __m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    //falloff : 3t^4 - 4t^3 + 1 = t^3*(3t - 4) + 1
+    const __m128 falloff = _mm_add_ps(_mm_mul_ps(t3, _mm_sub_ps(_mm_mul_ps(three, t), four)), one);
+    _mm_storeu_ps(&strengths[first], _mm_mul_ps(strength, falloff));
+  });
+  for (int i = 4*nbBlocks; i<nbVerts; ++i)
+  {
+    const Vertex &v = vertices[iVerts[i]];
+    const float dx = v.x()-brush._position.x();
+    const float dy = v.y()-brush._position.y();
+    const float dz = v.z()-brush._position.z();
+    const float t = std::sqrt(dx*dx+dy*dy+dz*dz)*(1.0f/brush._radius);
+    strengths[i] = brush._strength*(t*t*t*(3.0f*t-4.0f)+1.0f);
   }
 }
 
@@ -224,17 +312,10 @@ Vector3 Sculpt::areaNormal(Mesh* mesh, const std::vector<int> &iVerts)
 {
   VertexVector &vertices = mesh->getVertices();
   int nbVerts = iVerts.size();
-  float areaX=0.f,areaY=0.f,areaZ=0.f;
-#pragma omp parallel for reduction(+:areaX,areaY,areaZ)
-  for (int i = 0; i<nbVerts; ++i)
-  {
-    const Vector3& normal = vertices[iVerts[i]].normal_;
-    areaX+=normal.x();
-    areaY+=normal.y();
-    areaZ+=normal.z();
-  }
+  Vector3 result = ThreadPool::parallelReduce(0, nbVerts, Vector3(Vector3::Zero()), [&](int i, Vector3 &area) {
+    area += vertices[iVerts[i]].normal_;
+  }, std::plus<Vector3>());
   LM_ASSERT(nbVerts > 0, "Not enough points");
-  Vector3 result(areaX, areaY, areaZ);
   float length = result.norm();
   if (length == 0.0f) {
     return Vector3::Zero();
@@ -247,24 +328,18 @@ Vector3 Sculpt::areaCenter(Mesh* mesh, const std::vector<int> &iVerts)
 {
   VertexVector &vertices = mesh->getVertices();
   int nbVerts = iVerts.size();
-  float areaX=0.f,areaY=0.f,areaZ=0.f;
-#pragma omp parallel for reduction(+:areaX,areaY,areaZ)
-  for (int i = 0; i<nbVerts; ++i)
-  {
-    Vertex &v = vertices[iVerts[i]];
-    areaX+=v.x();
-    areaY+=v.y();
-    areaZ+=v.z();
-  }
+  Vector3 sum = ThreadPool::parallelReduce(0, nbVerts, Vector3(Vector3::Zero()), [&](int i, Vector3 &area) {
+    area += vertices[iVerts[i]];
+  }, std::plus<Vector3>());
   LM_ASSERT(nbVerts > 0, "Not enough points");
-  return Vector3(areaX,areaY,areaZ)/static_cast<float>(nbVerts);
+  return sum/static_cast<float>(nbVerts);
 }
 
 /**
 * Flattening, projection of the sculpting vertex onto a plane
 * defined by the barycenter and normals of all the sculpting vertices
 */
-void Sculpt::flatten(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush)
+void Sculpt::flatten(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths)
 {
   Vector3 areaNorm = areaNormal(mesh, iVerts);
   if(areaNorm.squaredNorm()<0.0001f)
@@ -274,67 +349,17 @@ void Sculpt::flatten(Mesh* mesh, const std::vector<int> &iVerts, const Brush& br
   int nbVerts = iVerts.size();
   float deformationIntensity = 0.3f;
   const float dMove = std::sqrt(d2Move_);
+  computeStrengths(vertices, iVerts, brush, strengths);
 
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &v = vertices[iVerts[i]];
     float distance = (v-areaPoint).dot(areaNorm);
-    v -= areaNorm * std::min(dMove, distance*deformationIntensity*brush.strengthAt(v));
-  }
-}
-
-/** Laplacian smooth. Special rule for vertex on the edge of the mesh. */
-void Sculpt::laplacianSmooth(Mesh* mesh, const std::vector<int> &iVerts, Vector3Vector &smoothVerts, Vector3Vector &smoothColors)
-{
-  VertexVector &vertices = mesh->getVertices();
-  int nbVerts = iVerts.size();
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
-    Vertex &vert = vertices[iVerts[i]];
-    const std::vector<int> &ivRing = vert.ringVertices_;
-    int nbVRing=ivRing.size();
-    if(nbVRing!=(int)vert.tIndices_.size())
-    {
-      Vector3 center(Vector3::Zero());
-      Vector3 color(Vector3::Zero());
-      int nbVertEdge = 0;
-      for(int j = 0; j<nbVRing; ++j)
-      {
-        Vertex &ivr = vertices[ivRing[j]];
-        if(ivr.tIndices_.size()!=ivr.ringVertices_.size())
-        {
-          center+=ivr;
-          ++nbVertEdge;
-          color += ivr.material_;
-        }
-      }
-      LM_ASSERT(nbVertEdge > 0, "Not enough verts");
-      if (nbVertEdge > 0) {
-        smoothVerts[i]=center/static_cast<float>(nbVertEdge);
-        smoothColors[i]=color/static_cast<float>(nbVertEdge);
-      }
-    }
-    else
-    {
-      Vector3 center(Vector3::Zero());
-      Vector3 color(Vector3::Zero());
-      for (int j=0;j<nbVRing;++j) {
-        center+=vertices[ivRing[j]];
-        color+=vertices[ivRing[j]].material_;
-      }
-      LM_ASSERT(nbVRing > 0, "Not enough verts");
-      if (nbVRing > 0) {
-        smoothVerts[i]=center/static_cast<float>(nbVRing);
-        smoothColors[i]=color/static_cast<float>(nbVRing);
-      }
-    }
-  }
+    v -= areaNorm * std::min(dMove, distance*deformationIntensity*strengths[i]);
+  });
 }
 
 /** Sweep deformation */
-void Sculpt::sweep(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush)
+void Sculpt::sweep(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths)
 {
   VertexVector &vertices = mesh->getVertices();
   int nbVerts = iVerts.size();
@@ -342,32 +367,30 @@ void Sculpt::sweep(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brus
   const float velMag = brush._velocity.norm();
   const Vector3 normalizedVel = brush._velocity / velMag;
   const float dMove = std::sqrt(d2Move_);
+  computeStrengths(vertices, iVerts, brush, strengths);
 
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &vert = vertices[iVerts[i]];
-    const float strength = brush.strengthAt(vert);
+    const float strength = strengths[i];
     vert += std::min(dMove, deformationIntensity*strength*velMag)*normalizedVel;
-  }
+  });
 }
 
-void Sculpt::push(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush)
+void Sculpt::push(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, std::vector<float> &strengths)
 {
   VertexVector &vertices = mesh->getVertices();
   int nbVerts = iVerts.size();
   const float dMove = std::sqrt(d2Move_);
   const float deformationIntensity = brush._radius*0.25f;
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
+  computeStrengths(vertices, iVerts, brush, strengths);
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex &vert = vertices[iVerts[i]];
-    const float strength = brush.strengthAt(vert);
+    const float strength = strengths[i];
     vert -= std::min(dMove, deformationIntensity*strength)*brush._direction;
-  }
+  });
 }
 
-void Sculpt::crease(Mesh* mesh, const std::vector<int>& iVerts, const Brush& brush) {
+void Sculpt::crease(Mesh* mesh, const std::vector<int>& iVerts, const Brush& brush, std::vector<float> &strengths) {
   const Vector3 areaNorm = areaNormal(mesh, iVerts);
   if(areaNorm.squaredNorm()<0.0001f)
     return;
@@ -376,10 +399,11 @@ void Sculpt::crease(Mesh* mesh, const std::vector<int>& iVerts, const Brush& bru
   const float dMove = std::sqrt(d2Move_);
   const float normalFactor = 30.0f;
   const Vector3& center = brush._position;
+  computeStrengths(vertices, iVerts, brush, strengths);
 
-  for (int i = 0; i < nbVerts; ++i) {
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
     Vertex& vert = vertices[iVerts[i]];
-    const float strength = brush.strengthAt(vert);
+    const float strength = strengths[i];
     const Vector3 displ = strength * ((center - vert) + strength*strength*normalFactor*areaNorm);
     float displLength = displ.squaredNorm();
     if (displLength<=d2Move_) {
@@ -387,19 +411,19 @@ void Sculpt::crease(Mesh* mesh, const std::vector<int>& iVerts, const Brush& bru
     } else {
       vert += displ.normalized()*dMove;
     }
-  }
+  });
 }
 
-void Sculpt::paint(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, const Vector3& color) {
+void Sculpt::paint(Mesh* mesh, const std::vector<int> &iVerts, const Brush& brush, const Vector3& color, std::vector<float> &strengths) {
   VertexVector &vertices = mesh->getVertices();
+  Vector3Vector &materials = mesh->getMaterials();
   int nbVerts = iVerts.size();
-#pragma omp parallel for
-  for (int i = 0; i<nbVerts; ++i)
-  {
-    Vertex &vert=vertices[iVerts[i]];
-    const float changeSpeed = brush.strengthAt(vert);
-    vert.material_ = (1.0f-changeSpeed)*vert.material_ + changeSpeed*color;
-  }
+  computeStrengths(vertices, iVerts, brush, strengths);
+  ThreadPool::parallelFor(0, nbVerts, [&](int i) {
+    const float changeSpeed = strengths[i];
+    Vector3 &material = materials[iVerts[i]];
+    material = (1.0f-changeSpeed)*material + changeSpeed*color;
+  });
 }
 
 void Sculpt::addBrush(const Vector3& worldPos, const Vector3& pos, const Vector3& dir, const Vector3& vel, float radius, float strength, float activation)
@@ -429,17 +453,26 @@ void Sculpt::addBrush(const Vector3& worldPos, const Vector3& pos, const Vector3
 
 void Sculpt::applyBrushes(double curTime, AutoSave* autoSave)
 {
+  if (log_ && log_->isRecording()) {
+    logFrame(curTime);
+  }
   if (sculptMode_ == INVALID) {
     return;
   }
 
   static const float DESIRED_ANGLE_PER_SAMPLE = 0.02f;
 
-  std::unique_lock<std::mutex> lock(brushMutex_);
+  // measured without the app clock, a replay has no application
+  ci::Timer timer(true);
+  frameBrushes_ = _brushes;
   if (remeshRadius_ > 0) {
     remesh(remeshRadius_);
     remeshRadius_ = -1.0f;
   }
+  if (smoothMeshIterations_ > 0) {
+    smoothMesh(smoothMeshIterations_);
+    smoothMeshIterations_ = 0;
+  }
 
   const Vector3& origin = mesh_->getRotationOrigin();
   const Vector3& axis = mesh_->getRotationAxis();
@@ -453,30 +486,93 @@ void Sculpt::applyBrushes(double curTime, AutoSave* autoSave)
 
   bool haveSculpt = false;
 
-  for (size_t b=0; b<_brushes.size(); ++b) {
+  if (mesh_->isRecycling() != recycling_) {
+    mesh_->setRecycling(recycling_);
+  }
+
+  // the snapshot of the modified chunks is published once for all the samples of the frame
+  mesh_->startDeferredUpdate();
+  brushCaches_.resize(frameBrushes_.size());
+  for (size_t b=0; b<frameBrushes_.size(); ++b) {
     const int numSamples = numRotSamples;
     double sampleTime = lastUpdateTime_;
+    sampleBrushes_.clear();
     for (int i=0; i<numSamples; i++) {
       sampleTime += timePerSample;
       const Matrix4x4 transformInv = mesh_->getTransformation(sampleTime).inverse();
 
-      Brush brush = _brushes[b].transformed(transformInv).withSpinVelocity(origin, axis, rotVelocity);
+      Brush brush = frameBrushes_[b].transformed(transformInv).withSpinVelocity(origin, axis, rotVelocity);
       brush._strength *= rotStrengthMult;
+      sampleBrushes_.push_back(brush);
+    }
 
+    // when the mesh spins, a single query gathers the vertices swept by the whole motion
+    const bool swept = numSamples > 1;
+    float sampleWindow = static_cast<float>(numSamples);
+    if (swept) {
+      sweptVertices_.clear();
+      sweptTimes_.clear();
+      mesh_->flushDeferredUpdate();
+      mesh_->getVerticesInsideSweptBrush(sampleBrushes_, sweptVertices_, sweptTimes_);
+      float pathLength = 0.0f;
+      for (int i=1; i<numSamples; i++) {
+        pathLength += (sampleBrushes_[i].boundingSphereCenter() - sampleBrushes_[i-1].boundingSphereCenter()).norm();
+      }
+      const float stepLength = pathLength / (numSamples - 1);
+      if (stepLength > 0.0f) {
+        // a sample containing a vertex is less than 2 radii away from its closest approach,
+        // measured along the chord; allow a factor 2 for the arc of the rotation
+        sampleWindow = std::min(sampleWindow, 4.0f * sampleBrushes_[0].boundingSphereRadius() / stepLength + 1.0f);
+      }
+    }
+
+    for (int i=0; i<numSamples; i++) {
+      const Brush& brush = sampleBrushes_[i];
       brushVertices_.clear();
-      mesh_->getVerticesInsideBrush(brush, brushVertices_);
+      // the previous samples may have moved vertices in or out of this one
+      mesh_->flushDeferredUpdate();
+      if (swept) {
+        getSweptVerticesInsideBrush(brush, static_cast<float>(i), sampleWindow, brushVertices_);
+      } else {
+        mesh_->getVerticesInsideBrush(brush, brushVertices_, &brushCaches_[b]);
+      }
       if (!brushVertices_.empty()) {
         if (!haveSculpt && !prevSculpt_) {
           mesh_->startPushState();
         }
         haveSculpt = true;
+        const int nbVerticesBefore = mesh_->getNbVertices();
         sculptMesh(brushVertices_, brush);
+        if (swept) {
+          // vertices created by the topology only exist near the current sample
+          const int nbVertices = mesh_->getNbVertices();
+          for (int j=nbVerticesBefore; j<nbVertices; j++) {
+            sweptVertices_.push_back(j);
+            sweptTimes_.push_back(static_cast<float>(i));
+          }
+          // so do the ones created in holes, the ones decimation moved to a new index are
+          // listed again too (the brush test still applies to them)
+          const std::vector<int>& reused = topo_.getReusedVertices();
+          for (size_t j=0; j<reused.size(); j++) {
+            sweptVertices_.push_back(reused[j]);
+            sweptTimes_.push_back(static_cast<float>(i));
+          }
+          const std::vector<int>& moved = topo_.getMovedVertices();
+          for (size_t j=0; j<moved.size(); j++) {
+            sweptVertices_.push_back(moved[j]);
+            sweptTimes_.push_back(static_cast<float>(i));
+          }
+        }
       }
     }
   }
+  mesh_->endDeferredUpdate();
 
   if (!haveSculpt && prevSculpt_) {
-    autoSave->triggerAutoSave(mesh_);
+    mesh_->compact();
+    if (autoSave) {
+      autoSave->triggerAutoSave(mesh_);
+    }
     mesh_->checkLeavesUpdate();
     material_++;
   }
@@ -488,13 +584,55 @@ void Sculpt::applyBrushes(double curTime, AutoSave* autoSave)
   if (haveSculpt) {
     lastSculptTime_ = curTime;
   }
+  lastSculptDuration_ = 1000.0f*static_cast<float>(timer.getSeconds());
+  sculptDuration_.Update(lastSculptDuration_, curTime, 0.9f);
+}
+
+/** Record the inputs of the current step */
+void Sculpt::logFrame(double curTime)
+{
+  SculptLog::Frame frame;
+  frame.time_ = curTime;
+  frame.sculptMode_ = sculptMode_;
+  frame.topoMode_ = topoMode_;
+  frame.materialColor_ = materialColor_;
+  frame.detail_ = detail_;
+  frame.rotationVelocity_ = mesh_->getRotationVelocity_notSmoothed();
+  frame.remeshRadius_ = remeshRadius_;
+  frame.smoothMeshIterations_ = smoothMeshIterations_;
+  frame.undo_ = mesh_->isUndoPending();
+  frame.redo_ = mesh_->isRedoPending();
+  frame.brushes_ = _brushes;
+  log_->write(frame);
+}
+
+/** Select the swept candidates inside one sample of the brush */
+void Sculpt::getSweptVerticesInsideBrush(const Brush& brush, float sampleIndex, float sampleWindow, std::vector<int>& result)
+{
+  VertexVector &vertices = mesh_->getVertices();
+  Visitation &selection = mesh_->getSelection();
+  const int nbVertices = vertices.size();
+  const int nbCandidates = sweptVertices_.size();
+  selection.start(nbVertices);
+  for (int i=0; i<nbCandidates; i++) {
+    const int iVert = sweptVertices_[i];
+    // decimation may have removed (or renamed) candidates since the query
+    if (iVert >= nbVertices || vertices[iVert].tagFlag_ < 0 || std::fabs(sweptTimes_[i] - sampleIndex) > sampleWindow) {
+      continue;
+    }
+    if (!selection.isVisited(iVert) && brush.contains(vertices[iVert])) {
+      selection.visit(iVert);
+      result.push_back(iVert);
+    }
+  }
 }
 
-BrushVector Sculpt::getBrushes() const {
-  std::unique_lock<std::mutex> lock(brushMutex_);
-  return _brushes;
+/** Hands the current brushes to the render thread (called by the thread adding the brushes) */
+void Sculpt::publishBrushes() {
+  publishedBrushes_.write(_brushes);
 }
 
-std::mutex& Sculpt::getBrushMutex() {
-  return brushMutex_;
+/** Brushes of the last published frame, only called by the render thread */
+const BrushVector& Sculpt::getBrushes() {
+  return publishedBrushes_.read();
 }
@@ -0,0 +1,211 @@
+#include "StdAfx.h"
+#include "SculptLog.h"
+#include <stdint.h>
+#include <algorithm>
+
+/** Constructor */
+SculptLog::Frame::Frame() : time_(0.0), sculptMode_(-1), topoMode_(-1), materialColor_(Vector3::Ones()), detail_(1.0f),
+  rotationVelocity_(0.0f), remeshRadius_(-1.0f), smoothMeshIterations_(0), undo_(false), redo_(false)
+{}
+
+/** Constructor */
+SculptLog::SculptLog() : recording_(false), meshScale_(1.0f), nbFrames_(0)
+{}
+
+/** Destructor */
+SculptLog::~SculptLog()
+{
+  close();
+}
+
+/** Start a new log (replaces the file) */
+bool SculptLog::openWrite(const std::string& filename, float meshScale)
+{
+  close();
+  stream_.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!stream_) {
+    return false;
+  }
+  const unsigned int magic = magic_, version = version_;
+  put(magic);
+  put(version);
+  put(meshScale);
+  meshScale_ = meshScale;
+  recording_ = true;
+  return true;
+}
+
+/** Open a log to replay it */
+bool SculptLog::openRead(const std::string& filename)
+{
+  close();
+  stream_.open(filename.c_str(), std::ios::in | std::ios::binary);
+  unsigned int magic = 0, version = 0;
+  if (!stream_ || !get(magic) || !get(version) || magic != magic_ || version != version_ || !get(meshScale_)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+/** Close the file */
+void SculptLog::close()
+{
+  if (stream_.is_open()) {
+    stream_.close();
+  }
+  stream_.clear();
+  recording_ = false;
+  nbFrames_ = 0;
+  last_ = Frame();
+}
+
+bool SculptLog::isRecording() const { return recording_; }
+int SculptLog::getNbFrames() const { return nbFrames_; }
+float SculptLog::getMeshScale() const { return meshScale_; }
+
+/** Append a record */
+void SculptLog::write(const Frame& frame)
+{
+  if (!recording_) {
+    return;
+  }
+  uint8_t changes = 0;
+  if (nbFrames_ == 0 || frame.sculptMode_ != last_.sculptMode_ || frame.topoMode_ != last_.topoMode_) {
+    changes |= CHANGE_MODES;
+  }
+  if (nbFrames_ == 0 || frame.materialColor_ != last_.materialColor_) {
+    changes |= CHANGE_MATERIAL;
+  }
+  if (nbFrames_ == 0 || frame.detail_ != last_.detail_) {
+    changes |= CHANGE_DETAIL;
+  }
+  if (nbFrames_ == 0 || frame.rotationVelocity_ != last_.rotationVelocity_) {
+    changes |= CHANGE_ROTATION;
+  }
+  if (frame.remeshRadius_ > 0.0f) {
+    changes |= CHANGE_REMESH;
+  }
+  if (frame.smoothMeshIterations_ > 0) {
+    changes |= CHANGE_SMOOTH;
+  }
+  if (frame.undo_) {
+    changes |= CHANGE_UNDO;
+  }
+  if (frame.redo_) {
+    changes |= CHANGE_REDO;
+  }
+
+  put(changes);
+  put(frame.time_);
+  if (changes & CHANGE_MODES) {
+    put(static_cast<int8_t>(frame.sculptMode_));
+    put(static_cast<int8_t>(frame.topoMode_));
+  }
+  if (changes & CHANGE_MATERIAL) {
+    putVector(frame.materialColor_);
+  }
+  if (changes & CHANGE_DETAIL) {
+    put(frame.detail_);
+  }
+  if (changes & CHANGE_ROTATION) {
+    put(frame.rotationVelocity_);
+  }
+  if (changes & CHANGE_REMESH) {
+    put(frame.remeshRadius_);
+  }
+  if (changes & CHANGE_SMOOTH) {
+    put(static_cast<int32_t>(frame.smoothMeshIterations_));
+  }
+
+  const int nbBrushes = std::min(static_cast<int>(frame.brushes_.size()), 255);
+  put(static_cast<uint8_t>(nbBrushes));
+  for (int i=0; i<nbBrushes; ++i) {
+    const Brush &brush = frame.brushes_[i];
+    put(brush._radius);
+    put(brush._length);
+    put(brush._strength);
+    put(brush._activation);
+    putVector(brush._position);
+    putVector(brush._direction);
+    putVector(brush._velocity);
+    putVector(brush._worldPos);
+  }
+  last_ = frame;
+  ++nbFrames_;
+}
+
+/** Read the next record, false at the end of the log */
+bool SculptLog::read(Frame& frame)
+{
+  if (recording_ || !stream_.is_open()) {
+    return false;
+  }
+  uint8_t changes = 0;
+  frame = last_;
+  frame.remeshRadius_ = -1.0f;
+  frame.smoothMeshIterations_ = 0;
+  if (!get(changes) || !get(frame.time_)) {
+    return false;
+  }
+  if (changes & CHANGE_MODES) {
+    int8_t sculptMode = 0, topoMode = 0;
+    get(sculptMode);
+    get(topoMode);
+    frame.sculptMode_ = sculptMode;
+    frame.topoMode_ = topoMode;
+  }
+  if (changes & CHANGE_MATERIAL) {
+    getVector(frame.materialColor_);
+  }
+  if (changes & CHANGE_DETAIL) {
+    get(frame.detail_);
+  }
+  if (changes & CHANGE_ROTATION) {
+    get(frame.rotationVelocity_);
+  }
+  if (changes & CHANGE_REMESH) {
+    get(frame.remeshRadius_);
+  }
+  if (changes & CHANGE_SMOOTH) {
+    int32_t nbIterations = 0;
+    get(nbIterations);
+    frame.smoothMeshIterations_ = nbIterations;
+  }
+  frame.undo_ = (changes & CHANGE_UNDO) != 0;
+  frame.redo_ = (changes & CHANGE_REDO) != 0;
+
+  uint8_t nbBrushes = 0;
+  get(nbBrushes);
+  frame.brushes_.resize(nbBrushes);
+  for (int i=0; i<nbBrushes; ++i) {
+    Brush &brush = frame.brushes_[i];
+    get(brush._radius);
+    get(brush._length);
+    get(brush._strength);
+    get(brush._activation);
+    getVector(brush._position);
+    getVector(brush._direction);
+    getVector(brush._velocity);
+    getVector(brush._worldPos);
+    brush._radius_squared = brush._radius*brush._radius;
+  }
+  if (stream_.fail()) {
+    return false;
+  }
+  last_ = frame;
+  ++nbFrames_;
+  return true;
+}
+
+void SculptLog::putVector(const Vector3 &v)
+{
+  put(v.x());
+  put(v.y());
+  put(v.z());
+}
+
+bool SculptLog::getVector(Vector3 &v)
+{
+  return get(v.x()) && get(v.y()) && get(v.z());
+}
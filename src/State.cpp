@@ -1,10 +1,332 @@
 #include "StdAfx.h"
 #include "State.h"
+#include "Mesh.h"
+#include "LockFree.h"
+#include "StateFile.h"
+#include <cstring>
+
+namespace
+{
+  enum SpillStatus { SPILL_NONE, SPILL_DONE, SPILL_FAILED };
+  enum VertexChange { POSITION = 1, NORMAL = 2, MATERIAL = 4, TRIANGLES = 8, RING = 16, NB_CHANGE_BITS = 5 };
+
+  unsigned int floatBits(float value)
+  {
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  float bitsFloat(unsigned int bits)
+  {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /**
+  * Difference of the bit patterns of two vectors, returns false if they are identical.
+  * Floats of the same sign are ordered like their bit patterns, so a small move gives a
+  * small difference (in units in the last place). The unsigned arithmetic wraps instead of
+  * overflowing, and the base plus the difference gives back the value bit for bit.
+  * Against a zero base (no base element), the difference is the raw float.
+  */
+  bool difference(const Vector3 &value, const Vector3 &base, int d[3])
+  {
+    for(int i=0;i<3;++i)
+      d[i] = static_cast<int>(floatBits(value[i])-floatBits(base[i]));
+    return d[0]!=0 || d[1]!=0 || d[2]!=0;
+  }
+
+  Vector3 applyDifference(const Vector3 &base, const int *d)
+  {
+    Vector3 value;
+    for(int i=0;i<3;++i)
+      value[i] = bitsFloat(floatBits(base[i])+static_cast<unsigned int>(d[i]));
+    return value;
+  }
+
+  bool sameList(const Adjacency::Range &a, const Adjacency::Range &b)
+  {
+    return a.size()==b.size() && std::equal(a.begin(), a.end(), b.begin());
+  }
+
+  /** Size followed by the differences between consecutive indices */
+  void pushList(std::vector<int> &deltas, const Adjacency::Range &list)
+  {
+    const int nb = list.size();
+    deltas.push_back(nb);
+    int prev = 0;
+    for(int i=0;i<nb;++i)
+    {
+      deltas.push_back(list[i]-prev);
+      prev = list[i];
+    }
+  }
+
+  const int* readList(const int *deltas, std::vector<int> &list)
+  {
+    const int nb = *deltas++;
+    list.resize(nb);
+    int prev = 0;
+    for(int i=0;i<nb;++i)
+    {
+      prev += *deltas++;
+      list[i] = prev;
+    }
+    return deltas;
+  }
+}
 
 /** Constructor */
-State::State() : nbTrianglesState_(0), nbVerticesState_(0), tState_(), vState_(), aabbState_()
+State::State() : nbTrianglesState_(0), nbVerticesState_(0), tIdState_(), tIndicesState_(), vState_(), vIdState_(),
+  vMaterialState_(), vTrisState_(), vRingState_(), aabbState_(), compressRequested_(false), spillRequested_(false),
+  fileOffset_(0), nbTrianglesBase_(0), nbVerticesBase_(0), copies_(true), closed_(false),
+  nbDeltaBytes_(0), deltas_(), packed_(), nbPackedBytes_(0), file_(0), compressed_(0), spilled_(SPILL_NONE)
 {}
 
 /** Destructor */
 State::~State()
 {}
+
+/** Getters */
+bool State::isClosed() const { return closed_; }
+bool State::isCompressed() const { return LockFree::loadAcquire(compressed_)!=0; }
+bool State::hasCopies() const { return copies_; }
+bool State::isSpilled() const { return LockFree::loadAcquire(spilled_)==SPILL_DONE; }
+bool State::isSpillDone() const { return LockFree::loadAcquire(spilled_)!=SPILL_NONE; }
+bool State::isSpillFailed() const { return LockFree::loadAcquire(spilled_)==SPILL_FAILED; }
+size_t State::getNbPackedBytes() const { return nbPackedBytes_; }
+
+/** Memory used by the state (can be called while the compression or the spill runs) */
+size_t State::getNbBytes() const
+{
+  size_t nbBytes = sizeof(State);
+  if(copies_)
+  {
+    nbBytes += (tIdState_.capacity()+tIndicesState_.capacity()+vIdState_.capacity())*sizeof(int);
+    nbBytes += vState_.capacity()*sizeof(Vertex)+vMaterialState_.capacity()*sizeof(Vector3);
+    nbBytes += vTrisState_.getNbBytes()+vRingState_.getNbBytes();
+  }
+  if(isSpilled())
+    return nbBytes;
+  if(isCompressed())
+    nbBytes += nbPackedBytes_;
+  else if(closed_)
+    nbBytes += nbDeltaBytes_;
+  return nbBytes;
+}
+
+/**
+* Compute the differences between the copies and the current mesh.
+* Layout : number of triangles, then for each one (id-previousId)*2+changed followed by the
+* 3 index deltas if the triangle changed. Number of vertices, then for each one
+* (id-previousId)<<NB_CHANGE_BITS|changes followed by the changed attributes (see difference).
+* The elements that do not exist in the mesh anymore are stored relative to 0.
+*/
+void State::close(const Mesh &mesh)
+{
+  const TriangleVector &triangles = mesh.getTriangles();
+  const VertexVector &vertices = mesh.getVertices();
+  const Vector3Vector &materials = mesh.getMaterials();
+  const Adjacency &vertTris = mesh.getVerticesTriangles();
+  const Adjacency &vertRings = mesh.getVerticesRing();
+  const int noIndices[3] = {0, 0, 0};
+  const Vertex noVertex(Vector3::Zero());
+  const Vector3 noMaterial(Vector3::Zero());
+  nbTrianglesBase_ = triangles.size();
+  nbVerticesBase_ = vertices.size();
+  deltas_.clear();
+
+  const int nbTris = tIdState_.size();
+  deltas_.push_back(nbTris);
+  int prevId = 0;
+  for(int i=0;i<nbTris;++i)
+  {
+    const int id = tIdState_[i];
+    const int *indices = &tIndicesState_[3*i];
+    const int *base = id<nbTrianglesBase_ ? triangles[id].vIndices_ : noIndices;
+    const bool changed = !std::equal(indices, indices+3, base);
+    deltas_.push_back((id-prevId)*2+(changed ? 1 : 0));
+    prevId = id;
+    if(changed)
+    {
+      for(int j=0;j<3;++j)
+        deltas_.push_back(indices[j]-base[j]);
+    }
+  }
+
+  const int nbVerts = vIdState_.size();
+  deltas_.push_back(nbVerts);
+  prevId = 0;
+  for(int i=0;i<nbVerts;++i)
+  {
+    const int id = vIdState_[i];
+    const bool hasBase = id<nbVerticesBase_;
+    const Vertex &v = vState_[i];
+    const Vertex &vBase = hasBase ? vertices[id] : noVertex;
+    const Vector3 &materialBase = hasBase ? materials[id] : noMaterial;
+    int dPosition[3], dNormal[3], dMaterial[3];
+    int changes = 0;
+    if(difference(v, vBase, dPosition)) changes |= POSITION;
+    if(difference(v.normal_, vBase.normal_, dNormal)) changes |= NORMAL;
+    if(difference(vMaterialState_[i], materialBase, dMaterial)) changes |= MATERIAL;
+    if(!hasBase || !sameList(vTrisState_[i], vertTris[id])) changes |= TRIANGLES;
+    if(!hasBase || !sameList(vRingState_[i], vertRings[id])) changes |= RING;
+    deltas_.push_back((id-prevId)*(1<<NB_CHANGE_BITS)+changes);
+    prevId = id;
+    if(changes & POSITION) deltas_.insert(deltas_.end(), dPosition, dPosition+3);
+    if(changes & NORMAL) deltas_.insert(deltas_.end(), dNormal, dNormal+3);
+    if(changes & MATERIAL) deltas_.insert(deltas_.end(), dMaterial, dMaterial+3);
+    if(changes & TRIANGLES) pushList(deltas_, vTrisState_[i]);
+    if(changes & RING) pushList(deltas_, vRingState_[i]);
+  }
+  std::vector<int>(deltas_.begin(), deltas_.end()).swap(deltas_);
+  nbDeltaBytes_ = deltas_.size()*sizeof(int);
+  closed_ = true;
+}
+
+/** Pack the differences as zigzag variable length integers (small deltas take one byte) */
+void State::compress()
+{
+  std::vector<unsigned char> packed;
+  packed.reserve(deltas_.size()*2);
+  const int nbDeltas = deltas_.size();
+  for(int i=0;i<nbDeltas;++i)
+  {
+    const int delta = deltas_[i];
+    unsigned int value = (static_cast<unsigned int>(delta)<<1)^static_cast<unsigned int>(delta>>31);
+    while(value>=0x80)
+    {
+      packed.push_back(static_cast<unsigned char>(value|0x80));
+      value >>= 7;
+    }
+    packed.push_back(static_cast<unsigned char>(value));
+  }
+  std::vector<unsigned char>(packed.begin(), packed.end()).swap(packed_);
+  std::vector<int>().swap(deltas_);
+  nbPackedBytes_ = packed_.size();
+  LockFree::storeRelease(compressed_, 1);
+}
+
+/** Move the compressed differences to the undo file at fileOffset_ (kept in memory if the write fails) */
+void State::spill(StateFile &file)
+{
+  if(!file.write(fileOffset_, packed_.data(), nbPackedBytes_))
+  {
+    LockFree::storeRelease(spilled_, SPILL_FAILED);
+    return;
+  }
+  file_ = &file;
+  std::vector<unsigned char>().swap(packed_);
+  LockFree::storeRelease(spilled_, SPILL_DONE);
+}
+
+/** Rebuild the copies from the differences (the mesh must be the one the state was closed against) */
+void State::open(const Mesh &mesh)
+{
+  if(copies_)
+    return;
+  const TriangleVector &triangles = mesh.getTriangles();
+  const VertexVector &vertices = mesh.getVertices();
+  const Vector3Vector &materials = mesh.getMaterials();
+  const Adjacency &vertTris = mesh.getVerticesTriangles();
+  const Adjacency &vertRings = mesh.getVerticesRing();
+  const int noIndices[3] = {0, 0, 0};
+  const Vertex noVertex(Vector3::Zero());
+  const Vector3 noMaterial(Vector3::Zero());
+  LM_ASSERT(nbTrianglesBase_==static_cast<int>(triangles.size()) && nbVerticesBase_==static_cast<int>(vertices.size()), "History out of sync");
+
+  std::vector<int> unpacked;
+  if(isCompressed())
+  {
+    //a spilled state is paged back in from the undo file while it is read
+    const unsigned char *packed = isSpilled() ? file_->getData(fileOffset_) : packed_.data();
+    const int nbPacked = nbPackedBytes_;
+    unpacked.reserve(nbPacked);
+    unsigned int value = 0;
+    int shift = 0;
+    for(int i=0;i<nbPacked;++i)
+    {
+      value |= static_cast<unsigned int>(packed[i]&0x7f)<<shift;
+      shift += 7;
+      if(!(packed[i]&0x80))
+      {
+        unpacked.push_back(static_cast<int>(value>>1)^-static_cast<int>(value&1));
+        value = 0;
+        shift = 0;
+      }
+    }
+  }
+  const int *deltas = isCompressed() ? unpacked.data() : deltas_.data();
+
+  const int nbTris = *deltas++;
+  tIdState_.resize(nbTris);
+  tIndicesState_.resize(3*nbTris);
+  int prevId = 0;
+  for(int i=0;i<nbTris;++i)
+  {
+    const int word = *deltas++;
+    const int id = prevId+(word>>1);
+    const int *base = id<nbTrianglesBase_ ? triangles[id].vIndices_ : noIndices;
+    tIdState_[i] = id;
+    prevId = id;
+    for(int j=0;j<3;++j)
+      tIndicesState_[3*i+j] = base[j]+((word&1) ? *deltas++ : 0);
+  }
+
+  const int nbVerts = *deltas++;
+  vIdState_.resize(nbVerts);
+  vState_.resize(nbVerts);
+  vMaterialState_.resize(nbVerts);
+  vTrisState_.clear();
+  vRingState_.clear();
+  std::vector<int> list;
+  prevId = 0;
+  for(int i=0;i<nbVerts;++i)
+  {
+    const int word = *deltas++;
+    const int id = prevId+(word>>NB_CHANGE_BITS);
+    const int changes = word&((1<<NB_CHANGE_BITS)-1);
+    const bool hasBase = id<nbVerticesBase_;
+    const Vertex &vBase = hasBase ? vertices[id] : noVertex;
+    const Vector3 &materialBase = hasBase ? materials[id] : noMaterial;
+    vIdState_[i] = id;
+    prevId = id;
+    Vertex &v = vState_[i];
+    v = vBase;
+    v.tagFlag_ = 1;
+    vMaterialState_[i] = materialBase;
+    if(changes & POSITION) { v = applyDifference(vBase, deltas); deltas += 3; }
+    if(changes & NORMAL) { v.normal_ = applyDifference(vBase.normal_, deltas); deltas += 3; }
+    if(changes & MATERIAL) { vMaterialState_[i] = applyDifference(materialBase, deltas); deltas += 3; }
+    if(changes & TRIANGLES)
+    {
+      deltas = readList(deltas, list);
+      vTrisState_.append(Adjacency::Range(list.data(), list.size()));
+    }
+    else
+      vTrisState_.append(vertTris[id]);
+    if(changes & RING)
+    {
+      deltas = readList(deltas, list);
+      vRingState_.append(Adjacency::Range(list.data(), list.size()));
+    }
+    else
+      vRingState_.append(vertRings[id]);
+  }
+  copies_ = true;
+}
+
+/** Free the plain copies (once the state is closed) */
+void State::releaseCopies()
+{
+  std::vector<int>().swap(tIdState_);
+  std::vector<int>().swap(tIndicesState_);
+  VertexVector().swap(vState_);
+  std::vector<int>().swap(vIdState_);
+  Vector3Vector().swap(vMaterialState_);
+  vTrisState_ = Adjacency();
+  vRingState_ = Adjacency();
+  copies_ = false;
+}
@@ -0,0 +1,97 @@
+#include "StdAfx.h"
+#include "StateFile.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+  const size_t minFileSize = 16*1024*1024;
+}
+
+/** Constructor */
+StateFile::StateFile() : path_(), capacity_(0), size_(0), mapping_(), region_()
+{}
+
+/** Destructor */
+StateFile::~StateFile()
+{
+  close();
+}
+
+/** Getters */
+bool StateFile::isOpen() const { return !path_.empty(); }
+size_t StateFile::getCapacity() const { return capacity_; }
+
+/** Create an empty file (replaces the content of a previous session) */
+bool StateFile::open(const std::string &path, size_t capacity)
+{
+  close();
+  std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+  if(!file.is_open()) {
+    return false;
+  }
+  path_ = path;
+  capacity_ = capacity;
+  return true;
+}
+
+/** Unmap and remove the file */
+void StateFile::close()
+{
+  if(path_.empty()) {
+    return;
+  }
+  boost::interprocess::mapped_region().swap(region_);
+  boost::interprocess::file_mapping().swap(mapping_);
+  try {
+    boost::filesystem::remove(path_);
+  } catch (...) { }
+  path_.clear();
+  capacity_ = 0;
+  size_ = 0;
+}
+
+/** Copy data at some position of the file, false if the file could not grow */
+bool StateFile::write(size_t offset, const unsigned char *data, size_t nb)
+{
+  if(path_.empty() || offset+nb>capacity_) {
+    return false;
+  }
+  if(offset+nb>size_ && !resize(std::min(capacity_, std::max(offset+nb, std::max(2*size_, minFileSize))))) {
+    return false;
+  }
+  std::memcpy(static_cast<unsigned char*>(region_.get_address())+offset, data, nb);
+  return true;
+}
+
+/** Data at some position of the file (invalidated by the next write) */
+const unsigned char* StateFile::getData(size_t offset) const
+{
+  return static_cast<const unsigned char*>(region_.get_address())+offset;
+}
+
+/** Grow the file and map it again (the file can not be resized while mapped on Windows) */
+bool StateFile::resize(size_t size)
+{
+  boost::interprocess::mapped_region().swap(region_);
+  boost::interprocess::file_mapping().swap(mapping_);
+  try {
+    boost::filesystem::resize_file(path_, size);
+    boost::interprocess::file_mapping(path_.c_str(), boost::interprocess::read_write).swap(mapping_);
+    boost::interprocess::mapped_region(mapping_, boost::interprocess::read_write).swap(region_);
+  } catch (...) {
+    //keep the states already written readable
+    try {
+      if(size_>0) {
+        boost::interprocess::file_mapping(path_.c_str(), boost::interprocess::read_write).swap(mapping_);
+        boost::interprocess::mapped_region(mapping_, boost::interprocess::read_write, 0, size_).swap(region_);
+      }
+    } catch (...) {
+      size_ = 0;
+    }
+    return false;
+  }
+  size_ = size;
+  return true;
+}
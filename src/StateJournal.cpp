@@ -0,0 +1,38 @@
+#include "StdAfx.h"
+#include "StateJournal.h"
+
+/** Constructor */
+StateJournal::StateJournal() : bits_(), log_(), nbElements_(0)
+{}
+
+/** Destructor */
+StateJournal::~StateJournal()
+{}
+
+/** Start a new state with nbElements elements, nothing is marked */
+void StateJournal::start(int nbElements)
+{
+  const int nbLogged = log_.size();
+  for(int i=0;i<nbLogged;++i)
+    bits_[log_[i]>>5] &= ~(1u<<(log_[i]&31));
+  log_.clear();
+  nbElements_ = nbElements;
+  const size_t nbWords = (nbElements+31)>>5;
+  if(nbWords>bits_.size())
+    bits_.resize(nbWords, 0);
+}
+
+/** The element iSrc moves to iDst (swap delete), iDst takes its mark */
+void StateJournal::move(int iDst, int iSrc)
+{
+  if(iDst>=nbElements_)
+    return;
+  const unsigned int bit = 1u<<(iDst&31);
+  if(isMarked(iSrc))
+  {
+    bits_[iDst>>5] |= bit;
+    log_.push_back(iDst);
+  }
+  else
+    bits_[iDst>>5] &= ~bit;
+}
@@ -0,0 +1,228 @@
+#include "StdAfx.h"
+#include "ThreadPool.h"
+#include <cinder/Timer.h>
+
+#if _WIN32
+#define LM_THREAD_LOCAL __declspec(thread)
+#else
+#define LM_THREAD_LOCAL __thread
+#endif
+
+/** Index of the worker running on the current thread (-1 outside of the pool) */
+static LM_THREAD_LOCAL int currentWorker_ = -1;
+
+/** Constructor */
+ThreadPool::TaskGroup::TaskGroup(const char *name) : name_(name), nbPending_(0)
+{}
+
+/** Destructor, the tasks may reference the group */
+ThreadPool::TaskGroup::~TaskGroup()
+{
+  wait();
+}
+
+const char* ThreadPool::TaskGroup::getName() const { return name_; }
+
+/** Submit a task to the pool */
+void ThreadPool::TaskGroup::run(const Task &task)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++nbPending_;
+  }
+  Job job;
+  job.task_ = task;
+  job.group_ = this;
+  ThreadPool::getInstance().push(job);
+}
+
+/** Wait for every task of the group, running them if no worker took them yet */
+void ThreadPool::TaskGroup::wait()
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  const int iWorker = getCurrentWorker();
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if(nbPending_==0)
+        return;
+    }
+    Job job;
+    if(pool.steal(iWorker, this, job))
+    {
+      pool.execute(job, iWorker);
+      continue;
+    }
+    //the remaining tasks are running on other threads
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(nbPending_>0)
+      condition_.wait(lock);
+    return;
+  }
+}
+
+/** A task of the group is finished */
+void ThreadPool::TaskGroup::done()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if(--nbPending_==0)
+    condition_.notify_all();
+}
+
+/** Constructor, one worker per hardware thread besides the calling one */
+ThreadPool::ThreadPool() : nbQueued_(0), shutdown_(false)
+{
+  const int nbWorkers = std::max(1, static_cast<int>(std::thread::hardware_concurrency())-1);
+  for(int i=0;i<=nbWorkers;++i)
+    queues_.push_back(new Queue());
+  for(int i=0;i<nbWorkers;++i)
+    workers_.push_back(new std::thread(&ThreadPool::runWorker, this, i));
+}
+
+/** Destructor */
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    shutdown_ = true;
+    sleepCondition_.notify_all();
+  }
+  const int nbWorkers = workers_.size();
+  for(int i=0;i<nbWorkers;++i)
+  {
+    workers_[i]->join();
+    delete workers_[i];
+  }
+  const int nbQueues = queues_.size();
+  for(int i=0;i<nbQueues;++i)
+    delete queues_[i];
+}
+
+/** Number of threads running the tasks (the workers and the calling thread) */
+int ThreadPool::getNbThreads() const
+{
+  return workers_.size()+1;
+}
+
+/** Set the hook timing each task */
+void ThreadPool::setTimingHook(const TimingHook &hook)
+{
+  timingHook_ = hook;
+}
+
+/** Push a job on the deque of the current worker (or the shared one) and wake up a worker */
+void ThreadPool::push(const Job &job)
+{
+  const int iWorker = getCurrentWorker();
+  Queue &queue = *queues_[iWorker!=-1 ? iWorker : queues_.size()-1];
+  {
+    std::unique_lock<std::mutex> lock(queue.mutex_);
+    queue.jobs_.push_back(job);
+  }
+  std::unique_lock<std::mutex> lock(sleepMutex_);
+  ++nbQueued_;
+  sleepCondition_.notify_one();
+}
+
+/** Pop the newest job of a deque */
+bool ThreadPool::pop(int iQueue, Job &job)
+{
+  Queue &queue = *queues_[iQueue];
+  {
+    std::unique_lock<std::mutex> lock(queue.mutex_);
+    if(queue.jobs_.empty())
+      return false;
+    job = queue.jobs_.back();
+    queue.jobs_.pop_back();
+  }
+  taken();
+  return true;
+}
+
+/**
+* Steal the oldest job of another deque, starting after the thief's own deque.
+* If group isn't null, only its jobs are taken.
+*/
+bool ThreadPool::steal(int iThief, const TaskGroup *group, Job &job)
+{
+  const int nbQueues = queues_.size();
+  const int iStart = iThief!=-1 ? iThief+1 : nbQueues-1;
+  for(int i=0;i<nbQueues;++i)
+  {
+    Queue &queue = *queues_[(iStart+i)%nbQueues];
+    std::unique_lock<std::mutex> lock(queue.mutex_);
+    std::deque<Job>::iterator it = queue.jobs_.begin();
+    if(group)
+    {
+      while(it!=queue.jobs_.end() && it->group_!=group)
+        ++it;
+    }
+    if(it==queue.jobs_.end())
+      continue;
+    job = *it;
+    queue.jobs_.erase(it);
+    lock.unlock();
+    taken();
+    return true;
+  }
+  return false;
+}
+
+/** A job left the deques */
+void ThreadPool::taken()
+{
+  std::unique_lock<std::mutex> lock(sleepMutex_);
+  --nbQueued_;
+}
+
+/** Run a job and signal its group */
+void ThreadPool::execute(Job &job, int iWorker)
+{
+  if(timingHook_)
+  {
+    ci::Timer timer(true);
+    job.task_();
+    timingHook_(job.group_->getName(), iWorker, timer.getSeconds());
+  }
+  else
+  {
+    job.task_();
+  }
+  job.group_->done();
+}
+
+/** Main loop of a worker */
+void ThreadPool::runWorker(int iWorker)
+{
+  currentWorker_ = iWorker;
+  for(;;)
+  {
+    Job job;
+    if(pop(iWorker, job) || steal(iWorker, 0, job))
+    {
+      execute(job, iWorker);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    while(nbQueued_==0 && !shutdown_)
+      sleepCondition_.wait(lock);
+    if(shutdown_)
+      return;
+  }
+}
+
+/** Number of chunks of a parallel loop */
+int ThreadPool::getNbChunks(int nbElements, int grain)
+{
+  if(nbElements<=0)
+    return 0;
+  const int nbChunks = (nbElements+grain-1)/std::max(grain, 1);
+  return std::min(nbChunks, getInstance().getNbThreads()*chunksPerThread_);
+}
+
+/** Index of the worker running on the current thread (-1 outside of the pool) */
+int ThreadPool::getCurrentWorker()
+{
+  return currentWorker_;
+}
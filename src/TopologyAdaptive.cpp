@@ -13,7 +13,7 @@ void Topology::adaptTopology(std::vector<int> &iTris, float d2Thickness)
   for(int i = 0; i<nbVerts; ++i)
   {
     int iVert = iVerts[i];
-    if(iVert>=nbVertices)
+    if(iVert>=nbVertices || vertices()[iVert].tagFlag_<0)
       continue;
     Vertex &v = vertices()[iVert];
     if((v-centerPoint_).squaredNorm()<radiusSquared_)
@@ -27,16 +27,14 @@ void Topology::adaptTopology(std::vector<int> &iTris, float d2Thickness)
   std::vector<int> iTrisTemp;
   int nbTrisTemp = iTris.size();
   int nbTriangles = triangles().size();
-  ++Triangle::tagMask_;
+  triVisitation_.start(nbTriangles);
   for(int i = 0; i<nbTrisTemp; ++i)
   {
     int iTri = iTris[i];
-    if(iTri>=nbTriangles)
+    if(iTri>=nbTriangles || triangles()[iTri].tagFlag_<0)
       continue;
-    Triangle &t = triangles()[iTri];
-    if(t.tagFlag_==Triangle::tagMask_)
+    if(!triVisitation_.visit(iTri))
       continue;
-    t.tagFlag_ = Triangle::tagMask_;
     iTrisTemp.push_back(iTri);
   }
   iTris = iTrisTemp;
@@ -72,11 +70,11 @@ void Topology::checkCollisions(std::vector<int> &iVerts, float d2Thickness)
     Vertex &v = vertices()[iVert];
     if(v.tagFlag_<0)
       continue;
-    std::vector<int> &ring = v.ringVertices_;
+    Adjacency::Range ring = vertRings()[iVert];
     int nbRing = ring.size();
-    ++Vertex::tagMask_;
+    vertVisitation_.start(vertices().size());
     for(int j=0;j<nbRing;++j)
-      vertices()[ring[j]].tagFlag_ = Vertex::tagMask_;
+      vertVisitation_.visit(ring[j]);
 
     grid_.getNeighborhood(v, iNearVerts);
     int nbNearVerts = iNearVerts.size();
@@ -86,11 +84,11 @@ void Topology::checkCollisions(std::vector<int> &iVerts, float d2Thickness)
       if(iVert==jVert)
         continue;
       Vertex &vTest = vertices()[jVert];
-      if(vTest.tagFlag_<0 || vTest.tagFlag_==Vertex::tagMask_)
+      if(vTest.tagFlag_<0 || vertVisitation_.isVisited(jVert))
         continue;
       if((v-vTest).squaredNorm()<r2Thickness)
       {
-        if(nbRing>(int)vTest.ringVertices_.size())
+        if(nbRing>vertRings().size(jVert))
           vertexJoin(iVert,jVert);
         else
           vertexJoin(jVert,iVert);
@@ -110,13 +108,14 @@ void Topology::checkCollisions(std::vector<int> &iVerts, float d2Thickness)
   for(int i=0;i<nbVertsDecimated;++i)
   {
     int iv = iVertsDecimated_[i];
-    if(vertices()[iv].sculptFlag_==Vertex::sculptMask_)
+    if(mesh_->getSelection().isVisited(iv))
       vSmooth.push_back(iv);
   }
   mesh_->expandVertices(vSmooth,1);
   Brush brush;
   brush._strength = 1.0f;
-  Sculpt::smooth(mesh_, vSmooth, brush, false);
+  laplacian_.init(mesh_, vSmooth);
+  Sculpt::smooth(mesh_, laplacian_, brush, false);
 }
 
 /** Vertex joint */
@@ -125,26 +124,26 @@ void Topology::vertexJoin(int iv1, int iv2)
   Vertex &v1 = vertices()[iv1];
   Vertex &v2 = vertices()[iv2];
 
-  std::vector<int> &iTris1 = v1.tIndices_;
-  std::vector<int> &iTris2 = v2.tIndices_;
-  std::vector<int> ring1 = v1.ringVertices_;
-  std::vector<int> ring2 = v2.ringVertices_;
+  std::vector<int> iTris1 = vertTris()[iv1].toVector();
+  std::vector<int> iTris2 = vertTris()[iv2].toVector();
+  std::vector<int> ring1 = vertRings()[iv1].toVector();
+  std::vector<int> ring2 = vertRings()[iv2].toVector();
   int nbRing1 = ring1.size();
   int nbRing2 = ring2.size();
 
   //undo-redo
   mesh_->pushState(iTris1, ring1);
   mesh_->pushState(iTris2, ring2);
-  if(v1.stateFlag_!=Mesh::stateMask_) { v1.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v1); }
-  if(v2.stateFlag_!=Mesh::stateMask_) { v2.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v2); }
+  mesh_->pushVertexState(iv1);
+  mesh_->pushVertexState(iv2);
 
   std::vector<Edge> edges1,edges2;
 
-  trianglesRotate(v1.tIndices_,iv1,edges1);
+  trianglesRotate(iTris1,iv1,edges1);
   if(!adjustEdgeOrientation(edges1))
     return;
 
-  trianglesRotate(v2.tIndices_,iv2,edges2);
+  trianglesRotate(iTris2,iv2,edges2);
   if(!adjustEdgeOrientation(edges2))
     return;
 
@@ -189,33 +188,33 @@ void Topology::connect1RingCommonVertices(std::vector<Edge> &edges1, std::vector
   int nbEdges2 = edges2.size();
   int nbCommon = common.size();
 
-  ++Vertex::tagMask_;
+  vertVisitation_.start(vertices().size());
   for(int i = 0; i<nbCommon; ++i)
-    vertices()[common[i]].tagFlag_ = Vertex::tagMask_;
+    vertVisitation_.visit(common[i]);
 
   //delete triangles
   for(int i = 0; i<nbEdges1; ++i)
   {
-    Vertex &v1 = vertices()[edges1[i].v1_];
-    Vertex &v2 = vertices()[edges1[i].v2_];
-    if(v1.tagFlag_==Vertex::tagMask_ && v2.tagFlag_==Vertex::tagMask_)
+    const bool common1 = isTagged(edges1[i].v1_);
+    const bool common2 = isTagged(edges1[i].v2_);
+    if(common1 && common2)
     {
       int iTri = edges1[i].t_;
-      v1.removeTriangle(iTri);
-      v2.removeTriangle(iTri);
+      vertTris().remove(edges1[i].v1_, iTri);
+      vertTris().remove(edges1[i].v2_, iTri);
       triangles()[iTri].tagFlag_ = -1;
       iTrisToDelete_.push_back(iTri);
     }
   }
   for(int i = 0; i<nbEdges2; ++i)
   {
-    Vertex &v1 = vertices()[edges2[i].v1_];
-    Vertex &v2 = vertices()[edges2[i].v2_];
-    if(v1.tagFlag_==Vertex::tagMask_ && v2.tagFlag_==Vertex::tagMask_)
+    const bool common1 = isTagged(edges2[i].v1_);
+    const bool common2 = isTagged(edges2[i].v2_);
+    if(common1 && common2)
     {
       int iTri = edges2[i].t_;
-      v1.removeTriangle(iTri);
-      v2.removeTriangle(iTri);
+      vertTris().remove(edges2[i].v1_, iTri);
+      vertTris().remove(edges2[i].v2_, iTri);
       triangles()[iTri].tagFlag_ = -1;
       iTrisToDelete_.push_back(iTri);
     }
@@ -230,20 +229,20 @@ void Topology::connect1RingCommonVertices(std::vector<Edge> &edges1, std::vector
 
   for(int i = 0; i<nbEdges1; ++i)
   {
-    Vertex &v1 = vertices()[edges1[i].v1_];
-    Vertex &v2 = vertices()[edges1[i].v2_];
-    if(v1.tagFlag_!=Vertex::tagMask_ || v2.tagFlag_!=Vertex::tagMask_ )
+    const bool common1 = isTagged(edges1[i].v1_);
+    const bool common2 = isTagged(edges1[i].v2_);
+    if(!common1 || !common2)
       subEdges1.back().push_back(edges1[i]);
-    if(v2.tagFlag_==Vertex::tagMask_ && subEdges1.back().size()!=0)
+    if(common2 && subEdges1.back().size()!=0)
       subEdges1.push_back(std::vector<Edge>());
   }
   for(int i = 0; i<nbEdges2; ++i)
   {
-    Vertex &v1 = vertices()[edges2[i].v1_];
-    Vertex &v2 = vertices()[edges2[i].v2_];
-    if(v1.tagFlag_!=Vertex::tagMask_ || v2.tagFlag_!=Vertex::tagMask_ )
+    const bool common1 = isTagged(edges2[i].v1_);
+    const bool common2 = isTagged(edges2[i].v2_);
+    if(!common1 || !common2)
       subEdges2.back().push_back(edges2[i]);
-    if(v2.tagFlag_==Vertex::tagMask_ && subEdges2.back().size()!=0)
+    if(common2 && subEdges2.back().size()!=0)
       subEdges2.push_back(std::vector<Edge>());
   }
 
@@ -317,11 +316,11 @@ void Topology::connect1Ring(std::vector<Edge> &edges1, std::vector<Edge> &edges2
     if(i!=0)
       j = (int)(nbEdges2 - step*i);
     triangles()[edges1[i].t_].vIndices_[2] = edges2[j].v1_;
-    vertices()[edges2[j].v1_].addTriangle(edges1[i].t_);
+    vertTris().add(edges2[j].v1_, edges1[i].t_);
     if(j!=temp)
     {
       triangles()[edges2[j].t_].vIndices_[2] = edges1[i].v1_;
-      vertices()[edges1[i].v1_].addTriangle(edges2[j].t_);
+      vertTris().add(edges1[i].v1_, edges2[j].t_);
     }
     temp = j;
   }
@@ -331,12 +330,12 @@ void Topology::connect1Ring(std::vector<Edge> &edges1, std::vector<Edge> &edges2
 void Topology::connectLinkedEdges(std::vector<Edge> &edges1, std::vector<Edge> &edges2)
 {
   int iTri1 = edges2.front().t_;
-  vertices()[edges2.front().v1_].removeTriangle(iTri1);
-  vertices()[edges2.front().v2_].removeTriangle(iTri1);
+  vertTris().remove(edges2.front().v1_, iTri1);
+  vertTris().remove(edges2.front().v2_, iTri1);
 
   int iTri2 = edges2.back().t_;
-  vertices()[edges2.back().v1_].removeTriangle(iTri2);
-  vertices()[edges2.back().v2_].removeTriangle(iTri2);
+  vertTris().remove(edges2.back().v1_, iTri2);
+  vertTris().remove(edges2.back().v2_, iTri2);
 
   int nbEdges1 = edges1.size();
   int nbEdges2 = edges2.size();
@@ -350,11 +349,11 @@ void Topology::connectLinkedEdges(std::vector<Edge> &edges1, std::vector<Edge> &
     if (j < nbEdges2)
     {
       triangles()[edges1[i].t_].vIndices_[2] = edges2[j].v1_;
-      vertices()[edges2[j].v1_].addTriangle(edges1[i].t_);
+      vertTris().add(edges2[j].v1_, edges1[i].t_);
       if(j!=temp && j!=0 && j!=(nbEdges2-1))
       {
         triangles()[edges2[j].t_].vIndices_[2] = edges1[i].v1_;
-        vertices()[edges1[i].v1_].addTriangle(edges2[j].t_);
+        vertTris().add(edges1[i].v1_, edges2[j].t_);
       }
     }
     temp = j;
@@ -370,14 +369,13 @@ void Topology::connectLoop(std::vector<Edge> &edges)
 {
   int nbEdges = edges.size();
   int iTri = edges.front().t_;
-  vertices()[edges.front().v1_].removeTriangle(iTri);
-  vertices()[edges.front().v2_].removeTriangle(iTri);
+  vertTris().remove(edges.front().v1_, iTri);
+  vertTris().remove(edges.front().v2_, iTri);
   int iv = edges.front().v1_;
-  Vertex &v = vertices()[iv];
   for(int i = 1; i<nbEdges; ++i)
   {
     triangles()[edges[i].t_].vIndices_[2] = iv;
-    v.addTriangle(edges[i].t_);
+    vertTris().add(iv, edges[i].t_);
   }
   triangles()[iTri].tagFlag_ = -1;
   iTrisToDelete_.push_back(iTri);
@@ -524,14 +522,15 @@ void Topology::cleanUpSingularVertex(int iv)
     return;
 
   //undo-redo
-  mesh_->pushState(v.tIndices_,v.ringVertices_);
-  if(v.stateFlag_!=Mesh::stateMask_) { v.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v); }
+  mesh_->pushState(vertTris()[iv].toVector(),vertRings()[iv].toVector());
+  mesh_->pushVertexState(iv);
 
   if(deleteVertexIfDegenerate(iv))
     return;
 
   std::vector<Edge> edges;
-  trianglesRotate(v.tIndices_,iv,edges);
+  std::vector<int> iTris = vertTris()[iv].toVector();
+  trianglesRotate(iTris,iv,edges);
   if(!adjustEdgeOrientation(edges))
     return;
 
@@ -550,31 +549,30 @@ void Topology::cleanUpSingularVertex(int iv)
   if(endLoop == -1)
     return;
 
-  int ivNew = vertices().size();
-  Vertex vNew(v,ivNew);
-  vNew.material_ = v.material_;
+  Vertex vNew(v.x(), v.y(), v.z());
   LM_ASSERT(fabs(v.normal_.squaredNorm() - 1.0f) < 0.001f, "Bad normal");
   vNew.normal_ = -v.normal_;
-  vNew.stateFlag_ = Mesh::stateMask_;
 
+  if(mesh_->getNextVertex()<(int)vertices().size())
+    iVertsReused_.push_back(mesh_->getNextVertex());
+  int ivNew = mesh_->addVertex(vNew, mesh_->getMaterials()[iv]);
   for(int i = 0; i<=endLoop; ++i)
   {
     int iTri = edges[i].t_;
-    vNew.addTriangle(iTri);
-    v.removeTriangle(iTri);
+    vertTris().add(ivNew, iTri);
+    vertTris().remove(iv, iTri);
     triangles()[iTri].vIndices_[2] = ivNew;
   }
 
-  vertices().push_back(vNew);
   mesh_->computeRingVertices(iv);
   mesh_->computeRingVertices(ivNew);
 
-  std::vector<int> &ring1 = vertices()[ivNew].ringVertices_;
+  std::vector<int> ring1 = vertRings()[ivNew].toVector();
   int nbRing1 = ring1.size();
   for(int i = 0; i<nbRing1; ++i)
     mesh_->computeRingVertices(ring1[i]);
 
-  std::vector<int> &ring2 = vertices()[iv].ringVertices_;
+  std::vector<int> ring2 = vertRings()[iv].toVector();
   int nbRing2 = ring2.size();
   for(int i = 0; i<nbRing2; ++i)
     mesh_->computeRingVertices(ring2[i]);
@@ -588,7 +586,8 @@ void Topology::cleanUpSingularVertex(int iv)
 
   Brush brush;
   brush._strength = 1.0f;
-  Sculpt::smooth(mesh_, vSmooth, brush, false);
+  laplacian_.init(mesh_, vSmooth);
+  Sculpt::smooth(mesh_, laplacian_, brush, false);
 
   cleanUpSingularVertex(iv);
   cleanUpSingularVertex(ivNew);
@@ -600,8 +599,8 @@ bool Topology::deleteVertexIfDegenerate(int iv)
   Vertex &v = vertices()[iv];
   if(v.tagFlag_<0)
     return true;
-  Tools::tidy(v.tIndices_);
-  int nbTris = v.tIndices_.size();
+  vertTris().tidy(iv);
+  int nbTris = vertTris().size(iv);
   if(nbTris==0)
   {
     v.tagFlag_ = -1;
@@ -611,7 +610,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
   }
   else if(nbTris==1)
   {
-    int iTri = v.tIndices_[0];
+    int iTri = vertTris()[iv][0];
     std::vector<int> verts;
     Triangle &t = triangles()[iTri];
     verts.push_back(t.vIndices_[0]);
@@ -624,7 +623,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts[i];
       if(iVert!=iv)
       {
-        vertices()[iVert].removeTriangle(iTri);
+        vertTris().remove(iVert, iTri);
         mesh_->computeRingVertices(iVert);
       }
     }
@@ -638,7 +637,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts[i];
       if(iVert!=iv)
       {
-        if(vertices()[iVert].tIndices_.size()<3)
+        if(vertTris().size(iVert)<3)
           deleteVertexIfDegenerate(iVert);
       }
     }
@@ -646,7 +645,8 @@ bool Topology::deleteVertexIfDegenerate(int iv)
   }
   else if(nbTris==2)
   {
-    int iTri1 = v.tIndices_[0];
+    int iTri1 = vertTris()[iv][0];
+    int iTri2 = vertTris()[iv][1];
     std::vector<int> verts1;
     Triangle &t1 = triangles()[iTri1];
     verts1.push_back(t1.vIndices_[0]);
@@ -659,12 +659,11 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts1[i];
       if(iVert!=iv)
       {
-        vertices()[iVert].removeTriangle(iTri1);
+        vertTris().remove(iVert, iTri1);
         mesh_->computeRingVertices(iVert);
       }
     }
 
-    int iTri2 = v.tIndices_[1];
     std::vector<int> verts2;
     Triangle &t2 = triangles()[iTri2];
     verts2.push_back(t2.vIndices_[0]);
@@ -677,7 +676,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts2[i];
       if(iVert!=iv)
       {
-        vertices()[iVert].removeTriangle(iTri2);
+        vertTris().remove(iVert, iTri2);
         mesh_->computeRingVertices(iVert);
       }
     }
@@ -694,7 +693,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts1[i];
       if(iVert!=iv)
       {
-        if(vertices()[iVert].tIndices_.size()<3)
+        if(vertTris().size(iVert)<3)
           deleteVertexIfDegenerate(iVert);
       }
     }
@@ -703,7 +702,7 @@ bool Topology::deleteVertexIfDegenerate(int iv)
       int iVert = verts2[i];
       if(iVert!=iv)
       {
-        if(vertices()[iVert].tIndices_.size()<3)
+        if(vertTris().size(iVert)<3)
           deleteVertexIfDegenerate(iVert);
       }
     }
@@ -64,18 +64,16 @@ void Topology::decimation(std::vector<int> &iTris, float detailMinSquared)
   std::vector<int> iTrisTemp;
   int nbTris = iTris.size();
   int nbTriangles = triangles().size();
-  ++Triangle::tagMask_;
+  triVisitation_.start(nbTriangles);
   for(int i = 0; i<nbTris; ++i)
   {
     int iTri = iTris[i];
-    if(iTri>=nbTriangles) {
+    if(iTri>=nbTriangles || triangles()[iTri].tagFlag_<0) {
       continue;
     }
-    Triangle &t = triangles()[iTri];
-    if(t.tagFlag_==Triangle::tagMask_) {
+    if(!triVisitation_.visit(iTri)) {
       continue;
     }
-    t.tagFlag_ = Triangle::tagMask_;
     iTrisTemp.push_back(iTri);
   }
   iTris = iTrisTemp;
@@ -98,47 +96,43 @@ void Topology::applyDeletion() {
 void Topology::getValidModifiedVertices(std::vector<int>& iVerts) {
   int nbVertsDecimated = iVertsDecimated_.size();
   int nbVertices = vertices().size();
-  ++Vertex::tagMask_;
+  vertVisitation_.start(nbVertices);
   for(int i=0;i<nbVertsDecimated;++i)
   {
     int iVert = iVertsDecimated_[i];
-    if(iVert>=nbVertices) {
+    if(iVert>=nbVertices || vertices()[iVert].tagFlag_<0) {
       continue;
     }
-    Vertex &v = vertices()[iVert];
-    if(v.tagFlag_==Vertex::tagMask_) {
+    if(!vertVisitation_.visit(iVert)) {
       continue;
     }
-    v.tagFlag_ = Vertex::tagMask_;
     iVerts.push_back(iVert);
   }
 }
 
-/** Find opposite triangle */
+/**
+* Find opposite triangle (-1 if the edge is on the border or shared by more than two triangles).
+* The fan of iv1 is scanned for iv2, so the cost is linear in the valence of iv1.
+*/
 int Topology::findOppositeTriangle(int iTri, int iv1, int iv2)
 {
-  Vertex &v1 = vertices()[iv1];
-  Vertex &v2 = vertices()[iv2];
-  std::vector<int> &iTris1 = v1.tIndices_;
-  std::vector<int> &iTris2 = v2.tIndices_;
-  std::sort(iTris1.begin(),iTris1.end());
-  std::sort(iTris2.begin(),iTris2.end());
-  std::vector<int> res(std::max(iTris1.size(), iTris2.size()),-1);
-  std::set_intersection(iTris1.begin(),iTris1.end(),iTris2.begin(),iTris2.end(),res.begin());
-  for (size_t i=0; i<res.size(); i++) {
-    if (res[i] == -1) {
-      res.resize(i);
-      break;
+  Adjacency::Range iTris1 = vertTris()[iv1];
+  int nbTris1 = iTris1.size();
+  int iTriOpp = -1;
+  for(int i=0;i<nbTris1;++i)
+  {
+    int iTriTest = iTris1[i];
+    if(iTriTest==iTri)
+      continue;
+    const int *vIndices = triangles()[iTriTest].vIndices_;
+    if(vIndices[0]==iv2 || vIndices[1]==iv2 || vIndices[2]==iv2)
+    {
+      if(iTriOpp!=-1)
+        return -1;
+      iTriOpp = iTriTest;
     }
   }
-  if (res.size() != 2) {
-    return -1;
-  }
-  if(res[0]==iTri) {
-    return res[1];
-  } else {
-    return res[0];
-  }
+  return iTriOpp;
 }
 
 /** Decimate triangles (find orientation of the 2 triangles) */
@@ -198,12 +192,10 @@ void Topology::edgeCollapse(int iTri1, int iTri2,int iv1, int iv2,int ivOpp1, in
   Vertex &v1 = vertices()[iv1];
   Vertex &v2 = vertices()[iv2];
   Vector3& n1 = v1.normal_;
-  Vertex &vOpp1 = vertices()[ivOpp1];
-  Vertex &vOpp2 = vertices()[ivOpp2];
-  std::vector<int> &tris1 = v1.tIndices_;
-  std::vector<int> &tris2 = v2.tIndices_;
-  std::vector<int> &ring1 = v1.ringVertices_;
-  std::vector<int> &ring2 = v2.ringVertices_;
+  std::vector<int> tris1 = vertTris()[iv1].toVector();
+  std::vector<int> tris2 = vertTris()[iv2].toVector();
+  std::vector<int> ring1 = vertRings()[iv1].toVector();
+  std::vector<int> ring2 = vertRings()[iv2].toVector();
 
   //undo-redo
   mesh_->pushState(tris1,ring1);
@@ -217,10 +209,10 @@ void Topology::edgeCollapse(int iTri1, int iTri2,int iv1, int iv2,int ivOpp1, in
   LM_ASSERT(res.size() >= 2, "Not enough res");
   if(res[2]!=-1) //edge flip
   {
-    v1.removeTriangle(iTri2);
-    v2.removeTriangle(iTri1);
-    vOpp1.addTriangle(iTri2);
-    vOpp2.addTriangle(iTri1);
+    vertTris().remove(iv1, iTri2);
+    vertTris().remove(iv2, iTri1);
+    vertTris().add(ivOpp1, iTri2);
+    vertTris().add(ivOpp2, iTri1);
     t1.replaceVertex(iv2,ivOpp2);
     t2.replaceVertex(iv1,ivOpp1);
     mesh_->computeRingVertices(iv1);
@@ -236,22 +228,23 @@ void Topology::edgeCollapse(int iTri1, int iTri2,int iv1, int iv2,int ivOpp1, in
 
   n1 = (v1.normal_+v2.normal_).normalized();
   LM_ASSERT(fabs(n1.squaredNorm() - 1.0f) < 0.0001f, "Bad normal"); // crash n1 coords set to -1.#IND0000
-  ring1.insert(ring1.end(),ring2.begin(),ring2.end());
 
-  v1.removeTriangle(iTri1);
-  v1.removeTriangle(iTri2);
-  v2.removeTriangle(iTri1);
-  v2.removeTriangle(iTri2);
-  vOpp1.removeTriangle(iTri1);
-  vOpp2.removeTriangle(iTri2);
-  tris1.insert(tris1.end(),tris2.begin(),tris2.end());
+  vertTris().remove(iv1, iTri1);
+  vertTris().remove(iv1, iTri2);
+  vertTris().remove(iv2, iTri1);
+  vertTris().remove(iv2, iTri2);
+  vertTris().remove(ivOpp1, iTri1);
+  vertTris().remove(ivOpp2, iTri2);
 
+  tris2 = vertTris()[iv2].toVector();
   int nbTris2 = tris2.size();
   for(int i = 0; i<nbTris2; ++i) {
+    vertTris().add(iv1, tris2[i]);
     triangles()[tris2[i]].replaceVertex(iv2,iv1);
   }
 
   mesh_->computeRingVertices(iv1);
+  ring1 = vertRings()[iv1].toVector();
 
   Vector3 laplacianPos(Vector3::Zero());
   int nbRing1 = ring1.size();
@@ -264,7 +257,8 @@ void Topology::edgeCollapse(int iTri1, int iTri2,int iv1, int iv2,int ivOpp1, in
   laplacianPos/=static_cast<float>(nbRing1);
   v1 = laplacianPos - n1*n1.dot(laplacianPos-v1);
 
-  iTris.insert(iTris.end(),tris1.begin(),tris1.end());
+  Adjacency::Range trisCollapsed = vertTris()[iv1];
+  iTris.insert(iTris.end(),trisCollapsed.begin(),trisCollapsed.end());
   v2.tagFlag_ = -1;
   t1.tagFlag_ = -1;
   t2.tagFlag_ = -1;
@@ -279,15 +273,13 @@ void Topology::edgeCollapse(int iTri1, int iTri2,int iv1, int iv2,int ivOpp1, in
 void Topology::deleteTriangle(int iTri)
 {
   Triangle &t = triangles()[iTri];
-  int oldPos = t.posInLeaf_;
-  std::vector<int> &iTrisLeaf = t.leaf_->getTriangles();
-  int lastTri = iTrisLeaf.back();
-  if(iTri!=lastTri)
+  Octree *octree = mesh_->getOctree();
+  octree->removeTriangle(triangles(), t);
+  if(mesh_->isRecycling())
   {
-    iTrisLeaf[oldPos] = lastTri;
-    triangles()[lastTri].posInLeaf_ = oldPos;
+    mesh_->recycleTriangle(iTri);
+    return;
   }
-  iTrisLeaf.pop_back();
 
   int lastPos = triangles().size()-1;
   if(lastPos==iTri)
@@ -298,30 +290,27 @@ void Topology::deleteTriangle(int iTri)
   Triangle &last = triangles()[lastPos];
 
   //undo-redo
-  if(last.stateFlag_!=Mesh::stateMask_) { last.stateFlag_ = Mesh::stateMask_; mesh_->getTrianglesState().push_back(last); }
+  mesh_->pushTriangleState(lastPos);
 
   last.id_ = iTri;
-  std::vector<int> &iTrisLeafLast = last.leaf_->getTriangles();
-  iTrisLeafLast[last.posInLeaf_] = iTri;
+  octree->renameTriangle(last, iTri);
   int iv1 = last.vIndices_[0];
   int iv2 = last.vIndices_[1];
   int iv3 = last.vIndices_[2];
-  Vertex &v1 = vertices()[iv1];
-  Vertex &v2 = vertices()[iv2];
-  Vertex &v3 = vertices()[iv3];
 
   //undo-redo
-  if(v1.stateFlag_!=Mesh::stateMask_) { v1.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v1); }
-  if(v2.stateFlag_!=Mesh::stateMask_) { v2.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v2); }
-  if(v3.stateFlag_!=Mesh::stateMask_) { v3.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v3); }
+  mesh_->pushVertexState(iv1);
+  mesh_->pushVertexState(iv2);
+  mesh_->pushVertexState(iv3);
 
-  v1.replaceTriangle(lastPos,iTri);
-  v2.replaceTriangle(lastPos,iTri);
-  v3.replaceTriangle(lastPos,iTri);
+  vertTris().replace(iv1,lastPos,iTri);
+  vertTris().replace(iv2,lastPos,iTri);
+  vertTris().replace(iv3,lastPos,iTri);
   iVertsDecimated_.push_back(iv1);
   iVertsDecimated_.push_back(iv2);
   iVertsDecimated_.push_back(iv3);
   triangles()[iTri] = last;
+  mesh_->moveTriangle(iTri, lastPos);
 
   triangles().pop_back();
 }
@@ -329,41 +318,39 @@ void Topology::deleteTriangle(int iTri)
 /** Update last vertex of array and move its position */
 void Topology::deleteVertex(int iVert)
 {
+  if(mesh_->isRecycling())
+  {
+    mesh_->recycleVertex(iVert);
+    return;
+  }
   int lastPos = vertices().size()-1;
   if(iVert==lastPos)
   {
-    vertices().pop_back();
+    mesh_->removeVertex(iVert);
     return;
   }
-  Vertex &last = vertices()[lastPos];
 
   //undo-redo
-  if(last.stateFlag_!=Mesh::stateMask_) { last.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(last); }
+  mesh_->pushVertexState(lastPos);
 
-  last.id_ = iVert;
-  std::vector<int> &iTris = last.tIndices_;
-  std::vector<int> &ring = last.ringVertices_;
+  Adjacency::Range iTris = vertTris()[lastPos];
+  Adjacency::Range ring = vertRings()[lastPos];
   int nbTris = iTris.size();
   int nbRing = ring.size();
   for(int i=0;i<nbTris;++i)
   {
-    Triangle &t = triangles()[iTris[i]];
-
     //undo-redo
-    if(t.stateFlag_!=Mesh::stateMask_) { t.stateFlag_ = Mesh::stateMask_; mesh_->getTrianglesState().push_back(t); }
+    mesh_->pushTriangleState(iTris[i]);
 
-    t.replaceVertex(lastPos,iVert);
+    triangles()[iTris[i]].replaceVertex(lastPos,iVert);
   }
   for(int i=0;i<nbRing;++i)
   {
-    Vertex &v = vertices()[ring[i]];
-
     //undo-redo
-    if(v.stateFlag_!=Mesh::stateMask_) { v.stateFlag_ = Mesh::stateMask_; mesh_->getVerticesState().push_back(v); }
+    mesh_->pushVertexState(ring[i]);
 
-    v.replaceRingVertex(lastPos,iVert);
+    vertRings().replace(ring[i],lastPos,iVert);
   }
-  vertices()[iVert] = last;
-
-  vertices().pop_back();
+  mesh_->removeVertex(iVert);
+  iVertsMoved_.push_back(iVert);
 }
@@ -5,13 +5,7 @@
 /** Subdivide until the detail every selected triangles comply with a detail level */
 void Topology::subdivision(std::vector<int> &iTris, float detailMaxSquared)
 {
-  int nbTriangles = triangles().size();
-  do
-  {
-    nbTriangles = triangles().size();
-    subdivide(iTris, detailMaxSquared);
-  }
-  while(nbTriangles!=(int)triangles().size());
+  while(subdivide(iTris, detailMaxSquared));
 }
 
 /**
@@ -22,16 +16,18 @@ void Topology::subdivision(std::vector<int> &iTris, float detailMaxSquared)
 * 4. Fill the triangles (just create an edge where it's needed)
 * 5. Smooth newly created vertices (along the plane defined by their own normals)
 * 6. Tag the newly created vertices if they are inside the sculpt brush radius
+* The new elements may reuse the holes of deleted ones (see Mesh::setRecycling), so
+* they are listed by the split functions instead of being taken at the end of the arrays.
+* Returns false if no triangle was split.
 */
-void Topology::subdivide(std::vector<int> &iTris, float detailMaxSquared)
+bool Topology::subdivide(std::vector<int> &iTris, float detailMaxSquared)
 {
   verticesMap_.clear();
   iTrisSubd_.clear();
   iVertsSubd_.clear();
   split_.clear();
-
-  int nbVertsInit = vertices().size();
-  int nbTrisInit = triangles().size();
+  iTrisNew_.clear();
+  iVertsNew_.clear();
 
   initSplit(iTris, iTrisSubd_, split_, detailMaxSquared);
   if(iTrisSubd_.size()>20)
@@ -44,15 +40,13 @@ void Topology::subdivide(std::vector<int> &iTris, float detailMaxSquared)
   split_.resize(iTrisSubd_.size(),0);
   subdivideTriangles(iTrisSubd_, split_, detailMaxSquared);
 
-  std::vector<int> newTriangle;
-  int nbTriangles = triangles().size();
-  for(int i = nbTrisInit; i<nbTriangles; ++i)
-    newTriangle.push_back(i);
+  std::vector<int> newTriangle = iTrisNew_;
+  const int nbTrisSplit = iTrisNew_.size();
 
   mesh_->expandTriangles(newTriangle,1);
 
   //undo-redo
-  iTrisSubd_ = std::vector<int>(newTriangle.begin() + (nbTriangles - nbTrisInit), newTriangle.end());
+  iTrisSubd_ = std::vector<int>(newTriangle.begin() + nbTrisSplit, newTriangle.end());
   mesh_->getVerticesFromTriangles(iTrisSubd_, iVertsSubd_);
   mesh_->pushState(iTrisSubd_, iVertsSubd_);
 
@@ -60,44 +54,40 @@ void Topology::subdivide(std::vector<int> &iTris, float detailMaxSquared)
 
   std::vector<int> iTrisTemp;
   int nbTrisTemp = iTris.size();
-  ++Triangle::tagMask_;
+  triVisitation_.start(triangles().size());
   for(int i=0;i<nbTrisTemp;++i)
   {
     int iTri = iTris[i];
-    Triangle &t = triangles()[iTri];
-    if(t.tagFlag_==Triangle::tagMask_)
+    if(!triVisitation_.visit(iTri))
       continue;
-    t.tagFlag_ = Triangle::tagMask_;
     iTrisTemp.push_back(iTri);
   }
   iTris = iTrisTemp;
 
-  int nbTrianglesOld = triangles().size();
   while(newTriangle.size()>0)
     fillTriangles(newTriangle);
 
-  nbTriangles = triangles().size();
-  for(int i = nbTrianglesOld; i<nbTriangles; ++i)
-    iTris.push_back(i);
+  iTris.insert(iTris.end(), iTrisNew_.begin()+nbTrisSplit, iTrisNew_.end());
 
-  std::vector<int> vNew;
+  std::vector<int> vNew = iVertsNew_;
   int nbVertices = vertices().size();
-  for(int i = nbVertsInit; i<nbVertices; ++i)
-    vNew.push_back(i);
 
   int nbVNew = vNew.size();
   mesh_->expandVertices(vNew,1);
-  Sculpt::smoothFlat(mesh_, std::vector<int>(vNew.begin() + nbVNew, vNew.end()));
+  laplacian_.init(mesh_, std::vector<int>(vNew.begin() + nbVNew, vNew.end()));
+  Sculpt::smoothFlat(mesh_, laplacian_);
 
   nbVNew = vNew.size();
-#pragma omp parallel for
-  for(int i=0;i<nbVNew;++i) {
+  Visitation &selection = mesh_->getSelection();
+  selection.reserve(nbVertices);
+  ThreadPool::parallelFor(0, nbVNew, [&](int i) {
     if ((vertices()[vNew[i]]-centerPoint_).squaredNorm()<radiusSquared_) {
-      vertices()[vNew[i]].sculptFlag_ = Vertex::sculptMask_;
+      selection.visit(vNew[i]);
     } else {
-      vertices()[vNew[i]].sculptFlag_ = Vertex::sculptMask_-1;
+      selection.unvisit(vNew[i]);
     }
-  }
+  });
+  return !iTrisNew_.empty();
 }
 
 /** Detect which triangles to split and the edge that need to be split */
@@ -184,38 +174,30 @@ void Topology::subdivideTriangles(std::vector<int> &iTrisSubd, std::vector<int>
 */
 void Topology::halfEdgeSplit(int iTri, int iv1, int iv2, int iv3)
 {
+  int iNewTri = mesh_->addTriangle();
+  iTrisNew_.push_back(iNewTri);
   Triangle &t = triangles()[iTri];
-  Octree *leaf = t.leaf_;
-  std::vector<int> &iTrisLeaf = leaf->getTriangles();
+  int leaf = t.leaf_;
   Vertex &v1 = vertices()[iv1];
   Vertex &v2 = vertices()[iv2];
-  Vertex &v3 = vertices()[iv3];
-
-  std::pair<std::map<std::pair<int,int>,int>::iterator, bool> pair;
-  std::pair<std::pair<int,int>,int> entry;
-  entry.first.first = std::min(iv1,iv2);
-  entry.first.second = std::max(iv1,iv2);
-  entry.second = vertices().size();
-  pair = verticesMap_.insert(entry);
-  int ivMid=(*pair.first).second;
-
-  v3.addRingVertex(ivMid);
-  int iNewTri = triangles().size();
+
+  int ivMid = mesh_->getNextVertex();
+  const bool newVertex = verticesMap_.insert(iv1, iv2, ivMid);
+
+  vertRings().add(iv3, ivMid);
   t.vIndices_[0] = iv1;
   t.vIndices_[1] = ivMid;
   t.vIndices_[2] = iv3;
   Triangle newTri = Triangle(Vector3::Zero(),ivMid,iv2,iv3,iNewTri);
-  newTri.stateFlag_ = Mesh::stateMask_;
 
-  v3.addTriangle(iNewTri);
-  v2.replaceTriangle(iTri,iNewTri);
-  newTri.leaf_ = leaf;
-  newTri.posInLeaf_ = iTrisLeaf.size();
+  vertTris().add(iv3, iNewTri);
+  vertTris().replace(iv2, iTri, iNewTri);
 
-  if(pair.second) //new vertex
+  if(newVertex)
   {
-    Vertex vMidTest((v1+v2)*0.5f,vertices().size());
-    vMidTest.material_ = 0.5f*(v1.material_+v2.material_);
+    Vertex vMidTest((v1+v2)*0.5f);
+    const Vector3Vector &materials = mesh_->getMaterials();
+    Vector3 materialMid = 0.5f*(materials[iv1]+materials[iv2]);
     float dot = v1.normal_.dot(v2.normal_);
     float angle;
     if(dot<=-1.f) angle = static_cast<float>(M_PI);
@@ -230,25 +212,26 @@ void Topology::halfEdgeSplit(int iTri, int iv1, int iv2, int iv3)
     }
     vMidTest += vMidTest.normal_ * offset;
 
-    vMidTest.stateFlag_ = Mesh::stateMask_;
-    vMidTest.addRingVertex(iv1);
-    vMidTest.addRingVertex(iv2);
-    vMidTest.addRingVertex(iv3);
-    v1.replaceRingVertex(iv2,ivMid);
-    v2.replaceRingVertex(iv1,ivMid);
-    vMidTest.addTriangle(iTri);
-    vMidTest.addTriangle(iNewTri);
-    vertices().push_back(vMidTest);
+    vertRings().replace(iv1, iv2, ivMid);
+    vertRings().replace(iv2, iv1, ivMid);
+    if(ivMid<(int)vertices().size())
+      iVertsReused_.push_back(ivMid);
+    iVertsNew_.push_back(ivMid);
+    mesh_->addVertex(vMidTest, materialMid);
+    vertRings().add(ivMid, iv1);
+    vertRings().add(ivMid, iv2);
+    vertRings().add(ivMid, iv3);
+    vertTris().add(ivMid, iTri);
+    vertTris().add(ivMid, iNewTri);
   }
   else
   {
-    Vertex &vm = vertices()[ivMid];
-    vm.addRingVertex(iv3);
-    vm.addTriangle(iTri);
-    vm.addTriangle(iNewTri);
+    vertRings().add(ivMid, iv3);
+    vertTris().add(ivMid, iTri);
+    vertTris().add(ivMid, iNewTri);
   }
-  iTrisLeaf.push_back(iNewTri);
-  triangles().push_back(newTri);
+  triangles()[iNewTri] = newTri;
+  mesh_->getOctree()->addTriangle(leaf, triangles()[iNewTri]);
 }
 
 /**
@@ -267,25 +250,19 @@ void Topology::fillTriangles(std::vector<int> &iTris)
     const int iv1 = t.vIndices_[0];
     const int iv2 = t.vIndices_[1];
     const int iv3 = t.vIndices_[2];
-    Vertex &v1 = vertices()[iv1];
-    Vertex &v2 = vertices()[iv2];
-    Vertex &v3 = vertices()[iv3];
 
-    const std::pair<int,int> entry1(std::min(iv1,iv2), std::max(iv1,iv2));
-    std::map<std::pair<int,int>,int>::iterator it1 = verticesMap_.find(entry1);
-    const bool find1 = it1!=verticesMap_.end();
+    const int ivMid1 = verticesMap_.find(iv1,iv2);
+    const bool find1 = ivMid1!=-1;
 
-    const std::pair<int,int> entry2(std::min(iv2,iv3), std::max(iv2,iv3));
-    std::map<std::pair<int,int>,int>::iterator it2 = verticesMap_.find(entry2);
-    const bool find2 = it2!=verticesMap_.end();
+    const int ivMid2 = verticesMap_.find(iv2,iv3);
+    const bool find2 = ivMid2!=-1;
 
-    const std::pair<int,int> entry3(std::min(iv1,iv3), std::max(iv1,iv3));
-    std::map<std::pair<int,int>,int>::iterator it3 = verticesMap_.find(entry3);
-    const bool find3 = it3!=verticesMap_.end();
+    const int ivMid3 = verticesMap_.find(iv1,iv3);
+    const bool find3 = ivMid3!=-1;
 
-    const int num1 = v1.ringVertices_.size();
-    const int num2 = v2.ringVertices_.size();
-    const int num3 = v3.ringVertices_.size();
+    const int num1 = vertRings().size(iv1);
+    const int num2 = vertRings().size(iv2);
+    const int num3 = vertRings().size(iv3);
     int split = 0;
     if(find1)
     {
@@ -311,45 +288,40 @@ void Topology::fillTriangles(std::vector<int> &iTris)
     else if(find3) split = 3;
 
     if(split==1)
-      fillTriangle(iTri,iv1,iv2,iv3,it1->second);
+      fillTriangle(iTri,iv1,iv2,iv3,ivMid1);
     else if(split==2)
-      fillTriangle(iTri,iv2,iv3,iv1,it2->second);
+      fillTriangle(iTri,iv2,iv3,iv1,ivMid2);
     else if(split==3)
-      fillTriangle(iTri,iv3,iv1,iv2,it3->second);
+      fillTriangle(iTri,iv3,iv1,iv2,ivMid3);
     else continue;
     iTrisNext.push_back(iTri);
-    iTrisNext.push_back(triangles().size()-1);
+    iTrisNext.push_back(iTrisNew_.back());
   }
   iTris = iTrisNext;
 }
 
-/** Fill crack on one triangle */
-void Topology::fillTriangle(int iTri, int iv1, int iv2, int iv3, int ivMid)
+/** Fill crack on one triangle, returns the new triangle */
+int Topology::fillTriangle(int iTri, int iv1, int iv2, int iv3, int ivMid)
 {
+  int iNewTri = mesh_->addTriangle();
+  iTrisNew_.push_back(iNewTri);
   Triangle &t = triangles()[iTri];
   t.vIndices_[0] = iv1;
   t.vIndices_[1] = ivMid;
   t.vIndices_[2] = iv3;
-  Octree *leaf = t.leaf_;
-  std::vector<int> &iTrisLeaf = leaf->getTriangles();
+  int leaf = t.leaf_;
 
-  Vertex &v2 = vertices()[iv2];
-  Vertex &v3 = vertices()[iv3];
-  Vertex &vMid = vertices()[ivMid];
-  vMid.addRingVertex(iv3);
-  v3.addRingVertex(ivMid);
-
-  int iNewTri = triangles().size();
-  vMid.addTriangle(iTri);
-  vMid.addTriangle(iNewTri);
+  vertRings().add(ivMid, iv3);
+  vertRings().add(iv3, ivMid);
+
+  vertTris().add(ivMid, iTri);
+  vertTris().add(ivMid, iNewTri);
   Triangle newTri = Triangle(Vector3::Zero(),ivMid,iv2,iv3,iNewTri);
-  newTri.stateFlag_ = Mesh::stateMask_;
-  newTri.leaf_ = leaf;
-  newTri.posInLeaf_ = iTrisLeaf.size();
 
-  v3.addTriangle(iNewTri);
-  v2.replaceTriangle(iTri,iNewTri);
+  vertTris().add(iv3, iNewTri);
+  vertTris().replace(iv2, iTri, iNewTri);
 
-  iTrisLeaf.push_back(iNewTri);
-  triangles().push_back(newTri);
+  triangles()[iNewTri] = newTri;
+  mesh_->getOctree()->addTriangle(leaf, triangles()[iNewTri]);
+  return iNewTri;
 }
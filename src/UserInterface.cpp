@@ -534,7 +534,7 @@ void UserInterface::update(LeapInteraction* leap, Sculpt* sculpt) {
   static const float FORCE_SMOOTH_STRENGTH = 0.9f;
   static const float UI_INACTIVITY_FADE_TIME = 10.0f;
 
-  std::vector<ci::Vec4f> tips = leap->getTips();
+  const std::vector<ci::Vec4f>& tips = leap->getTips();
   LM_ASSERT_IDENTICAL(tips.size());
   for (unsigned i = 0; i < tips.size(); i++)
   {
@@ -1,17 +1,12 @@
 #include "StdAfx.h"
 #include "Vertex.h"
 
-int Vertex::tagMask_ = 1;
-int Vertex::sculptMask_ = 1;
-
 /** Constructor */
-Vertex::Vertex(float x, float y, float z, int id) : Vector3(x, y, z), tagFlag_(1), sculptFlag_(1),
-  stateFlag_(1), id_(id), normal_(Vector3::Zero()), material_(Vector3::Ones())
+Vertex::Vertex(float x, float y, float z) : Vector3(x, y, z), normal_(Vector3::Zero()), tagFlag_(1)
 {}
 
 /** Constructor */
-Vertex::Vertex(const Vector3& vec, int id) : Vector3(vec), tagFlag_(1), sculptFlag_(1),
-  stateFlag_(1), id_(id), normal_(Vector3::Zero()), material_(Vector3::Ones())
+Vertex::Vertex(const Vector3& vec) : Vector3(vec), normal_(Vector3::Zero()), tagFlag_(1)
 {}
 
 /** Assignment operator */
@@ -23,72 +18,6 @@ Vertex& Vertex::operator=(const Vector3& vec)
   return *this;
 }
 
-/** Destructor */
-Vertex::~Vertex()
-{}
-
-/** Replace triangle */
-void Vertex::replaceTriangle(int iTriOld, int iTriNew)
-{
-  int nbTris=tIndices_.size();
-  for(int i=0;i<nbTris;++i)
-  {
-    if(iTriOld==tIndices_[i])
-    {
-      tIndices_[i]=iTriNew;
-      return;
-    }
-  }
-  LM_ASSERT(false, "Triangle not found");
-}
-
-/** Replace ring vertex */
-void Vertex::replaceRingVertex(int iVerOld, int iVerNew)
-{
-  int nbVerts=ringVertices_.size();
-  for(int i=0;i<nbVerts;++i)
-  {
-    if(iVerOld==ringVertices_[i])
-    {
-      ringVertices_[i]=iVerNew;
-      return;
-    }
-  }
-  LM_ASSERT(false, "Ring vertex not found");
-}
-
-/** Remove triangle */
-void Vertex::removeTriangle(int iTri)
-{
-  int nbTris=tIndices_.size();
-  for(int i=0;i<nbTris;++i)
-  {
-    if(iTri==tIndices_[i])
-    {
-      tIndices_[i]=tIndices_.back();
-      tIndices_.pop_back();
-      return;
-    }
-  }
-  LM_ASSERT(false, "Triangle not found");
-}
-
-/** Remove ring vertex */
-void Vertex::removeRingVertex(int iVer)
-{
-  int nbVerts=ringVertices_.size();
-  for(int i=0;i<nbVerts;++i)
-  {
-    if(iVer==ringVertices_[i])
-    {
-      ringVertices_[i]=ringVertices_.back();
-      ringVertices_.pop_back();
-      return;
-    }
-  }
-  LM_ASSERT(false, "Ring vertex not found");
-}
-
 /** < operator */
 bool operator<( const Vertex  &a, const  Vertex & b)
 {
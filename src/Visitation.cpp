@@ -0,0 +1,35 @@
+#include "StdAfx.h"
+#include "Visitation.h"
+#include <algorithm>
+#include <limits>
+
+/** Constructor */
+Visitation::Visitation() : stamp_(1)
+{}
+
+/** Destructor */
+Visitation::~Visitation()
+{}
+
+/**
+* Start a new query, every element is unvisited. Elements can be visited
+* beyond nbElements (the stamps grow as needed) but reserving avoids it
+* inside parallel loops.
+*/
+void Visitation::start(int nbElements)
+{
+  if(stamp_==std::numeric_limits<int>::max())
+  {
+    std::fill(stamps_.begin(), stamps_.end(), 0);
+    stamp_ = 0;
+  }
+  ++stamp_;
+  reserve(nbElements);
+}
+
+/** Make room for nbElements without changing the current query */
+void Visitation::reserve(int nbElements)
+{
+  if(nbElements>static_cast<int>(stamps_.size()))
+    stamps_.resize(nbElements, 0);
+}